@@ -7,19 +7,115 @@ set -e
 
 # Configuration
 BOARD="nrf52840dk_nrf52840"
-BUILD_DIR="build"
 CONFIG_FILE="prj.conf"
 
-echo "Building Adaptive BLE Sensor Node for $BOARD..."
+# Profile: dev (default, logging on the UART console), production
+# (prj_production.conf on top: no log, no UART), ota (production plus
+# prj_ota.conf and MCUboot from sysbuild_ota.conf; needs OTA_KEY_FILE and
+# OTA_PASSKEY), compare (build dev
+# and production and print their sizes side by side), sim (native_sim
+# build with prj_sim.conf, run against the power model), or check
+# (twister over testcase.yaml: the sim run plus build-only dev and
+# production)
+PROFILE="${1:-dev}"
+
+build_profile() {
+    local profile=$1
+    local build_dir=$2
+    local overlay=""
+    local sysbuild=""
+
+    if [ "$profile" = "production" ]; then
+        overlay="-DOVERLAY_CONFIG=prj_production.conf"
+    elif [ "$profile" = "ota" ]; then
+        # Images signed with MCUboot's public development key could be
+        # replaced by anyone, and a node without a passkey cannot pair
+        if [ -z "$OTA_KEY_FILE" ] || [ ! -f "$OTA_KEY_FILE" ]; then
+            echo "Set OTA_KEY_FILE to the deployment's MCUboot signing key (PEM)"
+            exit 1
+        fi
+        if [ -z "$OTA_PASSKEY" ] || [ "$OTA_PASSKEY" -eq 0 ] 2>/dev/null; then
+            echo "Set OTA_PASSKEY to the deployment's six-digit pairing passkey"
+            exit 1
+        fi
+        overlay="-DOVERLAY_CONFIG=prj_production.conf;prj_ota.conf -DSB_CONF_FILE=sysbuild_ota.conf"
+        overlay="$overlay -DSB_CONFIG_BOOT_SIGNATURE_KEY_FILE=\"$(realpath "$OTA_KEY_FILE")\""
+        overlay="$overlay -DCONFIG_APP_CONNECT_PASSKEY=$OTA_PASSKEY"
+        sysbuild="--sysbuild"
+    elif [ "$profile" != "dev" ]; then
+        echo "Unknown profile: $profile (dev, production, ota, compare, sim or check)"
+        exit 1
+    fi
+
+    echo "Building Adaptive BLE Sensor Node for $BOARD ($profile)..."
+
+    # Create build directory
+    mkdir -p $build_dir
+
+    # Build the project
+    west build -b $BOARD -d $build_dir $sysbuild -- -DCONF_FILE=$CONFIG_FILE $overlay
+}
+
+# text/data/bss of a build's ELF
+elf_size() {
+    ${SIZE:-arm-zephyr-eabi-size} "$1/zephyr/zephyr.elf" | awk 'NR == 2 { print $1, $2, $3 }'
+}
 
-# Create build directory
-mkdir -p $BUILD_DIR
+if [ "$PROFILE" = "compare" ]; then
+    build_profile dev build
+    build_profile production build_production
+
+    read dev_text dev_data dev_bss <<< "$(elf_size build)"
+    read prod_text prod_data prod_bss <<< "$(elf_size build_production)"
+
+    echo ""
+    printf "%-12s %10s %10s %10s\n" "" "flash" "ram" "delta flash"
+    printf "%-12s %10d %10d %10s\n" "dev" $((dev_text + dev_data)) $((dev_data + dev_bss)) "-"
+    printf "%-12s %10d %10d %10d\n" "production" $((prod_text + prod_data)) \
+           $((prod_data + prod_bss)) $((prod_text + prod_data - dev_text - dev_data))
+    echo ""
+    echo "Only sizes are compared here. The per-cycle charge the builds log or"
+    echo "advertise is an estimate: measured awake time times the assumed currents"
+    echo "in CONFIG_APP_CYCLE_STATS_*_CURRENT_EST_UA. The UART share of it is that"
+    echo "assumption by construction, so it cannot show what the production build"
+    echo "saves. Measure both builds with a power analyser on the VBAT rail."
+    exit 0
+fi
+
+if [ "$PROFILE" = "sim" ]; then
+    echo "Building Adaptive BLE Sensor Node for native_sim..."
+    west build -b native_sim -d build_sim -- -DCONF_FILE=prj_sim.conf
+
+    # Runs until CONFIG_APP_SIM_DAYS of simulated time or the modeled cell
+    # is empty, then prints the charge breakdown and predicted lifetime
+    ./build_sim/zephyr/zephyr.exe
+    exit 0
+fi
+
+if [ "$PROFILE" = "check" ]; then
+    # Fails if any build fails or the simulated run does not finish
+    west twister -T . --integration --outdir build_twister
+    exit 0
+fi
+
+BUILD_DIR="build"
+if [ "$PROFILE" = "production" ]; then
+    BUILD_DIR="build_production"
+elif [ "$PROFILE" = "ota" ]; then
+    BUILD_DIR="build_ota"
+fi
 
-# Build the project
-west build -b $BOARD -d $BUILD_DIR -- -DCONF_FILE=$CONFIG_FILE
+build_profile $PROFILE $BUILD_DIR
 
 echo "Build completed successfully!"
-echo "Binary location: $BUILD_DIR/zephyr/zephyr.hex"
+if [ "$PROFILE" = "ota" ]; then
+    # MCUboot and the application; flash once over SWD, then update in
+    # maintenance windows
+    echo "Binary location: $BUILD_DIR/merged.hex"
+    echo "Update image: $BUILD_DIR/dfu_application.zip"
+else
+    echo "Binary location: $BUILD_DIR/zephyr/zephyr.hex"
+fi
 echo ""
 echo "To flash the device:"
 echo "west flash -d $BUILD_DIR"
@@ -1,14 +1,51 @@
 #include "adaptive_scheduler.h"
 #include "rv3028.h"
+#include "battery_monitor.h"
+#include "cycle_stats.h"
+#include "node_config.h"
 #include <zephyr/device.h>
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/logging/log.h>
+#include <stdlib.h>
 
 LOG_MODULE_REGISTER(adaptive_scheduler, LOG_LEVEL_INF);
 
+// RV-3028 INT output (open drain, active low) on P0.02
+#define RTC_INT_PIN 2
+
 static const struct device *rtc_int_gpio;
 static power_tier_t current_tier = POWER_TIER_NORMAL;
 
+// RV-3028 UNIX counter at the last cold boot, which starts the lifetime
+// clock, and the seconds elapsed since then as of this wake
+static uint32_t epoch_s;
+static uint32_t runtime_s;
+
+#define LIFETIME_TARGET_S   ((uint64_t)CONFIG_APP_LIFETIME_TARGET_DAYS * 24 * 3600)
+#define CAPACITY_UC         ((uint64_t)CONFIG_APP_BATTERY_CAPACITY_MAH * 3600 * 1000)
+
+static int configure_rtc_int_gpio(void)
+{
+    int ret;
+
+    // Configure RTC interrupt GPIO (P0.02)
+    rtc_int_gpio = DEVICE_DT_GET(DT_ALIAS(rtc_int));
+    if (!device_is_ready(rtc_int_gpio)) {
+        LOG_ERR("RTC interrupt GPIO not ready");
+        return -ENODEV;
+    }
+
+    // Configure as active-low input with pull-up
+    gpio_flags_t flags = GPIO_INPUT | GPIO_PULL_UP | GPIO_ACTIVE_LOW;
+    ret = gpio_pin_configure(rtc_int_gpio, RTC_INT_PIN, flags);
+    if (ret != 0) {
+        LOG_ERR("Failed to configure RTC interrupt GPIO: %d", ret);
+        return ret;
+    }
+
+    return 0;
+}
+
 int adaptive_scheduler_init(void)
 {
     // Initialize RV-3028 RTC
@@ -18,35 +55,87 @@ int adaptive_scheduler_init(void)
         return ret;
     }
 
-    // Configure RTC interrupt GPIO (P0.02)
-    rtc_int_gpio = DEVICE_DT_GET(DT_ALIAS(rtc_int));
-    if (!device_is_ready(rtc_int_gpio)) {
-        LOG_ERR("RTC interrupt GPIO not ready");
-        return -ENODEV;
+    ret = configure_rtc_int_gpio();
+    if (ret != 0) {
+        return ret;
     }
 
-    // Configure as input with pull-up
-    gpio_flags_t flags = GPIO_INPUT | GPIO_PULL_UP;
-    ret = gpio_pin_configure(rtc_int_gpio, 2, flags);
+    ret = rv3028_get_unix_time(&epoch_s);
     if (ret != 0) {
-        LOG_ERR("Failed to configure RTC interrupt GPIO: %d", ret);
         return ret;
     }
+    runtime_s = 0;
 
     LOG_INF("Adaptive scheduler initialized with RV-3028");
     return 0;
 }
 
+// Warm wake: restore the tier from before SYSTEM OFF so hysteresis carries
+// over, the epoch so the lifetime budget does, and reuse the cached RTC
+// configuration
+int adaptive_scheduler_resume(power_tier_t tier, uint32_t epoch,
+                              const struct rv3028_config *rtc_config)
+{
+    int ret = rv3028_resume(rtc_config);
+    if (ret != 0) {
+        LOG_ERR("Failed to resume RV-3028: %d", ret);
+        return ret;
+    }
+
+    ret = configure_rtc_int_gpio();
+    if (ret != 0) {
+        return ret;
+    }
+
+    current_tier = (tier <= POWER_TIER_SURVIVAL) ? tier : POWER_TIER_NORMAL;
+    epoch_s = epoch;
+
+    LOG_DBG("Adaptive scheduler resumed in tier %d", current_tier);
+    return 0;
+}
+
+power_tier_t adaptive_scheduler_get_current_tier(void)
+{
+    return current_tier;
+}
+
+uint32_t adaptive_scheduler_get_epoch(void)
+{
+    return epoch_s;
+}
+
+// Time since cold boot from the RTC's own seconds counter, so early or
+// late wakes do not skew the lifetime budget. On a failed read the last
+// value stands.
+int adaptive_scheduler_update_runtime(void)
+{
+    uint32_t now_s;
+    int ret = rv3028_get_unix_time(&now_s);
+
+    if (ret != 0) {
+        return ret;
+    }
+
+    runtime_s = now_s - epoch_s;
+    return 0;
+}
+
+uint32_t adaptive_scheduler_get_runtime(void)
+{
+    return runtime_s;
+}
+
 power_tier_t adaptive_scheduler_get_tier(uint16_t battery_mv)
 {
+    const struct node_config *cfg = node_config_get();
     power_tier_t new_tier;
     
     // Determine tier based on battery voltage with hysteresis
-    if (battery_mv >= BATTERY_THRESHOLD_NORMAL_HIGH) {
+    if (battery_mv >= cfg->battery_high_mv[POWER_TIER_NORMAL]) {
         new_tier = POWER_TIER_NORMAL;
-    } else if (battery_mv >= BATTERY_THRESHOLD_CONSERVE_HIGH) {
+    } else if (battery_mv >= cfg->battery_high_mv[POWER_TIER_CONSERVE]) {
         new_tier = POWER_TIER_CONSERVE;
-    } else if (battery_mv >= BATTERY_THRESHOLD_RESERVE_HIGH) {
+    } else if (battery_mv >= cfg->battery_high_mv[POWER_TIER_RESERVE]) {
         new_tier = POWER_TIER_RESERVE;
     } else {
         new_tier = POWER_TIER_SURVIVAL;
@@ -57,22 +146,22 @@ power_tier_t adaptive_scheduler_get_tier(uint16_t battery_mv)
         // Only allow tier changes in one direction at a time
         if (new_tier > current_tier) {
             // Moving to higher power tier (lower battery) - use low threshold
-            if (battery_mv <= BATTERY_THRESHOLD_NORMAL_LOW && current_tier == POWER_TIER_NORMAL) {
+            if (battery_mv <= cfg->battery_low_mv[POWER_TIER_NORMAL] && current_tier == POWER_TIER_NORMAL) {
                 new_tier = POWER_TIER_CONSERVE;
-            } else if (battery_mv <= BATTERY_THRESHOLD_CONSERVE_LOW && current_tier == POWER_TIER_CONSERVE) {
+            } else if (battery_mv <= cfg->battery_low_mv[POWER_TIER_CONSERVE] && current_tier == POWER_TIER_CONSERVE) {
                 new_tier = POWER_TIER_RESERVE;
-            } else if (battery_mv <= BATTERY_THRESHOLD_RESERVE_LOW && current_tier == POWER_TIER_RESERVE) {
+            } else if (battery_mv <= cfg->battery_low_mv[POWER_TIER_RESERVE] && current_tier == POWER_TIER_RESERVE) {
                 new_tier = POWER_TIER_SURVIVAL;
             } else {
                 new_tier = current_tier; // Stay in current tier
             }
         } else {
             // Moving to lower power tier (higher battery) - use high threshold
-            if (battery_mv >= BATTERY_THRESHOLD_NORMAL_HIGH && current_tier == POWER_TIER_CONSERVE) {
+            if (battery_mv >= cfg->battery_high_mv[POWER_TIER_NORMAL] && current_tier == POWER_TIER_CONSERVE) {
                 new_tier = POWER_TIER_NORMAL;
-            } else if (battery_mv >= BATTERY_THRESHOLD_CONSERVE_HIGH && current_tier == POWER_TIER_RESERVE) {
+            } else if (battery_mv >= cfg->battery_high_mv[POWER_TIER_CONSERVE] && current_tier == POWER_TIER_RESERVE) {
                 new_tier = POWER_TIER_CONSERVE;
-            } else if (battery_mv >= BATTERY_THRESHOLD_RESERVE_HIGH && current_tier == POWER_TIER_SURVIVAL) {
+            } else if (battery_mv >= cfg->battery_high_mv[POWER_TIER_RESERVE] && current_tier == POWER_TIER_SURVIVAL) {
                 new_tier = POWER_TIER_RESERVE;
             } else {
                 new_tier = current_tier; // Stay in current tier
@@ -88,36 +177,201 @@ power_tier_t adaptive_scheduler_get_tier(uint16_t battery_mv)
     return current_tier;
 }
 
+// Per-tier rates come from the runtime configuration
 uint32_t adaptive_scheduler_get_interval(power_tier_t tier)
+{
+    const struct node_config *cfg = node_config_get();
+
+    return cfg->wake_interval_ms[(tier <= POWER_TIER_SURVIVAL) ? tier : POWER_TIER_NORMAL];
+}
+
+uint8_t adaptive_scheduler_get_adv_events(power_tier_t tier)
+{
+    const struct node_config *cfg = node_config_get();
+
+    return cfg->adv_events[(tier <= POWER_TIER_SURVIVAL) ? tier : POWER_TIER_NORMAL];
+}
+
+// Spend the remaining charge evenly over the remaining target lifetime.
+// The tier bounds the result: a cycle never runs slower or with fewer
+// events than its own tier's fixed rate, and never faster or with more
+// events than the next better tier's. A healthy cell therefore samples as
+// fast as its budget allows, while the voltage tiers stay a safety net.
+void adaptive_scheduler_plan(power_tier_t tier, uint16_t battery_mv, struct wake_plan *plan)
+{
+    uint32_t max_interval_ms = adaptive_scheduler_get_interval(tier);
+    uint32_t min_interval_ms = (tier > POWER_TIER_NORMAL) ?
+                               adaptive_scheduler_get_interval(tier - 1) :
+                               CONFIG_APP_WAKE_INTERVAL_MIN_S * 1000U;
+    uint8_t min_events = adaptive_scheduler_get_adv_events(tier);
+    uint8_t max_events = (tier > POWER_TIER_NORMAL) ?
+                         adaptive_scheduler_get_adv_events(tier - 1) : min_events;
+
+    // Average current the remaining charge sustains until the target date
+    uint64_t remaining_uc = CAPACITY_UC * battery_monitor_get_percentage(battery_mv) / 100;
+    uint64_t horizon_s = (LIFETIME_TARGET_S > runtime_s + ENERGY_MIN_HORIZON_S) ?
+                         LIFETIME_TARGET_S - runtime_s : ENERGY_MIN_HORIZON_S;
+    uint64_t budget_na = remaining_uc * 1000 / horizon_s;
+
+    plan->interval_ms = max_interval_ms;
+    plan->adv_events = min_events;
+
+    if (budget_na <= ENERGY_SLEEP_CURRENT_NA) {
+        LOG_WRN("Energy budget %u nA below sleep current", (uint32_t)budget_na);
+        return;
+    }
+    budget_na -= ENERGY_SLEEP_CURRENT_NA;
+
+    // Charge per wake, measured by the cycle statistics, with the
+    // advertising share spread over the wakes between transmissions;
+    // uC / nA gives seconds
+    uint32_t base_uc = cycle_stats_wake_charge_est_uc();
+    uint64_t wake_uc = base_uc +
+                       (uint64_t)min_events * ENERGY_ADV_EVENT_CHARGE_UC /
+                       CONFIG_APP_ADV_EVERY_N_SAMPLES;
+    uint64_t interval_ms = wake_uc * 1000 * 1000 / budget_na;
+
+    // Whole seconds, so a steady budget leaves the RTC timer untouched
+    plan->interval_ms = CLAMP(interval_ms, min_interval_ms, max_interval_ms) / 1000 * 1000;
+
+    // Surplus at the fastest allowed rate buys extra advertising events
+    uint64_t cycle_uc = budget_na * plan->interval_ms / (1000 * 1000);
+
+    if (cycle_uc > base_uc) {
+        uint64_t events = (cycle_uc - base_uc) *
+                          CONFIG_APP_ADV_EVERY_N_SAMPLES / ENERGY_ADV_EVENT_CHARGE_UC;
+
+        plan->adv_events = CLAMP(events, min_events, max_events);
+    }
+
+    LOG_DBG("Budget %u nA: wake every %u ms, %u adv events",
+            (uint32_t)budget_na, plan->interval_ms, plan->adv_events);
+}
+
+// Sensor measurement profile for each tier: conversion time and energy
+// follow the battery budget
+const struct bme280_profile *adaptive_scheduler_get_profile(power_tier_t tier)
 {
     switch (tier) {
         case POWER_TIER_NORMAL:
-            return WAKE_INTERVAL_NORMAL;
+            return &bme280_profile_high_precision;
         case POWER_TIER_CONSERVE:
-            return WAKE_INTERVAL_CONSERVE;
+            return &bme280_profile_standard;
         case POWER_TIER_RESERVE:
-            return WAKE_INTERVAL_RESERVE;
+            return &bme280_profile_low_power;
         case POWER_TIER_SURVIVAL:
-            return WAKE_INTERVAL_SURVIVAL;
+            return &bme280_profile_temperature_only;
         default:
-            return WAKE_INTERVAL_NORMAL;
+            return &bme280_profile_standard;
+    }
+}
+
+// True when the channel moved past its deadband, or was measured in only
+// one of the two readings. A deadband of zero reports every change.
+static bool channel_changed(int32_t value, int32_t last, int32_t not_measured,
+                            uint32_t deadband)
+{
+    if (value == not_measured || last == not_measured) {
+        return value != last;
+    }
+
+    return (uint32_t)abs(value - last) > deadband;
+}
+
+// The longest the node may stay silent has passed since the last report
+bool adaptive_scheduler_heartbeat_due(const struct report_state *report)
+{
+    return !report->valid ||
+           runtime_s - report->runtime_s >= CONFIG_APP_REPORT_HEARTBEAT_S;
+}
+
+// Decide whether a reading is worth turning the radio on for
+bool adaptive_scheduler_report_due(const struct report_state *report,
+                                   const struct sample_record *record)
+{
+    const struct sample_record *last = &report->last;
+
+    if (adaptive_scheduler_heartbeat_due(report)) {
+        return true;
     }
+
+    return channel_changed(record->temperature, last->temperature, SAMPLE_TEMP_NOT_MEASURED,
+                           CONFIG_APP_DEADBAND_TEMP) ||
+           channel_changed(record->pressure, last->pressure, SAMPLE_VALUE_NOT_MEASURED,
+                           CONFIG_APP_DEADBAND_PRESS) ||
+           channel_changed(record->humidity, last->humidity, SAMPLE_VALUE_NOT_MEASURED,
+                           CONFIG_APP_DEADBAND_HUM);
+}
+
+void adaptive_scheduler_report_sent(struct report_state *report,
+                                    const struct sample_record *record)
+{
+    report->last = *record;
+    report->runtime_s = runtime_s;
+    report->valid = 1;
+}
+
+// A maintenance window is due once CONFIG_APP_MAINTENANCE_INTERVAL_H of
+// runtime have passed since the last one; the survival tier keeps its
+// charge for readings
+bool adaptive_scheduler_maintenance_due(uint32_t last_s, power_tier_t tier)
+{
+#if defined(CONFIG_APP_MAINTENANCE)
+    return tier != POWER_TIER_SURVIVAL &&
+           runtime_s - last_s >= (uint32_t)CONFIG_APP_MAINTENANCE_INTERVAL_H * 3600;
+#else
+    ARG_UNUSED(last_s);
+    ARG_UNUSED(tier);
+    return false;
+#endif
+}
+
+// A scan request may open a configuration window once
+// CONFIG_APP_REMOTE_CONFIG_HOLDOFF_S of runtime have passed since the last
+// one, so scanners passing by cannot keep the node awake
+bool adaptive_scheduler_config_window_due(uint32_t last_s, power_tier_t tier)
+{
+#if defined(CONFIG_APP_REMOTE_CONFIG_SCAN_TRIGGER)
+    return tier != POWER_TIER_SURVIVAL &&
+           runtime_s - last_s >= CONFIG_APP_REMOTE_CONFIG_HOLDOFF_S;
+#else
+    ARG_UNUSED(last_s);
+    ARG_UNUSED(tier);
+    return false;
+#endif
 }
 
 int adaptive_scheduler_set_next_wake(uint32_t interval_ms)
 {
     int ret;
     
-    // Clear any existing alarm
-    rv3028_clear_alarm();
+    // The countdown timer reloads itself, so it is only reprogrammed when
+    // the plan changes the period
+    ret = rv3028_start_periodic_timer(interval_ms / 1000);
+    if (ret != 0) {
+        LOG_ERR("Failed to start RV-3028 periodic timer: %d", ret);
+        return ret;
+    }
+    
+    // A countdown event only pulses INT for tRTN, so a timer wake needs no
+    // I2C traffic here. If INT is still low (a stale flag after cold boot),
+    // clear TF: the level would wake the SoC straight out of SYSTEM OFF
+    ret = gpio_pin_get(rtc_int_gpio, RTC_INT_PIN);
+    if (ret > 0) {
+        ret = rv3028_clear_timer_flag();
+    }
+    if (ret < 0) {
+        LOG_ERR("Failed to release RV-3028 INT: %d", ret);
+        return ret;
+    }
     
-    // Set wakeup time using RV-3028
-    ret = rv3028_set_wakeup_time(interval_ms / 1000);
+    // Level sense on INT is the SYSTEM OFF wake source
+    ret = gpio_pin_interrupt_configure(rtc_int_gpio, RTC_INT_PIN, GPIO_INT_LEVEL_ACTIVE);
     if (ret != 0) {
-        LOG_ERR("Failed to set RV-3028 wakeup time: %d", ret);
+        LOG_ERR("Failed to configure RTC wake GPIO: %d", ret);
         return ret;
     }
     
-    LOG_INF("RV-3028 alarm set for %lu seconds from now", interval_ms / 1000);
+    LOG_INF("RV-3028 wake every %lu seconds", interval_ms / 1000);
     return 0;
 }
@@ -2,6 +2,9 @@
 #define ADAPTIVE_SCHEDULER_H
 
 #include <zephyr/kernel.h>
+#include "rv3028.h"
+#include "bme280.h"
+#include "sample_ring.h"
 
 // Power tiers based on battery voltage
 typedef enum {
@@ -11,12 +14,30 @@ typedef enum {
     POWER_TIER_SURVIVAL = 3   // 3.4V - 3.2V: 60 min intervals
 } power_tier_t;
 
-// Wake intervals for each tier (in milliseconds)
+// Wake intervals for each tier (in milliseconds). These and the event
+// counts and thresholds below are the defaults of the runtime
+// configuration (node_config.h).
 #define WAKE_INTERVAL_NORMAL    (5 * 60 * 1000)   // 5 minutes
 #define WAKE_INTERVAL_CONSERVE  (15 * 60 * 1000)  // 15 minutes
 #define WAKE_INTERVAL_RESERVE   (30 * 60 * 1000)  // 30 minutes
 #define WAKE_INTERVAL_SURVIVAL  (60 * 60 * 1000)  // 60 minutes
 
+// Advertising events per transmission for each tier. The controller stops the
+// advertising set after this many events and reports it through the sent callback.
+#define ADV_EVENTS_NORMAL      5
+#define ADV_EVENTS_CONSERVE    3
+#define ADV_EVENTS_RESERVE     2
+#define ADV_EVENTS_SURVIVAL    1
+
+// Charge model for the energy budget. The figures are estimates set in
+// Kconfig (see there for their sources); measure the board and override them.
+// After the first wake the per-wake figure gives way to the cycle statistics,
+// which time the awake phase and apply an estimated current to it.
+#define ENERGY_WAKE_CHARGE_UC       CONFIG_APP_ENERGY_WAKE_CHARGE_UC
+#define ENERGY_ADV_EVENT_CHARGE_UC  CONFIG_APP_ENERGY_ADV_EVENT_CHARGE_UC
+#define ENERGY_SLEEP_CURRENT_NA     CONFIG_APP_ENERGY_SLEEP_CURRENT_NA
+#define ENERGY_MIN_HORIZON_S        (7 * 24 * 3600) // Budget past the target lifetime
+
 // Battery voltage thresholds with hysteresis (in mV)
 #define BATTERY_THRESHOLD_NORMAL_HIGH    3800
 #define BATTERY_THRESHOLD_NORMAL_LOW     3600
@@ -25,10 +46,39 @@ typedef enum {
 #define BATTERY_THRESHOLD_RESERVE_HIGH   3400
 #define BATTERY_THRESHOLD_RESERVE_LOW    3200
 
+// Schedule for one wake cycle, from the energy budget
+struct wake_plan {
+    uint32_t interval_ms;      // Time until the next wake
+    uint8_t adv_events;        // Advertising events if this cycle transmits
+};
+
+// Last transmitted reading, kept in retained RAM for change-triggered reporting
+struct report_state {
+    struct sample_record last; // Newest reading of the last transmission
+    uint32_t runtime_s;        // Scheduler runtime when it was taken
+    uint8_t valid;             // Nonzero once anything has been transmitted
+};
+
 // Function prototypes
 int adaptive_scheduler_init(void);
+int adaptive_scheduler_resume(power_tier_t tier, uint32_t epoch_s,
+                              const struct rv3028_config *rtc_config);
+power_tier_t adaptive_scheduler_get_current_tier(void);
 power_tier_t adaptive_scheduler_get_tier(uint16_t battery_mv);
 uint32_t adaptive_scheduler_get_interval(power_tier_t tier);
+uint8_t adaptive_scheduler_get_adv_events(power_tier_t tier);
+void adaptive_scheduler_plan(power_tier_t tier, uint16_t battery_mv, struct wake_plan *plan);
+int adaptive_scheduler_update_runtime(void);
+uint32_t adaptive_scheduler_get_runtime(void);
+uint32_t adaptive_scheduler_get_epoch(void);
+const struct bme280_profile *adaptive_scheduler_get_profile(power_tier_t tier);
+bool adaptive_scheduler_heartbeat_due(const struct report_state *report);
+bool adaptive_scheduler_report_due(const struct report_state *report,
+                                   const struct sample_record *record);
+void adaptive_scheduler_report_sent(struct report_state *report,
+                                    const struct sample_record *record);
+bool adaptive_scheduler_maintenance_due(uint32_t last_s, power_tier_t tier);
+bool adaptive_scheduler_config_window_due(uint32_t last_s, power_tier_t tier);
 int adaptive_scheduler_set_next_wake(uint32_t interval_ms);
 
 #endif // ADAPTIVE_SCHEDULER_H
@@ -1,11 +1,67 @@
 #include "battery_monitor.h"
 #include <zephyr/device.h>
 #include <zephyr/drivers/adc.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/pm/device_runtime.h>
 #include <zephyr/logging/log.h>
+#include <string.h>
 
 LOG_MODULE_REGISTER(battery_monitor, LOG_LEVEL_INF);
 
+// Millivolts per ADC count in Q16, folding the reference, gain, divider
+// and board trim into one integer multiply
+#define BATTERY_DIVIDER_TOTAL_KOHM (BATTERY_DIVIDER_TOP_KOHM + BATTERY_DIVIDER_BOTTOM_KOHM)
+#define BATTERY_MV_PER_LSB_Q16 \
+    ((((uint64_t)ADC_FULL_SCALE_MV * BATTERY_DIVIDER_TOTAL_KOHM << 16) * \
+      (1000000 + CONFIG_APP_BATTERY_GAIN_TRIM_PPM) / 1000000 + \
+      ((uint64_t)BATTERY_DIVIDER_BOTTOM_KOHM << ADC_RESOLUTION) / 2) / \
+     ((uint64_t)BATTERY_DIVIDER_BOTTOM_KOHM << ADC_RESOLUTION))
+
+BUILD_ASSERT(BATTERY_MV_PER_LSB_Q16 * (1 << ADC_RESOLUTION) <= UINT32_MAX,
+             "Battery conversion must fit in 32 bits");
+
+// LiPo open-circuit discharge curve at room temperature, highest first
+static const struct {
+    uint16_t mv;
+    uint8_t percent;
+} lipo_curve[] = {
+    { 4200, 100 },
+    { 4110, 90 },
+    { 4020, 80 },
+    { 3950, 70 },
+    { 3870, 60 },
+    { 3840, 50 },
+    { 3800, 40 },
+    { 3770, 30 },
+    { 3730, 20 },
+    { 3690, 10 },
+    { 3610, 5 },
+    { 3270, 0 },
+};
+
 static const struct device *adc_dev;
+
+// Board revisions with a load switch in the divider's high side declare it
+// as vbat-divider-en-gpios under zephyr,user; the divider then only draws
+// current for the duration of a read
+#define VBAT_USER_NODE DT_PATH(zephyr_user)
+#if DT_NODE_HAS_PROP(VBAT_USER_NODE, vbat_divider_en_gpios)
+#define HAS_DIVIDER_SWITCH 1
+static const struct gpio_dt_spec divider_en = GPIO_DT_SPEC_GET(VBAT_USER_NODE, vbat_divider_en_gpios);
+#else
+#define HAS_DIVIDER_SWITCH 0
+#endif
+
+// Asynchronous read state; the SAADC raises the signal when the sequence ends
+static struct k_poll_signal adc_signal;
+static uint16_t adc_value;
+static const struct adc_sequence sequence = {
+    .channels = BIT(0),
+    .buffer = &adc_value,
+    .buffer_size = sizeof(adc_value),
+    .resolution = ADC_RESOLUTION,
+    .oversampling = 4, // Average 4 samples for better accuracy
+};
 static const struct adc_channel_cfg channel_cfg = {
     .gain = ADC_GAIN_1_4,
     .reference = ADC_REF_INTERNAL,
@@ -15,6 +71,26 @@ static const struct adc_channel_cfg channel_cfg = {
     .input_positive = 2,  // P0.02 for VBAT_SENSE
 };
 
+// Connect the divider for a read and let the ADC input settle
+static void divider_set(bool on)
+{
+#if HAS_DIVIDER_SWITCH
+    gpio_pin_set_dt(&divider_en, on);
+    if (on) {
+        k_usleep(BATTERY_DIVIDER_SETTLE_US);
+    }
+#else
+    ARG_UNUSED(on);
+#endif
+}
+
+// Release the SAADC and the divider once a read has ended
+static void read_done(void)
+{
+    divider_set(false);
+    (void)pm_device_runtime_put(adc_dev);
+}
+
 int battery_monitor_init(void)
 {
     adc_dev = DEVICE_DT_GET(DT_CHOSEN(zephyr,adc));
@@ -29,51 +105,181 @@ int battery_monitor_init(void)
         return -EIO;
     }
 
+#if HAS_DIVIDER_SWITCH
+    if (!gpio_is_ready_dt(&divider_en) ||
+        gpio_pin_configure_dt(&divider_en, GPIO_OUTPUT_INACTIVE) != 0) {
+        LOG_ERR("Failed to configure VBAT divider switch");
+        return -EIO;
+    }
+#endif
+
+    k_poll_signal_init(&adc_signal);
+
     LOG_INF("Battery monitor initialized");
     return 0;
 }
 
-uint16_t battery_monitor_read_voltage(void)
+// Start sampling the battery in the background; collect the result with
+// battery_monitor_finish_read()
+int battery_monitor_start_read(void)
+{
+    int ret;
+
+    k_poll_signal_reset(&adc_signal);
+
+    ret = pm_device_runtime_get(adc_dev);
+    if (ret < 0) {
+        LOG_ERR("Failed to resume ADC: %d", ret);
+        return ret;
+    }
+    divider_set(true);
+
+    ret = adc_read_async(adc_dev, &sequence, &adc_signal);
+    if (ret != 0) {
+        LOG_ERR("Failed to start ADC read: %d", ret);
+        read_done();
+    }
+    return ret;
+}
+
+// Wait for the read started by battery_monitor_start_read() and convert it.
+// Returns 0 mV on failure, like battery_monitor_read_voltage().
+uint16_t battery_monitor_finish_read(k_timeout_t timeout)
 {
+    struct k_poll_event event = K_POLL_EVENT_INITIALIZER(K_POLL_TYPE_SIGNAL,
+                                                         K_POLL_MODE_NOTIFY_ONLY,
+                                                         &adc_signal);
+    unsigned int signaled;
+    int result;
     int ret;
-    uint16_t adc_value;
-    uint16_t voltage_mv;
-    struct adc_sequence sequence = {
-        .buffer = &adc_value,
-        .buffer_size = sizeof(adc_value),
-        .resolution = ADC_RESOLUTION,
-        .oversampling = 4, // Average 4 samples for better accuracy
-    };
-
-    // Read ADC value
-    ret = adc_read(adc_dev, &sequence);
+    uint32_t voltage_mv;
+
+    ret = k_poll(&event, 1, timeout);
+    read_done();
     if (ret != 0) {
-        LOG_ERR("Failed to read ADC: %d", ret);
+        LOG_ERR("ADC read timed out");
         return 0;
     }
 
-    // Convert ADC value to voltage (mV)
-    // Assuming voltage divider: V_bat / 2 = V_adc
-    // V_bat = V_adc * 2 * ADC_REFERENCE_VOLTAGE / (2^ADC_RESOLUTION)
-    voltage_mv = (uint16_t)((uint32_t)adc_value * ADC_REFERENCE_VOLTAGE * ADC_GAIN / (1 << ADC_RESOLUTION));
+    k_poll_signal_check(&adc_signal, &signaled, &result);
+    if (result != 0) {
+        LOG_ERR("Failed to read ADC: %d", result);
+        return 0;
+    }
+
+    // Single-ended SAADC samples can read slightly below zero
+    int16_t counts = MAX((int16_t)adc_value, 0);
 
-    LOG_DBG("ADC: %d, Voltage: %d mV", adc_value, voltage_mv);
-    return voltage_mv;
+    voltage_mv = ((uint32_t)counts * BATTERY_MV_PER_LSB_Q16 + BIT(15)) >> 16;
+
+    LOG_DBG("ADC: %d, Voltage: %u mV", counts, voltage_mv);
+    return (uint16_t)voltage_mv;
 }
 
-uint8_t battery_monitor_get_percentage(uint16_t voltage_mv)
+uint16_t battery_monitor_read_voltage(void)
 {
-    uint8_t percentage;
-    
-    if (voltage_mv >= BATTERY_VOLTAGE_MAX) {
-        percentage = 100;
-    } else if (voltage_mv <= BATTERY_VOLTAGE_MIN) {
-        percentage = 0;
+    if (battery_monitor_start_read() != 0) {
+        return 0;
+    }
+
+    return battery_monitor_finish_read(K_MSEC(BATTERY_READ_TIMEOUT_MS));
+}
+
+static uint16_t median_mv(const struct battery_filter *filter)
+{
+    uint16_t sorted[BATTERY_MEDIAN_LEN];
+
+    memcpy(sorted, filter->recent_mv, sizeof(sorted));
+
+    // Insertion sort of the valid entries
+    for (uint8_t i = 1; i < filter->count; i++) {
+        uint16_t value = sorted[i];
+        uint8_t j = i;
+
+        while (j > 0 && sorted[j - 1] > value) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = value;
+    }
+
+    return sorted[filter->count / 2];
+}
+
+// Feed one resting reading into the filter and return the filtered voltage.
+// A failed read (0 mV) leaves the filter untouched.
+uint16_t battery_monitor_filter(struct battery_filter *filter, uint16_t voltage_mv)
+{
+    if (voltage_mv == 0) {
+        return (uint16_t)(filter->ewma_mv_q4 >> 4);
+    }
+
+    filter->recent_mv[filter->next] = voltage_mv;
+    filter->next = (filter->next + 1) % BATTERY_MEDIAN_LEN;
+    if (filter->count < BATTERY_MEDIAN_LEN) {
+        filter->count++;
+    }
+
+    int32_t median_q4 = (int32_t)median_mv(filter) << 4;
+
+    if (filter->count == 1) {
+        // First reading after a cold boot seeds the average
+        filter->ewma_mv_q4 = median_q4;
     } else {
-        // Linear interpolation between min and max voltage
-        percentage = (uint8_t)((voltage_mv - BATTERY_VOLTAGE_MIN) * 100 / 
-                              (BATTERY_VOLTAGE_MAX - BATTERY_VOLTAGE_MIN));
+        int32_t ewma = (int32_t)filter->ewma_mv_q4;
+
+        ewma += (median_q4 - ewma) / (1 << BATTERY_EWMA_SHIFT);
+        filter->ewma_mv_q4 = ewma;
     }
-    
-    return percentage;
+
+    LOG_DBG("Battery raw %u mV, filtered %u mV", voltage_mv, filter->ewma_mv_q4 >> 4);
+    return (uint16_t)(filter->ewma_mv_q4 >> 4);
+}
+
+// Record a reading taken right after a TX burst and update the internal
+// resistance estimate from its drop below the filtered resting voltage
+void battery_monitor_record_load(struct battery_filter *filter, uint16_t loaded_mv)
+{
+    uint16_t rest_mv = (uint16_t)(filter->ewma_mv_q4 >> 4);
+
+    if (loaded_mv == 0 || rest_mv == 0) {
+        return;
+    }
+
+    filter->loaded_mv = loaded_mv;
+
+    uint32_t drop_mv = (loaded_mv < rest_mv) ? rest_mv - loaded_mv : 0;
+    uint32_t resistance = MIN(drop_mv * 1000 / BATTERY_TX_CURRENT_MA, UINT16_MAX);
+
+    if (filter->resistance_mohm == 0) {
+        filter->resistance_mohm = resistance;
+    } else {
+        int32_t smoothed = filter->resistance_mohm;
+
+        smoothed += ((int32_t)resistance - smoothed) / (1 << BATTERY_EWMA_SHIFT);
+        filter->resistance_mohm = smoothed;
+    }
+
+    LOG_INF("Battery under load: %u mV (rest %u mV), R_int %u mOhm",
+            loaded_mv, rest_mv, filter->resistance_mohm);
+}
+
+// State of charge from the LiPo discharge curve, interpolated between points
+uint8_t battery_monitor_get_percentage(uint16_t voltage_mv)
+{
+    if (voltage_mv >= lipo_curve[0].mv) {
+        return lipo_curve[0].percent;
+    }
+
+    for (size_t i = 1; i < ARRAY_SIZE(lipo_curve); i++) {
+        if (voltage_mv >= lipo_curve[i].mv) {
+            uint16_t span_mv = lipo_curve[i - 1].mv - lipo_curve[i].mv;
+            uint8_t span_pct = lipo_curve[i - 1].percent - lipo_curve[i].percent;
+
+            return lipo_curve[i].percent +
+                   (uint8_t)((uint32_t)(voltage_mv - lipo_curve[i].mv) * span_pct / span_mv);
+        }
+    }
+
+    return 0;
 }
@@ -4,18 +4,43 @@
 #include <zephyr/kernel.h>
 
 // Battery voltage thresholds (in mV)
-#define BATTERY_VOLTAGE_MAX     4200  // 4.2V fully charged
-#define BATTERY_VOLTAGE_MIN     3500  // 3.5V minimum safe voltage
 #define BATTERY_VOLTAGE_CRITICAL 3300 // 3.3V critical low
 
-// ADC configuration
+// ADC configuration: internal 0.6 V reference with gain 1/4 gives a 2.4 V
+// full scale at the pin, which sits below a 4.22M / 1.87M divider
 #define ADC_RESOLUTION          12    // 12-bit ADC
-#define ADC_REFERENCE_VOLTAGE   3300  // 3.3V reference
-#define ADC_GAIN                3.256 // Voltage divider ratio: (4.22M + 1.87M) / 1.87M ≈ 3.256
+#define ADC_FULL_SCALE_MV       2400  // 0.6 V reference / gain 1/4
+#define BATTERY_DIVIDER_TOP_KOHM    4220
+#define BATTERY_DIVIDER_BOTTOM_KOHM 1870
+#define BATTERY_READ_TIMEOUT_MS 10    // Upper bound on one oversampled read
+#define BATTERY_DIVIDER_SETTLE_US 500 // Divider switch on to stable ADC input
+
+// Filtering across wakes: median of the last BATTERY_MEDIAN_LEN readings,
+// then an EWMA with weight 1 / 2^BATTERY_EWMA_SHIFT on the new median
+#define BATTERY_MEDIAN_LEN      3
+#define BATTERY_EWMA_SHIFT      2
+
+// Approximate supply current while the radio transmits, used to turn the
+// post-burst voltage drop into an internal resistance estimate
+#define BATTERY_TX_CURRENT_MA   15
+
+// Filter state, kept in retained RAM so it spans wake cycles
+struct battery_filter {
+    uint16_t recent_mv[BATTERY_MEDIAN_LEN];  // Unfiltered readings, ring order
+    uint8_t count;                           // Valid entries in recent_mv
+    uint8_t next;                            // Slot for the next reading
+    uint32_t ewma_mv_q4;                     // Filtered voltage in mV << 4
+    uint16_t loaded_mv;                      // Last reading taken after a TX burst
+    uint16_t resistance_mohm;                // Filtered internal resistance estimate
+};
 
 // Function prototypes
 int battery_monitor_init(void);
+int battery_monitor_start_read(void);
+uint16_t battery_monitor_finish_read(k_timeout_t timeout);
 uint16_t battery_monitor_read_voltage(void);
+uint16_t battery_monitor_filter(struct battery_filter *filter, uint16_t voltage_mv);
+void battery_monitor_record_load(struct battery_filter *filter, uint16_t loaded_mv);
 uint8_t battery_monitor_get_percentage(uint16_t voltage_mv);
 
 #endif // BATTERY_MONITOR_H
@@ -1,151 +1,691 @@
 #include "ble_advertiser.h"
+#include "cycle_stats.h"
+#include "node_config.h"
 #include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
 #include <zephyr/bluetooth/hci.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+
+#if defined(CONFIG_BT_SETTINGS)
+#include <zephyr/settings/settings.h>
+#endif
 
 LOG_MODULE_REGISTER(ble_advertiser, LOG_LEVEL_INF);
 
 // Nordic Semiconductor Company ID
 #define NORDIC_COMPANY_ID 0x0059
 
-// Advertising data buffer
-static uint8_t adv_data[31];
-static uint8_t adv_data_len;
+// Convert milliseconds to advertising interval units (0.625 ms)
+#define ADV_INTERVAL_UNITS(ms) ((ms) * 8 / 5)
+
+// Advertising set, created once and reused for every wake cycle
+static struct bt_le_ext_adv *adv_set;
+
+// Given by the sent callback when the controller has finished the set
+static K_SEM_DEFINE(adv_complete_sem, 0, 1);
+
+// Given once bt_enable() has completed and the set exists (or failed)
+static K_SEM_DEFINE(adv_ready_sem, 0, 1);
+static int adv_init_err;
+
+// Connect window: given when the connectable set times out, when a
+// central connects and again when it disconnects
+static K_SEM_DEFINE(window_sem, 0, 1);
+static bool window_open;
+#if defined(CONFIG_APP_CONNECT_WINDOW)
+static struct bt_conn *window_conn;
+#endif
+
+// Set when a scanner asked for the scan response during the last set
+static bool scan_requested;
+
+// Extended PDUs are needed for batches and for any PHY other than 1M. The
+// primary channels stay on 1M (or Coded); the 2M option moves the auxiliary
+// packet carrying the payload to 2M.
+#if defined(CONFIG_APP_ADV_PHY_CODED)
+#define ADV_EXT_OPTIONS    (BT_LE_ADV_OPT_EXT_ADV | BT_LE_ADV_OPT_CODED)
+#elif defined(CONFIG_APP_ADV_PHY_2M)
+#define ADV_EXT_OPTIONS    BT_LE_ADV_OPT_EXT_ADV
+#else
+#define ADV_EXT_OPTIONS    (BT_LE_ADV_OPT_EXT_ADV | BT_LE_ADV_OPT_NO_2M)
+#endif
+
+#define ADV_USE_EXT_PDU    (CONFIG_APP_ADV_BATCH_SAMPLES > 1 || \
+                            !IS_ENABLED(CONFIG_APP_ADV_PHY_1M))
+
+// Legacy sets are made scannable only to hand out the name, or so that a
+// scan request can ask for a configuration window
+#if defined(CONFIG_APP_REMOTE_CONFIG_SCAN_TRIGGER)
+#define ADV_LEGACY_OPTIONS (BT_LE_ADV_OPT_SCANNABLE | BT_LE_ADV_OPT_NOTIFY_SCAN_REQ)
+#elif defined(CONFIG_APP_ADV_NAME_IN_SCAN_RSP)
+#define ADV_LEGACY_OPTIONS BT_LE_ADV_OPT_SCANNABLE
+#else
+#define ADV_LEGACY_OPTIONS BT_LE_ADV_OPT_NONE
+#endif
+
+#if defined(CONFIG_APP_ADV_PAYLOAD_V1)
+#define ADV_PAYLOAD_VERSION ADV_PAYLOAD_V1
+#define ADV_PAYLOAD_LEN     sizeof(struct sensor_adv_data)
+#else
+#define ADV_PAYLOAD_VERSION ADV_PAYLOAD_V2
+#define ADV_PAYLOAD_LEN     ADV_V2_PAYLOAD_LEN
+#endif
+
+// All-ones value of a v2 field
+#define ADV_V2_NA(bits)    ((int32_t)BIT(bits) - 1)
+
+// Manufacturer data space: AD data per PDU (251 extended, 31 legacy) less
+// the flags and the manufacturer data AD headers
+#define ADV_EXT_MFG_DATA_MAX     (251 - 3 - 2)
+#define ADV_LEGACY_MFG_DATA_MAX  (31 - 3 - 2)
+
+// Previous cycle's statistics, between the v2 payload and the history
+#if defined(CONFIG_APP_CYCLE_STATS_ADV)
+#define ADV_STATS_LEN      CYCLE_STATS_SUMMARY_LEN
+#else
+#define ADV_STATS_LEN      0
+#endif
+
+#if CONFIG_APP_ADV_BATCH_SAMPLES > 1
+#define ADV_MFG_DATA_MAX   ADV_EXT_MFG_DATA_MAX
+#else
+#define ADV_MFG_DATA_MAX   (2 + ADV_PAYLOAD_LEN + ADV_STATS_LEN)
+#endif
+
+// Largest history record: interval plus three escaped values
+#define ADV_HISTORY_RECORD_MAX (2 + 3 * 3)
+
+// Options the advertising set was created with, and the manufacturer data
+// that fits its PDUs. Both drop to legacy values if the controller cannot
+// do extended advertising on the configured PHY.
+static uint32_t adv_options;
+static size_t mfg_data_max;
+
+// Manufacturer data: company ID, the sensor payload, then any history
+static uint8_t mfg_data[ADV_MFG_DATA_MAX];
+
+// The simulated board (CONFIG_APP_SIM) builds without the Bluetooth host
+#if defined(CONFIG_BT_DEVICE_NAME)
+#define ADV_DEVICE_NAME    CONFIG_BT_DEVICE_NAME
+#else
+#define ADV_DEVICE_NAME    "TempSensor"
+#endif
+
+// Advertising data. The local name stays out of it to keep the PDU short;
+// the host identifies nodes by the company ID, and the name can optionally
+// be handed out in the scan response. The manufacturer data length is
+// filled in per transmission.
+static struct bt_data adv_data[] = {
+    BT_DATA_BYTES(BT_DATA_FLAGS, BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR),
+    BT_DATA(BT_DATA_MANUFACTURER_DATA, mfg_data, 0),
+};
+
+static const struct bt_data scan_rsp[] = {
+    BT_DATA(BT_DATA_NAME_COMPLETE, ADV_DEVICE_NAME, sizeof(ADV_DEVICE_NAME) - 1),
+};
+
+// A set that is scannable only for the trigger answers with an empty response
+#define ADV_SCAN_RSP_LEN   (IS_ENABLED(CONFIG_APP_ADV_NAME_IN_SCAN_RSP) ? ARRAY_SIZE(scan_rsp) : 0)
 
 // Get advertising interval based on power tier
 static uint16_t get_adv_interval(power_tier_t tier)
 {
-    switch (tier) {
-        case POWER_TIER_NORMAL:
-            return ADV_INTERVAL_NORMAL;
-        case POWER_TIER_CONSERVE:
-            return ADV_INTERVAL_CONSERVE;
-        case POWER_TIER_RESERVE:
-        case POWER_TIER_SURVIVAL:
-            return ADV_INTERVAL_RESERVE;
-        default:
-            return ADV_INTERVAL_NORMAL;
+    const struct node_config *cfg = node_config_get();
+
+    return cfg->adv_interval_ms[(tier <= POWER_TIER_SURVIVAL) ? tier : POWER_TIER_NORMAL];
+}
+
+// Called by the host stack when the advertising set stops on its own,
+// either after the requested number of events or on timeout
+static void adv_sent(struct bt_le_ext_adv *adv, struct bt_le_ext_adv_sent_info *info)
+{
+    ARG_UNUSED(adv);
+
+    if (window_open) {
+        LOG_DBG("Connect window closed unused: %u events sent", info->num_sent);
+        k_sem_give(&window_sem);
+        return;
+    }
+
+    LOG_DBG("Advertising set complete: %u events sent", info->num_sent);
+    cycle_stats_count_adv(info->num_sent);
+    k_sem_give(&adv_complete_sem);
+}
+
+#if defined(CONFIG_APP_REMOTE_CONFIG_SCAN_TRIGGER)
+// Any active scanner triggers this, not only the gateway; the scheduler
+// rate-limits the windows it leads to
+static void adv_scanned(struct bt_le_ext_adv *adv, struct bt_le_ext_adv_scanned_info *info)
+{
+    ARG_UNUSED(adv);
+    ARG_UNUSED(info);
+
+    scan_requested = true;
+}
+#endif
+
+#if defined(CONFIG_APP_CONNECT_WINDOW)
+// A central connected to the window; the set has stopped
+static void adv_connected(struct bt_le_ext_adv *adv, struct bt_le_ext_adv_connected_info *info)
+{
+    ARG_UNUSED(adv);
+
+    window_conn = bt_conn_ref(info->conn);
+    k_sem_give(&window_sem);
+}
+
+static void conn_disconnected(struct bt_conn *conn, uint8_t reason)
+{
+    if (conn != window_conn) {
+        return;
+    }
+
+    LOG_INF("Window connection closed (reason 0x%02x)", reason);
+    bt_conn_unref(window_conn);
+    window_conn = NULL;
+    k_sem_give(&window_sem);
+}
+
+BT_CONN_CB_DEFINE(window_conn_callbacks) = {
+    .disconnected = conn_disconnected,
+};
+#endif
+
+#if defined(CONFIG_APP_CONNECT_PASSKEY)
+BUILD_ASSERT(CONFIG_APP_CONNECT_PASSKEY != 0,
+             "Set CONFIG_APP_CONNECT_PASSKEY to the deployment passkey");
+
+// Display-only pairing: the gateway enters the fixed deployment passkey
+static void auth_passkey_display(struct bt_conn *conn, unsigned int passkey)
+{
+    ARG_UNUSED(conn);
+    ARG_UNUSED(passkey);
+
+    LOG_INF("Pairing requested");
+}
+
+static void auth_cancel(struct bt_conn *conn)
+{
+    ARG_UNUSED(conn);
+
+    LOG_WRN("Pairing cancelled");
+}
+
+static const struct bt_conn_auth_cb auth_callbacks = {
+    .passkey_display = auth_passkey_display,
+    .cancel = auth_cancel,
+};
+#endif
+
+static const struct bt_le_ext_adv_cb adv_callbacks = {
+    .sent = adv_sent,
+#if defined(CONFIG_APP_CONNECT_WINDOW)
+    .connected = adv_connected,
+#endif
+#if defined(CONFIG_APP_REMOTE_CONFIG_SCAN_TRIGGER)
+    .scanned = adv_scanned,
+#endif
+};
+
+// Append a value as an int8 delta from the newer reading, or as
+// ADV_DELTA_ESCAPE followed by the full 16-bit value when it does not fit
+static size_t put_delta(uint8_t *buf, int32_t value, int32_t ref)
+{
+    int32_t delta = value - ref;
+
+    if (delta > INT8_MIN && delta <= INT8_MAX) {
+        buf[0] = (uint8_t)delta;
+        return 1;
+    }
+
+    buf[0] = ADV_DELTA_ESCAPE;
+    sys_put_le16((uint16_t)value, &buf[1]);
+    return 3;
+}
+
+// Encode a v2 field: offset and clamp a measured value below the all-ones
+// not-measured marker
+static int32_t v2_field(int32_t value, int32_t offset, uint8_t bits, bool measured)
+{
+    if (!measured) {
+        return ADV_V2_NA(bits);
+    }
+
+    return CLAMP(value + offset, 0, ADV_V2_NA(bits) - 1);
+}
+
+// Temperature, pressure and humidity of a reading in payload version units
+static void record_fields(const struct sample_record *record, int32_t fields[3])
+{
+    if (ADV_PAYLOAD_VERSION == ADV_PAYLOAD_V1) {
+        fields[0] = record->temperature;
+        fields[1] = record->pressure;
+        fields[2] = record->humidity;
+        return;
+    }
+
+    fields[0] = v2_field(record->temperature, ADV_V2_TEMP_OFFSET, ADV_V2_TEMP_BITS,
+                         record->temperature != ADV_TEMP_NOT_MEASURED);
+    fields[1] = v2_field(record->pressure, -ADV_V2_PRESS_OFFSET, ADV_V2_PRESS_BITS,
+                         record->pressure != ADV_VALUE_NOT_MEASURED);
+    // 0.01 %RH -> 0.1 %RH
+    fields[2] = v2_field((record->humidity + 5) / 10, 0, ADV_V2_HUM_BITS,
+                         record->humidity != ADV_VALUE_NOT_MEASURED);
+}
+
+// Append older readings after the sensor payload, newest first, each
+// delta-encoded against the reading before it. Returns the bytes used.
+static size_t prepare_history(uint8_t *buf, size_t space, const struct sample_ring *ring)
+{
+    const struct sample_record *record;
+    int32_t newer[3];
+    int32_t fields[3];
+    size_t len = 1;
+    uint8_t count = 0;
+
+    record_fields(sample_ring_get(ring, 0), newer);
+
+    for (uint8_t age = 1; age < CONFIG_APP_ADV_BATCH_SAMPLES; age++) {
+        record = sample_ring_get(ring, age);
+        if (record == NULL || len + ADV_HISTORY_RECORD_MAX > space) {
+            break;
+        }
+
+        // Gap from this reading to the newer one
+        sys_put_le16(record->interval_s, &buf[len]);
+        len += 2;
+
+        record_fields(record, fields);
+        for (int i = 0; i < 3; i++) {
+            len += put_delta(&buf[len], fields[i], newer[i]);
+            newer[i] = fields[i];
+        }
+
+        count++;
     }
+
+    buf[0] = count;
+    return len;
 }
 
-// Prepare advertising data with sensor information
-static int prepare_adv_data(const struct bme280_data *sensor_data, 
-                           uint16_t battery_mv, power_tier_t tier)
+// Fill in the v1 payload; returns its length
+static size_t prepare_payload_v1(uint8_t *buf, const struct sample_record *newest,
+                                 uint16_t battery_mv, power_tier_t tier)
 {
     struct sensor_adv_data sensor_payload;
-    uint8_t *ptr = adv_data;
-    uint8_t remaining = sizeof(adv_data);
-    
-    // Clear buffer
-    memset(adv_data, 0, sizeof(adv_data));
-    
-    // Flags (LE General Discoverable Mode)
-    if (remaining < 3) return -ENOMEM;
-    *ptr++ = 2;  // Length
-    *ptr++ = BT_DATA_FLAGS;
-    *ptr++ = BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR;
-    remaining -= 3;
-    
-    // Complete Local Name
-    const char *name = "TempSensor";
-    uint8_t name_len = strlen(name);
-    if (remaining < name_len + 2) return -ENOMEM;
-    *ptr++ = name_len + 1;  // Length
-    *ptr++ = BT_DATA_NAME_COMPLETE;
-    memcpy(ptr, name, name_len);
-    ptr += name_len;
-    remaining -= (name_len + 2);
-    
-    // Manufacturer Specific Data
-    sensor_payload.version = 1;
+
+    sensor_payload.version = ADV_PAYLOAD_V1;
     sensor_payload.tier = (uint8_t)tier;
     sensor_payload.battery_mv = battery_mv;
-    sensor_payload.temperature = (int16_t)(sensor_data->temperature * 100);
-    sensor_payload.pressure = (uint16_t)(sensor_data->pressure * 10);
-    sensor_payload.humidity = (uint16_t)(sensor_data->humidity * 100);
+    sensor_payload.temperature = newest->temperature;
+    sensor_payload.pressure = newest->pressure;
+    sensor_payload.humidity = newest->humidity;
     sensor_payload.timestamp = k_uptime_get() / 1000; // Current uptime in seconds
-    
-    uint8_t mfg_data_len = sizeof(sensor_payload) + 4; // +4 for company ID
-    if (remaining < mfg_data_len + 1) return -ENOMEM;
-    
-    *ptr++ = mfg_data_len;  // Length
-    *ptr++ = BT_DATA_MANUFACTURER_DATA;
-    
+
+    memcpy(buf, &sensor_payload, sizeof(sensor_payload));
+    return sizeof(sensor_payload);
+}
+
+// Fill in the bit-packed v2 payload; returns its length
+static size_t prepare_payload_v2(uint8_t *buf, const struct sample_ring *ring,
+                                 uint16_t battery_mv, power_tier_t tier)
+{
+    int32_t fields[3];
+    uint64_t bits;
+    uint8_t shift = 0;
+
+    record_fields(sample_ring_get(ring, 0), fields);
+
+    bits = (uint64_t)((uint32_t)tier & ADV_V2_NA(ADV_V2_TIER_BITS));
+    shift += ADV_V2_TIER_BITS;
+    bits |= (uint64_t)v2_field((battery_mv - ADV_V2_BATTERY_BASE_MV) / ADV_V2_BATTERY_STEP_MV,
+                               0, ADV_V2_BATTERY_BITS, true) << shift;
+    shift += ADV_V2_BATTERY_BITS;
+    bits |= (uint64_t)fields[0] << shift;
+    shift += ADV_V2_TEMP_BITS;
+    bits |= (uint64_t)fields[2] << shift;
+    shift += ADV_V2_HUM_BITS;
+    bits |= (uint64_t)fields[1] << shift;
+    shift += ADV_V2_PRESS_BITS;
+    bits |= (uint64_t)(ADV_STATS_LEN > 0) << shift;
+
+    buf[0] = ADV_PAYLOAD_V2;
+    buf[1] = ring->seq;
+    sys_put_le48(bits, &buf[2]);
+
+    return ADV_V2_PAYLOAD_LEN;
+}
+
+// Prepare advertising data from the newest reading plus history
+static int prepare_adv_data(const struct sample_ring *ring,
+                           uint16_t battery_mv, power_tier_t tier, bool maintenance)
+{
+    const struct sample_record *newest = sample_ring_get(ring, 0);
+    size_t len;
+
+    if (newest == NULL) {
+        return -ENODATA;
+    }
+
     // Company ID (little endian)
-    *ptr++ = NORDIC_COMPANY_ID & 0xFF;
-    *ptr++ = (NORDIC_COMPANY_ID >> 8) & 0xFF;
-    
+    mfg_data[0] = NORDIC_COMPANY_ID & 0xFF;
+    mfg_data[1] = (NORDIC_COMPANY_ID >> 8) & 0xFF;
+    len = 2;
+
     // Sensor payload
-    memcpy(ptr, &sensor_payload, sizeof(sensor_payload));
-    ptr += sizeof(sensor_payload);
-    
-    adv_data_len = ptr - adv_data;
-    
-    LOG_DBG("Advertising data prepared: %d bytes", adv_data_len);
-    LOG_DBG("Payload: T=%.2f°C, P=%.1f hPa, H=%.2f%%, V=%d mV, Tier=%d",
-            sensor_data->temperature, sensor_data->pressure, 
-            sensor_data->humidity, battery_mv, tier);
-    
+    if (ADV_PAYLOAD_VERSION == ADV_PAYLOAD_V1) {
+        len += prepare_payload_v1(&mfg_data[len], newest, battery_mv, tier);
+    } else {
+        len += prepare_payload_v2(&mfg_data[len], ring, battery_mv, tier);
+        if (ADV_STATS_LEN > 0) {
+            len += cycle_stats_encode_summary(&mfg_data[len]);
+        }
+    }
+
+    // Announce the window in the version byte, which every layout starts with
+    if (maintenance) {
+        mfg_data[2] |= ADV_FLAG_MAINTENANCE;
+    }
+
+    // Older readings extend the payload; hosts that do not know about
+    // them ignore the trailing bytes
+    if (CONFIG_APP_ADV_BATCH_SAMPLES > 1) {
+        len += prepare_history(&mfg_data[len], mfg_data_max - len, ring);
+    }
+
+    adv_data[1].data_len = len;
+
+    LOG_DBG("Advertising data prepared: v%d, %zu bytes", ADV_PAYLOAD_VERSION, len);
+    LOG_DBG("Payload: T=%d, P=%u, H=%u, V=%d mV, Tier=%d, Seq=%u",
+            newest->temperature, newest->pressure, newest->humidity,
+            battery_mv, tier, ring->seq);
+
     return 0;
 }
 
+void ble_advertiser_make_record(const struct bme280_data_fixed *sensor_data,
+                                uint32_t interval_ms, struct sample_record *record)
+{
+    record->temperature = (sensor_data->channels & BME280_CHAN_TEMP) ?
+                          (int16_t)CLAMP(sensor_data->temperature, INT16_MIN + 1, INT16_MAX) :
+                          ADV_TEMP_NOT_MEASURED;
+    // Pa -> 0.1 hPa and Q22.10 %RH -> 0.01 %RH, rounded to nearest. Pressure
+    // is clamped below the sentinel so a bogus reading cannot wrap the field.
+    record->pressure = (sensor_data->channels & BME280_CHAN_PRESS) ?
+                       (uint16_t)MIN((sensor_data->pressure + 5) / 10,
+                                     ADV_VALUE_NOT_MEASURED - 1) :
+                       ADV_VALUE_NOT_MEASURED;
+    record->humidity = (sensor_data->channels & BME280_CHAN_HUM) ?
+                       (uint16_t)((sensor_data->humidity * 100 + 512) >> 10) :
+                       ADV_VALUE_NOT_MEASURED;
+    record->interval_s = (uint16_t)MIN(interval_ms / 1000, UINT16_MAX);
+}
+
+// Controller bring-up finished; create the advertising set from the same
+// context so the main thread never blocks in bt_enable()
+static void bt_ready(int err)
+{
+    struct bt_le_adv_param adv_param = {
+        .id = BT_ID_DEFAULT,
+        .sid = 0,
+        .secondary_max_skip = 0,
+        .options = ADV_USE_EXT_PDU ? ADV_EXT_OPTIONS : ADV_LEGACY_OPTIONS,
+        .interval_min = ADV_INTERVAL_UNITS(get_adv_interval(POWER_TIER_NORMAL)),
+        .interval_max = ADV_INTERVAL_UNITS(get_adv_interval(POWER_TIER_NORMAL)),
+        .peer = NULL,
+    };
+
+    if (err != 0) {
+        LOG_ERR("Failed to enable Bluetooth: %d", err);
+        goto done;
+    }
+
+#if defined(CONFIG_BT_SETTINGS)
+    // The host finishes bring-up once the identity and bonds are loaded;
+    // a small NVS read on each wake that transmits
+    err = settings_load_subtree("bt");
+    if (err != 0) {
+        LOG_ERR("Failed to load Bluetooth settings: %d", err);
+        goto done;
+    }
+#endif
+
+#if defined(CONFIG_APP_CONNECT_PASSKEY)
+    (void)bt_passkey_set(CONFIG_APP_CONNECT_PASSKEY);
+    (void)bt_conn_auth_cb_register(&auth_callbacks);
+#endif
+
+    // Create the non-connectable advertising set, reused for every wake cycle
+    err = bt_le_ext_adv_create(&adv_param, &adv_callbacks, &adv_set);
+    if (err != 0 && (adv_param.options & BT_LE_ADV_OPT_EXT_ADV)) {
+        // Controller lacks extended advertising or the PHY; keep reporting
+        // with legacy PDUs, carrying as much history as fits
+        LOG_WRN("Extended advertising unavailable (%d), using legacy PDUs", err);
+        adv_param.options = ADV_LEGACY_OPTIONS;
+        err = bt_le_ext_adv_create(&adv_param, &adv_callbacks, &adv_set);
+    }
+    if (err != 0) {
+        LOG_ERR("Failed to create advertising set: %d", err);
+        goto done;
+    }
+
+    adv_options = adv_param.options;
+    mfg_data_max = (adv_options & BT_LE_ADV_OPT_EXT_ADV) ?
+                   ADV_MFG_DATA_MAX : MIN(ADV_MFG_DATA_MAX, ADV_LEGACY_MFG_DATA_MAX);
+
+    LOG_INF("Bluetooth initialized successfully");
+
+done:
+    adv_init_err = err;
+    k_sem_give(&adv_ready_sem);
+}
+
+// Start Bluetooth bring-up in the background; the sensor reads run while the
+// controller initializes, and ble_advertiser_wait_ready() joins it
 int ble_advertiser_init(void)
 {
-    int ret;
-    
-    // Initialize Bluetooth
-    ret = bt_enable(NULL);
+    static bool enabled;
+
+    // Safe to call again; wake cycles that may not transmit defer bring-up
+    if (enabled) {
+        return 0;
+    }
+
+    int ret = bt_enable(bt_ready);
     if (ret != 0) {
         LOG_ERR("Failed to enable Bluetooth: %d", ret);
         return ret;
     }
-    
-    LOG_INF("Bluetooth initialized successfully");
+
+    enabled = true;
     return 0;
 }
 
-int ble_advertiser_start(const struct bme280_data *sensor_data, 
-                        uint16_t battery_mv, power_tier_t tier)
+int ble_advertiser_wait_ready(k_timeout_t timeout)
+{
+    if (k_sem_take(&adv_ready_sem, timeout) != 0) {
+        return -ETIMEDOUT;
+    }
+
+    // Leave the semaphore given so later calls return immediately
+    k_sem_give(&adv_ready_sem);
+    return adv_init_err;
+}
+
+int ble_advertiser_start(const struct sample_ring *ring, uint16_t battery_mv,
+                         power_tier_t tier, uint8_t adv_events, bool maintenance)
 {
     int ret;
+    uint16_t interval = ADV_INTERVAL_UNITS(get_adv_interval(tier));
     struct bt_le_adv_param adv_param = {
         .id = BT_ID_DEFAULT,
         .sid = 0,
         .secondary_max_skip = 0,
-        .options = BT_LE_ADV_OPT_NONE,
-        .interval_min = get_adv_interval(tier),
-        .interval_max = get_adv_interval(tier),
+        .options = adv_options,
+        .interval_min = interval,
+        .interval_max = interval,
         .peer = NULL,
     };
-    
+    // Stop after a fixed number of events; the timeout (10 ms units) is a backstop
+    struct bt_le_ext_adv_start_param start_param = {
+        .timeout = node_config_get()->adv_duration_ms / 10,
+        .num_events = adv_events,
+    };
+
+    if (adv_set == NULL) {
+        return -ENODEV;
+    }
+
     // Prepare advertising data
-    ret = prepare_adv_data(sensor_data, battery_mv, tier);
+    ret = prepare_adv_data(ring, battery_mv, tier, maintenance);
     if (ret != 0) {
         LOG_ERR("Failed to prepare advertising data: %d", ret);
         return ret;
     }
-    
+
+    ret = bt_le_ext_adv_update_param(adv_set, &adv_param);
+    if (ret != 0) {
+        LOG_ERR("Failed to update advertising parameters: %d", ret);
+        return ret;
+    }
+
+    if (adv_options & BT_LE_ADV_OPT_SCANNABLE) {
+        ret = bt_le_ext_adv_set_data(adv_set, adv_data, ARRAY_SIZE(adv_data),
+                                     scan_rsp, ADV_SCAN_RSP_LEN);
+    } else {
+        ret = bt_le_ext_adv_set_data(adv_set, adv_data, ARRAY_SIZE(adv_data), NULL, 0);
+    }
+    if (ret != 0) {
+        LOG_ERR("Failed to set advertising data: %d", ret);
+        return ret;
+    }
+
+    k_sem_reset(&adv_complete_sem);
+    scan_requested = false;
+
     // Start advertising (non-connectable)
-    ret = bt_le_adv_start(&adv_param, adv_data, adv_data_len, NULL, 0);
+    ret = bt_le_ext_adv_start(adv_set, &start_param);
     if (ret != 0) {
         LOG_ERR("Failed to start advertising: %d", ret);
         return ret;
     }
-    
-    LOG_INF("BLE advertising started (tier %d, interval %d ms)", 
-            tier, get_adv_interval(tier));
+
+    LOG_INF("BLE advertising started (tier %d, interval %d ms, %d events)",
+            tier, get_adv_interval(tier), start_param.num_events);
     return 0;
 }
 
+int ble_advertiser_wait_complete(k_timeout_t timeout)
+{
+    // Block (CPU idle) until the controller reports the set has finished
+    int ret = k_sem_take(&adv_complete_sem, timeout);
+    if (ret != 0) {
+        LOG_WRN("Advertising set did not complete in time");
+        return -ETIMEDOUT;
+    }
+
+    return 0;
+}
+
+// True if a scanner sent a scan request during the last advertising set
+bool ble_advertiser_scan_requested(void)
+{
+    return scan_requested;
+}
+
+// Advertise the data of the last transmission as connectable for up to
+// window_ms, with the window flag set. A central that connects may stay
+// for session_ms, then is disconnected. Returns 0 whether or not anyone
+// connected.
+int ble_advertiser_open_window(uint32_t window_ms, uint32_t session_ms)
+{
+#if defined(CONFIG_APP_CONNECT_WINDOW)
+    int ret;
+    uint16_t interval = ADV_INTERVAL_UNITS(ADV_INTERVAL_WINDOW);
+    // Extended connectable sets cannot be scannable; legacy ADV_IND always is
+    struct bt_le_adv_param adv_param = {
+        .id = BT_ID_DEFAULT,
+        .sid = 0,
+        .secondary_max_skip = 0,
+        .options = (adv_options & ~BT_LE_ADV_OPT_SCANNABLE) | BT_LE_ADV_OPT_CONNECTABLE,
+        .interval_min = interval,
+        .interval_max = interval,
+        .peer = NULL,
+    };
+    struct bt_le_ext_adv_start_param start_param = {
+        .timeout = MIN(window_ms / 10, UINT16_MAX),
+        .num_events = 0,
+    };
+
+    if (adv_set == NULL) {
+        return -ENODEV;
+    }
+
+    ret = bt_le_ext_adv_update_param(adv_set, &adv_param);
+    if (ret != 0) {
+        LOG_ERR("Failed to make advertising connectable: %d", ret);
+        return ret;
+    }
+
+    // A window opened on a scan request was not announced by the set before it
+    mfg_data[2] |= ADV_FLAG_MAINTENANCE;
+
+    if (adv_param.options & BT_LE_ADV_OPT_EXT_ADV) {
+        ret = bt_le_ext_adv_set_data(adv_set, adv_data, ARRAY_SIZE(adv_data), NULL, 0);
+    } else {
+        ret = bt_le_ext_adv_set_data(adv_set, adv_data, ARRAY_SIZE(adv_data),
+                                     scan_rsp, ADV_SCAN_RSP_LEN);
+    }
+    if (ret != 0) {
+        LOG_ERR("Failed to set window advertising data: %d", ret);
+        return ret;
+    }
+
+    k_sem_reset(&window_sem);
+    window_open = true;
+
+    ret = bt_le_ext_adv_start(adv_set, &start_param);
+    if (ret != 0) {
+        LOG_ERR("Failed to open connect window: %d", ret);
+        window_open = false;
+        return ret;
+    }
+
+    LOG_INF("Connect window open for %u ms", window_ms);
+
+    // Ends on the controller's timeout, or with a connection
+    if (k_sem_take(&window_sem, K_MSEC(window_ms + 1000)) != 0) {
+        (void)bt_le_ext_adv_stop(adv_set);
+    }
+
+    if (window_conn != NULL) {
+        LOG_INF("Window connection open");
+        if (k_sem_take(&window_sem, K_MSEC(session_ms)) != 0) {
+            LOG_WRN("Window session too long, disconnecting");
+            (void)bt_conn_disconnect(window_conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+            (void)k_sem_take(&window_sem, K_MSEC(ADV_READY_TIMEOUT_MS));
+        }
+    }
+
+    window_open = false;
+    return 0;
+#else
+    ARG_UNUSED(window_ms);
+    ARG_UNUSED(session_ms);
+    return -ENOTSUP;
+#endif
+}
+
 int ble_advertiser_stop(void)
 {
-    int ret = bt_le_adv_stop();
+    int ret = bt_le_ext_adv_stop(adv_set);
     if (ret != 0) {
         LOG_ERR("Failed to stop advertising: %d", ret);
         return ret;
     }
-    
+
     LOG_INF("BLE advertising stopped");
     return 0;
 }
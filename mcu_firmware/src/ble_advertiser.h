@@ -4,14 +4,34 @@
 #include <zephyr/kernel.h>
 #include "bme280.h"
 #include "adaptive_scheduler.h"
+#include "sample_ring.h"
 
-// BLE advertising configuration
-#define ADV_DURATION_MS        30000  // 30 seconds advertising duration
+// BLE advertising configuration. The duration and the tier intervals are
+// the defaults of the runtime configuration (node_config.h).
+#define ADV_DURATION_MS        30000  // Upper bound on one advertising set (safety timeout)
+#define ADV_READY_TIMEOUT_MS   1000   // Upper bound on Bluetooth bring-up
 #define ADV_INTERVAL_NORMAL    1000   // 1 Hz for normal tier
 #define ADV_INTERVAL_CONSERVE  5000   // 0.2 Hz for conserve tier
 #define ADV_INTERVAL_RESERVE   10000  // 0.1 Hz for reserve tier
+#define ADV_INTERVAL_WINDOW    250    // Connectable maintenance or configuration window
 
-// Manufacturer data structure (custom payload)
+// Payload values for a channel that was not measured (skipped or failed)
+#define ADV_VALUE_NOT_MEASURED SAMPLE_VALUE_NOT_MEASURED
+#define ADV_TEMP_NOT_MEASURED  SAMPLE_TEMP_NOT_MEASURED
+
+// History delta byte announcing that the full 16-bit value follows
+#define ADV_DELTA_ESCAPE       0x80
+
+// Payload versions; the low nibble of the first payload byte selects the
+// layout and the high nibble carries flags
+#define ADV_PAYLOAD_V1         1
+#define ADV_PAYLOAD_V2         2
+#define ADV_VERSION_MASK       0x0F
+
+// A connectable window follows this advertising set, or is open
+#define ADV_FLAG_MAINTENANCE   0x80
+
+// Manufacturer data structure (custom payload, v1)
 struct sensor_adv_data {
     uint8_t version;           // Protocol version (1)
     uint8_t tier;              // Power tier
@@ -22,9 +42,46 @@ struct sensor_adv_data {
     uint32_t timestamp;        // Unix timestamp (if available)
 } __attribute__((packed));
 
+// Compact v2 payload: version byte, sequence number of the newest reading,
+// then 48 little-endian bits holding, from bit 0:
+//   tier          2 bits
+//   battery       8 bits, (mV - 2000) / 10
+//   temperature  14 bits, 0.01 C above -40 C
+//   humidity     10 bits, 0.1 %RH
+//   pressure     13 bits, 0.1 hPa above 300 hPa
+//   stats         1 bit, set when the cycle statistics summary follows
+// A field with all bits set means the channel was not measured.
+#define ADV_V2_PAYLOAD_LEN     8
+#define ADV_V2_TIER_BITS       2
+#define ADV_V2_BATTERY_BITS    8
+#define ADV_V2_TEMP_BITS       14
+#define ADV_V2_HUM_BITS        10
+#define ADV_V2_PRESS_BITS      13
+#define ADV_V2_BATTERY_BASE_MV 2000
+#define ADV_V2_BATTERY_STEP_MV 10
+#define ADV_V2_TEMP_OFFSET     4000   // 0.01 C
+#define ADV_V2_PRESS_OFFSET    3000   // 0.1 hPa
+
+// When batching, the payload is followed by older readings, newest first:
+//   uint8_t count;
+//   count x {
+//       uint16_t interval_s;  // Seconds from this reading to the newer one
+//       temperature, pressure, humidity;  // int8 delta from the newer reading,
+//                                         // or ADV_DELTA_ESCAPE + 16-bit value
+//   }
+// Values are in the units of the payload version: v1 fields, or the v2
+// offset fields (humidity in 0.1 %RH).
+
 // Function prototypes
 int ble_advertiser_init(void);
-int ble_advertiser_start(const struct bme280_data *sensor_data, uint16_t battery_mv, power_tier_t tier);
+int ble_advertiser_wait_ready(k_timeout_t timeout);
+void ble_advertiser_make_record(const struct bme280_data_fixed *sensor_data,
+                                uint32_t interval_ms, struct sample_record *record);
+int ble_advertiser_start(const struct sample_ring *ring, uint16_t battery_mv,
+                         power_tier_t tier, uint8_t adv_events, bool maintenance);
+int ble_advertiser_wait_complete(k_timeout_t timeout);
+bool ble_advertiser_scan_requested(void);
+int ble_advertiser_open_window(uint32_t window_ms, uint32_t session_ms);
 int ble_advertiser_stop(void);
 
 #endif // BLE_ADVERTISER_H
@@ -1,179 +1,366 @@
+#define DT_DRV_COMPAT bosch_bme280
+
 #include "bme280.h"
+#include "cycle_stats.h"
 #include <zephyr/device.h>
 #include <zephyr/drivers/i2c.h>
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/pm/device_runtime.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/kernel.h>
 
 LOG_MODULE_REGISTER(bme280, LOG_LEVEL_INF);
 
-static const struct device *i2c_dev;
-static struct bme280_calib_data calib_data;
+BUILD_ASSERT(BME280_COUNT > 0, "No bosch,bme280 node enabled in the devicetree");
+
+// Per-instance constant configuration, from the devicetree node
+struct bme280_config {
+    struct i2c_dt_spec bus;
+};
+
+// Per-instance state
+struct bme280_dev_data {
+    struct bme280_calib_data calib;
+    const struct bme280_profile *active_profile;
+
+    // Forced conversion in flight: the profile it runs with and when it started
+    const struct bme280_profile *conversion_profile;
+    uint32_t conversion_start;
+
+    // Last reading taken through sensor_sample_fetch()
+    struct bme280_data_fixed sample;
+};
+
+// Predefined measurement profiles
+const struct bme280_profile bme280_profile_high_precision =
+    BME280_PROFILE_INIT(BME280_OSRS_2X, BME280_OSRS_16X, BME280_OSRS_2X, BME280_FILTER_2);
+const struct bme280_profile bme280_profile_standard =
+    BME280_PROFILE_INIT(BME280_OSRS_1X, BME280_OSRS_1X, BME280_OSRS_1X, BME280_FILTER_OFF);
+const struct bme280_profile bme280_profile_low_power =
+    BME280_PROFILE_INIT(BME280_OSRS_1X, BME280_OSRS_SKIP, BME280_OSRS_1X, BME280_FILTER_OFF);
+const struct bme280_profile bme280_profile_temperature_only =
+    BME280_PROFILE_INIT(BME280_OSRS_1X, BME280_OSRS_SKIP, BME280_OSRS_SKIP, BME280_FILTER_OFF);
 
-// I2C read/write helper functions
-static int bme280_read_reg(uint8_t reg, uint8_t *data, size_t len)
+// I2C read/write helper functions. The cycle statistics count every
+// transaction and every failure. The TWIM is resumed for each transaction
+// and suspended again after it, so it stays off while conversions run.
+static int bme280_read_reg(const struct device *dev, uint8_t reg, uint8_t *data, size_t len)
 {
-    return i2c_write_read(i2c_dev, BME280_I2C_ADDR, &reg, 1, data, len);
+    const struct bme280_config *cfg = dev->config;
+    int ret = pm_device_runtime_get(cfg->bus.bus);
+
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = cycle_stats_count_i2c(i2c_write_read_dt(&cfg->bus, &reg, 1, data, len));
+    (void)pm_device_runtime_put(cfg->bus.bus);
+    return ret;
 }
 
-static int bme280_write_reg(uint8_t reg, uint8_t data)
+static int bme280_write_reg(const struct device *dev, uint8_t reg, uint8_t data)
 {
+    const struct bme280_config *cfg = dev->config;
     uint8_t buf[2] = {reg, data};
-    return i2c_write(i2c_dev, buf, 2, BME280_I2C_ADDR);
+    int ret = pm_device_runtime_get(cfg->bus.bus);
+
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = cycle_stats_count_i2c(i2c_write_dt(&cfg->bus, buf, 2));
+    (void)pm_device_runtime_put(cfg->bus.bus);
+    return ret;
 }
 
-static uint8_t bme280_read_reg8(uint8_t reg)
+static uint8_t bme280_read_reg8(const struct device *dev, uint8_t reg)
 {
     uint8_t data;
-    if (bme280_read_reg(reg, &data, 1) != 0) {
+    if (bme280_read_reg(dev, reg, &data, 1) != 0) {
         return 0;
     }
     return data;
 }
 
-static uint16_t bme280_read_reg16(uint8_t reg)
+// Little-endian calibration words
+static uint16_t bme280_get_le16(const uint8_t *buf)
 {
-    uint8_t data[2];
-    if (bme280_read_reg(reg, data, 2) != 0) {
-        return 0;
-    }
-    return (data[0] << 8) | data[1];
+    return (uint16_t)buf[0] | ((uint16_t)buf[1] << 8);
 }
 
-static int16_t bme280_read_reg16_signed(uint8_t reg)
+static int16_t bme280_get_le16_signed(const uint8_t *buf)
 {
-    return (int16_t)bme280_read_reg16(reg);
+    return (int16_t)bme280_get_le16(buf);
 }
 
-int bme280_init(void)
+// Cold boot: probe the chip, load its calibration and write the default
+// profile. The device init hook only checks the bus, so warm wakes can skip
+// all of this through bme280_resume().
+int bme280_init(const struct device *dev)
 {
+    struct bme280_dev_data *data = dev->data;
     uint8_t chip_id;
-    
-    i2c_dev = DEVICE_DT_GET(DT_CHOSEN(zephyr,i2c));
-    if (!device_is_ready(i2c_dev)) {
-        LOG_ERR("I2C device not ready");
+
+    if (!device_is_ready(dev)) {
+        LOG_ERR("%s: I2C bus not ready", dev->name);
         return -ENODEV;
     }
 
+    data->active_profile = NULL;
+    data->conversion_profile = NULL;
+
     // Check chip ID
-    chip_id = bme280_read_reg8(BME280_REG_CHIP_ID);
-    if (chip_id != 0x60) {
-        LOG_ERR("Invalid chip ID: 0x%02x", chip_id);
+    chip_id = bme280_read_reg8(dev, BME280_REG_CHIP_ID);
+    if (chip_id != BME280_CHIP_ID) {
+        LOG_ERR("%s: invalid chip ID: 0x%02x", dev->name, chip_id);
         return -ENODEV;
     }
 
-    LOG_INF("BME280 found, chip ID: 0x%02x", chip_id);
+    LOG_INF("%s found, chip ID: 0x%02x", dev->name, chip_id);
 
     // Read calibration data
-    if (bme280_read_calibration_data() != 0) {
-        LOG_ERR("Failed to read calibration data");
+    if (bme280_read_calibration_data(dev) != 0) {
+        LOG_ERR("%s: failed to read calibration data", dev->name);
+        return -EIO;
+    }
+
+    // Write the default profile; ctrl_hum latches on the first trigger
+    if (bme280_set_profile(dev, &bme280_profile_standard) != 0) {
+        LOG_ERR("%s: failed to configure measurement profile", dev->name);
+        return -EIO;
+    }
+
+    LOG_INF("%s initialized successfully", dev->name);
+    return 0;
+}
+
+// Warm wake: the sensor kept its configuration through SYSTEM OFF, so only
+// the retained calibration and the profile it was last configured with need
+// restoring. Pass NULL if that profile is not known; the next
+// bme280_set_profile() then writes the registers.
+int bme280_resume(const struct device *dev, const struct bme280_calib_data *calib,
+                  const struct bme280_profile *profile)
+{
+    struct bme280_dev_data *data = dev->data;
+
+    if (!device_is_ready(dev)) {
+        LOG_ERR("%s: I2C bus not ready", dev->name);
+        return -ENODEV;
+    }
+
+    // dig_T1 is never zero on a real part; zero means the sensor failed
+    // before its calibration was read and has to be initialized again
+    if (calib->dig_T1 == 0) {
+        return -ENODATA;
+    }
+
+    data->calib = *calib;
+    data->active_profile = profile;
+    data->conversion_profile = NULL;
+
+    LOG_DBG("%s resumed from retained calibration", dev->name);
+    return 0;
+}
+
+int bme280_set_profile(const struct device *dev, const struct bme280_profile *profile)
+{
+    struct bme280_dev_data *data = dev->data;
+
+    if (profile == data->active_profile) {
+        return 0;
+    }
+
+    // ctrl_hum only takes effect on the next ctrl_meas write (each trigger)
+    if (bme280_write_reg(dev, BME280_REG_CTRL_HUM, profile->ctrl_hum) != 0) {
         return -EIO;
     }
 
-    // Configure humidity control register
-    if (bme280_write_reg(BME280_REG_CTRL_HUM, BME280_CTRL_HUM_OSRS_H_1X) != 0) {
-        LOG_ERR("Failed to configure humidity control");
+    // config is only writable in sleep mode, which forced mode returns to
+    if (bme280_write_reg(dev, BME280_REG_CONFIG, profile->config) != 0) {
         return -EIO;
     }
 
-    // Configure measurement control register for forced mode
-    uint8_t ctrl_meas = BME280_CTRL_MEAS_OSRS_T_1X | 
-                       BME280_CTRL_MEAS_OSRS_P_1X | 
-                       BME280_CTRL_MEAS_MODE_FORCED;
-    
-    if (bme280_write_reg(BME280_REG_CTRL_MEAS, ctrl_meas) != 0) {
-        LOG_ERR("Failed to configure measurement control");
+    data->active_profile = profile;
+
+    LOG_DBG("Profile set: ctrl_hum 0x%02x, ctrl_meas 0x%02x, config 0x%02x",
+            profile->ctrl_hum, profile->ctrl_meas, profile->config);
+    return 0;
+}
+
+// Put the sensor in sleep mode before SYSTEM OFF. Forced mode already
+// returns to sleep after a conversion; this also covers a conversion that
+// was started but never fetched.
+int bme280_sleep(const struct device *dev)
+{
+    struct bme280_dev_data *data = dev->data;
+    uint8_t ctrl_meas = (data->active_profile != NULL) ? data->active_profile->ctrl_meas : 0;
+
+    data->conversion_profile = NULL;
+
+    if (bme280_write_reg(dev, BME280_REG_CTRL_MEAS, ctrl_meas | BME280_CTRL_MEAS_MODE_SLEEP) != 0) {
+        LOG_ERR("%s: failed to enter sleep mode", dev->name);
         return -EIO;
     }
 
-    LOG_INF("BME280 initialized successfully");
     return 0;
 }
 
-int bme280_read_calibration_data(void)
+void bme280_get_calibration(const struct device *dev, struct bme280_calib_data *calib)
 {
+    const struct bme280_dev_data *data = dev->data;
+
+    *calib = data->calib;
+}
+
+int bme280_read_calibration_data(const struct device *dev)
+{
+    struct bme280_dev_data *data = dev->data;
+    struct bme280_calib_data *calib = &data->calib;
+    uint8_t tp[BME280_CALIB_TP_LEN];
+    uint8_t hum[BME280_CALIB_H_LEN];
+
+    // Two burst reads cover every coefficient: 0x88-0xA1 and 0xE1-0xE7
+    if (bme280_read_reg(dev, BME280_REG_DIG_T1, tp, sizeof(tp)) != 0) {
+        return -EIO;
+    }
+
+    if (bme280_read_reg(dev, BME280_REG_DIG_H2, hum, sizeof(hum)) != 0) {
+        return -EIO;
+    }
+
     // Temperature calibration
-    calib_data.dig_T1 = bme280_read_reg16(BME280_REG_DIG_T1);
-    calib_data.dig_T2 = bme280_read_reg16_signed(BME280_REG_DIG_T2);
-    calib_data.dig_T3 = bme280_read_reg16_signed(BME280_REG_DIG_T3);
+    calib->dig_T1 = bme280_get_le16(&tp[BME280_REG_DIG_T1 - BME280_REG_DIG_T1]);
+    calib->dig_T2 = bme280_get_le16_signed(&tp[BME280_REG_DIG_T2 - BME280_REG_DIG_T1]);
+    calib->dig_T3 = bme280_get_le16_signed(&tp[BME280_REG_DIG_T3 - BME280_REG_DIG_T1]);
 
     // Pressure calibration
-    calib_data.dig_P1 = bme280_read_reg16(BME280_REG_DIG_P1);
-    calib_data.dig_P2 = bme280_read_reg16_signed(BME280_REG_DIG_P2);
-    calib_data.dig_P3 = bme280_read_reg16_signed(BME280_REG_DIG_P3);
-    calib_data.dig_P4 = bme280_read_reg16_signed(BME280_REG_DIG_P4);
-    calib_data.dig_P5 = bme280_read_reg16_signed(BME280_REG_DIG_P5);
-    calib_data.dig_P6 = bme280_read_reg16_signed(BME280_REG_DIG_P6);
-    calib_data.dig_P7 = bme280_read_reg16_signed(BME280_REG_DIG_P7);
-    calib_data.dig_P8 = bme280_read_reg16_signed(BME280_REG_DIG_P8);
-    calib_data.dig_P9 = bme280_read_reg16_signed(BME280_REG_DIG_P9);
+    calib->dig_P1 = bme280_get_le16(&tp[BME280_REG_DIG_P1 - BME280_REG_DIG_T1]);
+    calib->dig_P2 = bme280_get_le16_signed(&tp[BME280_REG_DIG_P2 - BME280_REG_DIG_T1]);
+    calib->dig_P3 = bme280_get_le16_signed(&tp[BME280_REG_DIG_P3 - BME280_REG_DIG_T1]);
+    calib->dig_P4 = bme280_get_le16_signed(&tp[BME280_REG_DIG_P4 - BME280_REG_DIG_T1]);
+    calib->dig_P5 = bme280_get_le16_signed(&tp[BME280_REG_DIG_P5 - BME280_REG_DIG_T1]);
+    calib->dig_P6 = bme280_get_le16_signed(&tp[BME280_REG_DIG_P6 - BME280_REG_DIG_T1]);
+    calib->dig_P7 = bme280_get_le16_signed(&tp[BME280_REG_DIG_P7 - BME280_REG_DIG_T1]);
+    calib->dig_P8 = bme280_get_le16_signed(&tp[BME280_REG_DIG_P8 - BME280_REG_DIG_T1]);
+    calib->dig_P9 = bme280_get_le16_signed(&tp[BME280_REG_DIG_P9 - BME280_REG_DIG_T1]);
 
     // Humidity calibration
-    calib_data.dig_H1 = bme280_read_reg8(BME280_REG_DIG_H1);
-    calib_data.dig_H2 = bme280_read_reg16_signed(BME280_REG_DIG_H2);
-    calib_data.dig_H3 = bme280_read_reg8(BME280_REG_DIG_H3);
-    
-    uint8_t h4_msb = bme280_read_reg8(BME280_REG_DIG_H4);
-    uint8_t h4_lsb = bme280_read_reg8(BME280_REG_DIG_H4 + 1);
-    calib_data.dig_H4 = (h4_msb << 4) | (h4_lsb & 0x0F);
-    
-    uint8_t h5_msb = bme280_read_reg8(BME280_REG_DIG_H5 + 1);
-    uint8_t h5_lsb = bme280_read_reg8(BME280_REG_DIG_H5);
-    calib_data.dig_H5 = (h5_msb << 4) | ((h5_lsb >> 4) & 0x0F);
-    
-    calib_data.dig_H6 = (int8_t)bme280_read_reg8(BME280_REG_DIG_H6);
+    calib->dig_H1 = tp[BME280_REG_DIG_H1 - BME280_REG_DIG_T1];
+    calib->dig_H2 = bme280_get_le16_signed(&hum[BME280_REG_DIG_H2 - BME280_REG_DIG_H2]);
+    calib->dig_H3 = hum[BME280_REG_DIG_H3 - BME280_REG_DIG_H2];
+
+    // H4 and H5 are 12-bit values sharing the nibbles of 0xE5
+    uint8_t e4 = hum[BME280_REG_DIG_H4 - BME280_REG_DIG_H2];
+    uint8_t e5 = hum[BME280_REG_DIG_H5 - BME280_REG_DIG_H2];
+    uint8_t e6 = hum[BME280_REG_DIG_H5 + 1 - BME280_REG_DIG_H2];
+    calib->dig_H4 = (int16_t)(((int8_t)e4 * 16) | (e5 & 0x0F));
+    calib->dig_H5 = (int16_t)(((int8_t)e6 * 16) | ((e5 >> 4) & 0x0F));
+
+    calib->dig_H6 = (int8_t)hum[BME280_REG_DIG_H6 - BME280_REG_DIG_H2];
 
     LOG_INF("Calibration data loaded");
     return 0;
 }
 
-int bme280_read_forced(struct bme280_data *data)
+// Wait for a forced conversion. With status polling the wait ends as soon as
+// the measuring bit clears after the typical time, otherwise sleep the
+// datasheet maximum.
+static int bme280_wait_conversion(const struct device *dev, uint32_t start,
+                                  uint32_t typ_us, uint32_t max_us)
 {
-    uint8_t raw_data[8];
-    int32_t adc_T, adc_P, adc_H;
-    int32_t var1, var2, t_fine;
-    int32_t p, h;
+    // Time the conversion has already had while the caller did other work
+    uint32_t waited_us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
 
-    // Trigger forced measurement
-    uint8_t ctrl_meas = BME280_CTRL_MEAS_OSRS_T_1X | 
-                       BME280_CTRL_MEAS_OSRS_P_1X | 
-                       BME280_CTRL_MEAS_MODE_FORCED;
-    
-    if (bme280_write_reg(BME280_REG_CTRL_MEAS, ctrl_meas) != 0) {
-        LOG_ERR("Failed to trigger measurement");
-        return -EIO;
+    if (!IS_ENABLED(CONFIG_APP_BME280_STATUS_POLL)) {
+        if (waited_us < max_us) {
+            k_usleep(max_us - waited_us);
+        }
+        return 0;
     }
 
-    // Wait for measurement to complete (max 10ms)
-    k_sleep(K_MSEC(10));
+    if (waited_us < typ_us) {
+        k_usleep(typ_us - waited_us);
+        waited_us = typ_us;
+    }
 
-    // Read all sensor data
-    if (bme280_read_reg(BME280_REG_PRESS_MSB, raw_data, 8) != 0) {
-        LOG_ERR("Failed to read sensor data");
-        return -EIO;
+    while (true) {
+        uint8_t status;
+
+        if (bme280_read_reg(dev, BME280_REG_STATUS, &status, 1) != 0) {
+            return -EIO;
+        }
+
+        if ((status & BME280_STATUS_MEASURING) == 0) {
+            return 0;
+        }
+
+        // Still measuring past the datasheet maximum: the data registers
+        // would hold a stale or partial result
+        if (waited_us >= max_us) {
+            return -ETIMEDOUT;
+        }
+
+        k_usleep(BME280_STATUS_POLL_US);
+        waited_us += BME280_STATUS_POLL_US;
     }
+}
 
-    // Extract raw ADC values
-    adc_P = ((int32_t)raw_data[0] << 12) | ((int32_t)raw_data[1] << 4) | (raw_data[2] >> 4);
-    adc_T = ((int32_t)raw_data[3] << 12) | ((int32_t)raw_data[4] << 4) | (raw_data[5] >> 4);
-    adc_H = ((int32_t)raw_data[6] << 8) | raw_data[7];
+// Temperature compensation (returns temperature in 0.01°C)
+static int32_t bme280_compensate_temperature(const struct bme280_calib_data *calib,
+                                             int32_t adc_T, int32_t *t_fine)
+{
+    int32_t var1, var2;
 
-    // Temperature compensation (returns temperature in 0.01°C)
-    var1 = ((((adc_T >> 3) - ((int32_t)calib_data.dig_T1 << 1))) * 
-            ((int32_t)calib_data.dig_T2)) >> 11;
-    var2 = (((((adc_T >> 4) - ((int32_t)calib_data.dig_T1)) * 
-              ((adc_T >> 4) - ((int32_t)calib_data.dig_T1))) >> 12) * 
-            ((int32_t)calib_data.dig_T3)) >> 14;
-    t_fine = var1 + var2;
-    data->temperature = (float)((t_fine * 5 + 128) >> 8) / 100.0f;
+    var1 = ((((adc_T >> 3) - ((int32_t)calib->dig_T1 << 1))) * 
+            ((int32_t)calib->dig_T2)) >> 11;
+    var2 = (((((adc_T >> 4) - ((int32_t)calib->dig_T1)) * 
+              ((adc_T >> 4) - ((int32_t)calib->dig_T1))) >> 12) * 
+            ((int32_t)calib->dig_T3)) >> 14;
+    *t_fine = var1 + var2;
+    return (*t_fine * 5 + 128) >> 8;
+}
+
+#if defined(CONFIG_APP_BME280_PRESSURE_COMP_64BIT)
+// Pressure compensation, 64-bit datasheet variant (returns pressure in Pa).
+// The datasheet formula yields Q24.8 Pa; it is rounded to whole Pa here.
+static int bme280_compensate_pressure(const struct bme280_calib_data *calib,
+                                      int32_t adc_P, int32_t t_fine, uint32_t *pressure)
+{
+    int64_t var1, var2, p;
+
+    var1 = ((int64_t)t_fine) - 128000;
+    var2 = var1 * var1 * (int64_t)calib->dig_P6;
+    var2 = var2 + ((var1 * (int64_t)calib->dig_P5) << 17);
+    var2 = var2 + (((int64_t)calib->dig_P4) << 35);
+    var1 = ((var1 * var1 * (int64_t)calib->dig_P3) >> 8) +
+           ((var1 * (int64_t)calib->dig_P2) << 12);
+    var1 = (((((int64_t)1) << 47) + var1)) * ((int64_t)calib->dig_P1) >> 33;
+    if (var1 == 0) {
+        return -EIO;
+    }
+    p = 1048576 - adc_P;
+    p = (((p << 31) - var2) * 3125) / var1;
+    var1 = (((int64_t)calib->dig_P9) * (p >> 13) * (p >> 13)) >> 25;
+    var2 = (((int64_t)calib->dig_P8) * p) >> 19;
+    p = ((p + var1 + var2) >> 8) + (((int64_t)calib->dig_P7) << 4);
+    *pressure = (uint32_t)((p + 128) >> 8);
+    return 0;
+}
+#else
+// Pressure compensation, 32-bit datasheet variant (returns pressure in Pa)
+static int bme280_compensate_pressure(const struct bme280_calib_data *calib,
+                                      int32_t adc_P, int32_t t_fine, uint32_t *pressure)
+{
+    int32_t var1, var2;
+    uint32_t p;
 
-    // Pressure compensation
     var1 = (((int32_t)t_fine) >> 1) - (int32_t)64000;
-    var2 = (((var1 >> 2) * (var1 >> 2)) >> 11) * ((int32_t)calib_data.dig_P6);
-    var2 = var2 + ((var1 * ((int32_t)calib_data.dig_P5)) << 1);
-    var2 = (var2 >> 2) + (((int32_t)calib_data.dig_P4) << 16);
-    var1 = (((calib_data.dig_P3 * (((var1 >> 2) * (var1 >> 2)) >> 13)) >> 3) + 
-            ((((int32_t)calib_data.dig_P2) * var1) >> 1)) >> 18;
-    var1 = ((((32768 + var1)) * ((int32_t)calib_data.dig_P1)) >> 15);
+    var2 = (((var1 >> 2) * (var1 >> 2)) >> 11) * ((int32_t)calib->dig_P6);
+    var2 = var2 + ((var1 * ((int32_t)calib->dig_P5)) << 1);
+    var2 = (var2 >> 2) + (((int32_t)calib->dig_P4) << 16);
+    var1 = (((calib->dig_P3 * (((var1 >> 2) * (var1 >> 2)) >> 13)) >> 3) + 
+            ((((int32_t)calib->dig_P2) * var1) >> 1)) >> 18;
+    var1 = ((((32768 + var1)) * ((int32_t)calib->dig_P1)) >> 15);
     if (var1 == 0) {
         return -EIO;
     }
@@ -183,24 +370,223 @@ int bme280_read_forced(struct bme280_data *data)
     } else {
         p = (p / (uint32_t)var1) * 2;
     }
-    var1 = (((int32_t)calib_data.dig_P9) * ((int32_t)(((p >> 3) * (p >> 3)) >> 13))) >> 12;
-    var2 = (((int32_t)(p >> 2)) * ((int32_t)calib_data.dig_P8)) >> 13;
-    p = (uint32_t)((int32_t)p + ((var1 + var2 + calib_data.dig_P7) >> 4));
-    data->pressure = (float)p / 256.0f;
+    var1 = (((int32_t)calib->dig_P9) * ((int32_t)(((p >> 3) * (p >> 3)) >> 13))) >> 12;
+    var2 = (((int32_t)(p >> 2)) * ((int32_t)calib->dig_P8)) >> 13;
+    *pressure = (uint32_t)((int32_t)p + ((var1 + var2 + calib->dig_P7) >> 4));
+    return 0;
+}
+#endif
+
+// Humidity compensation (returns humidity in Q22.10 %RH)
+static uint32_t bme280_compensate_humidity(const struct bme280_calib_data *calib,
+                                           int32_t adc_H, int32_t t_fine)
+{
+    int32_t var1, var2;
 
-    // Humidity compensation
     var1 = (t_fine - ((int32_t)76800));
-    var2 = ((((adc_H << 14) - (((int32_t)calib_data.dig_H4) << 20) - 
-              (((int32_t)calib_data.dig_H5) * var1)) + (int32_t)16384) >> 15) * 
-           (((((((var1 * ((int32_t)calib_data.dig_H6)) >> 10) * 
-                (((var1 * ((int32_t)calib_data.dig_H3)) >> 11) + (int32_t)32768)) >> 10) + 
-              (int32_t)2097152) * ((int32_t)calib_data.dig_H2) + 8192) >> 14);
-    var1 = var1 - ((var2 * (((var1 * ((int32_t)calib_data.dig_H6)) >> 10) * 
-                            (((var1 * ((int32_t)calib_data.dig_H3)) >> 11) + (int32_t)32768))) >> 10);
+    var2 = ((((adc_H << 14) - (((int32_t)calib->dig_H4) << 20) - 
+              (((int32_t)calib->dig_H5) * var1)) + (int32_t)16384) >> 15) * 
+           (((((((var1 * ((int32_t)calib->dig_H6)) >> 10) * 
+                (((var1 * ((int32_t)calib->dig_H3)) >> 11) + (int32_t)32768)) >> 10) + 
+              (int32_t)2097152) * ((int32_t)calib->dig_H2) + 8192) >> 14);
+    var1 = var1 - ((var2 * (((var1 * ((int32_t)calib->dig_H6)) >> 10) * 
+                            (((var1 * ((int32_t)calib->dig_H3)) >> 11) + (int32_t)32768))) >> 10);
     var1 = (var1 < 0 ? 0 : var1);
     var1 = (var1 > 419430400 ? 419430400 : var1);
-    h = (uint32_t)(var1 >> 12);
-    data->humidity = (float)h / 1024.0f;
+    return (uint32_t)(var1 >> 12);
+}
+
+// Trigger a forced conversion with the active profile and return without
+// waiting; the sensor converts on its own while the caller does other work.
+// Several instances can be started back to back and fetched afterwards so
+// their conversions overlap.
+int bme280_start_forced(const struct device *dev)
+{
+    struct bme280_dev_data *data = dev->data;
+
+    if (data->active_profile == NULL) {
+        return -ENODEV;
+    }
+
+    // Trigger forced measurement
+    uint8_t ctrl_meas = data->active_profile->ctrl_meas | BME280_CTRL_MEAS_MODE_FORCED;
+
+    if (bme280_write_reg(dev, BME280_REG_CTRL_MEAS, ctrl_meas) != 0) {
+        LOG_ERR("%s: failed to trigger measurement", dev->name);
+        data->conversion_profile = NULL;
+        return -EIO;
+    }
+
+    data->conversion_start = k_cycle_get_32();
+    data->conversion_profile = data->active_profile;
+    return 0;
+}
+
+// Wait for the conversion started by bme280_start_forced(), counting the
+// time already spent elsewhere, then burst-read the raw registers and
+// compensate them straight into the caller's struct
+int bme280_fetch_forced_fixed(const struct device *dev, struct bme280_data_fixed *out)
+{
+    struct bme280_dev_data *data = dev->data;
+    const struct bme280_calib_data *calib = &data->calib;
+    const struct bme280_profile *profile = data->conversion_profile;
+    uint8_t raw_data[8];
+    int32_t adc_T, adc_P, adc_H;
+    int32_t t_fine;
+    int ret;
+
+    if (profile == NULL) {
+        return -EAGAIN;
+    }
+    data->conversion_profile = NULL;
+
+    // Wait for measurement to complete
+    ret = bme280_wait_conversion(dev, data->conversion_start,
+                                 profile->meas_typ_us, profile->meas_max_us);
+    if (ret != 0) {
+        LOG_ERR("%s: measurement not ready: %d", dev->name, ret);
+        return ret;
+    }
+
+    // Read all sensor data
+    if (bme280_read_reg(dev, BME280_REG_PRESS_MSB, raw_data, 8) != 0) {
+        LOG_ERR("%s: failed to read sensor data", dev->name);
+        return -EIO;
+    }
+
+    // Extract raw ADC values
+    adc_P = ((int32_t)raw_data[0] << 12) | ((int32_t)raw_data[1] << 4) | (raw_data[2] >> 4);
+    adc_T = ((int32_t)raw_data[3] << 12) | ((int32_t)raw_data[4] << 4) | (raw_data[5] >> 4);
+    adc_H = ((int32_t)raw_data[6] << 8) | raw_data[7];
+
+    out->channels = BME280_CHAN_TEMP;
+    out->pressure = 0;
+    out->humidity = 0;
+    out->temperature = bme280_compensate_temperature(calib, adc_T, &t_fine);
+
+    if (profile->ctrl_meas & BME280_CTRL_MEAS_OSRS_P_MASK) {
+        if (bme280_compensate_pressure(calib, adc_P, t_fine, &out->pressure) != 0) {
+            return -EIO;
+        }
+        out->channels |= BME280_CHAN_PRESS;
+    }
+
+    if (profile->ctrl_hum & BME280_CTRL_HUM_OSRS_H_MASK) {
+        out->humidity = bme280_compensate_humidity(calib, adc_H, t_fine);
+        out->channels |= BME280_CHAN_HUM;
+    }
+
+    return 0;
+}
+
+int bme280_read_forced_fixed(const struct device *dev, struct bme280_data_fixed *data)
+{
+    int ret = bme280_start_forced(dev);
+    if (ret != 0) {
+        return ret;
+    }
+
+    return bme280_fetch_forced_fixed(dev, data);
+}
+
+// Floating-point convenience wrapper; the main loop uses the fixed-point API
+int bme280_read_forced(const struct device *dev, struct bme280_data *data)
+{
+    struct bme280_data_fixed fixed;
+    int ret = bme280_read_forced_fixed(dev, &fixed);
+    if (ret != 0) {
+        return ret;
+    }
+
+    data->temperature = (float)fixed.temperature / 100.0f;
+    data->pressure = (float)fixed.pressure / 100.0f;
+    data->humidity = (float)fixed.humidity / 1024.0f;
+    data->channels = fixed.channels;
+
+    return 0;
+}
+
+// Zephyr sensor API. A fetch runs a complete forced conversion with the
+// active profile; channels the profile skips report -ENODATA.
+static int bme280_sample_fetch(const struct device *dev, enum sensor_channel chan)
+{
+    struct bme280_dev_data *data = dev->data;
+
+    if (chan != SENSOR_CHAN_ALL && chan != SENSOR_CHAN_AMBIENT_TEMP &&
+        chan != SENSOR_CHAN_PRESS && chan != SENSOR_CHAN_HUMIDITY) {
+        return -ENOTSUP;
+    }
+
+    data->sample.channels = 0;
+    return bme280_read_forced_fixed(dev, &data->sample);
+}
+
+static int bme280_channel_get(const struct device *dev, enum sensor_channel chan,
+                              struct sensor_value *val)
+{
+    const struct bme280_data_fixed *sample = &((const struct bme280_dev_data *)dev->data)->sample;
+
+    switch (chan) {
+    case SENSOR_CHAN_AMBIENT_TEMP:
+        // 0.01 C to C
+        if (!(sample->channels & BME280_CHAN_TEMP)) {
+            return -ENODATA;
+        }
+        val->val1 = sample->temperature / 100;
+        val->val2 = (sample->temperature % 100) * 10000;
+        return 0;
+    case SENSOR_CHAN_PRESS:
+        // Pa to kPa
+        if (!(sample->channels & BME280_CHAN_PRESS)) {
+            return -ENODATA;
+        }
+        val->val1 = (int32_t)(sample->pressure / 1000);
+        val->val2 = (int32_t)(sample->pressure % 1000) * 1000;
+        return 0;
+    case SENSOR_CHAN_HUMIDITY:
+        // Q22.10 to %RH
+        if (!(sample->channels & BME280_CHAN_HUM)) {
+            return -ENODATA;
+        }
+        val->val1 = (int32_t)(sample->humidity >> 10);
+        val->val2 = (int32_t)(((sample->humidity & 0x3FF) * 1000000U) >> 10);
+        return 0;
+    default:
+        return -ENOTSUP;
+    }
+}
+
+static const struct sensor_driver_api bme280_api = {
+    .sample_fetch = bme280_sample_fetch,
+    .channel_get = bme280_channel_get,
+};
+
+// Device init only checks the bus: chip probing and calibration are left to
+// bme280_init() so that a warm wake costs no I2C traffic
+static int bme280_dev_init(const struct device *dev)
+{
+    const struct bme280_config *cfg = dev->config;
+
+    if (!i2c_is_ready_dt(&cfg->bus)) {
+        return -ENODEV;
+    }
 
     return 0;
 }
+
+#define BME280_DEFINE(inst)                                                    \
+    static struct bme280_dev_data bme280_data_##inst;                          \
+    static const struct bme280_config bme280_config_##inst = {                 \
+        .bus = I2C_DT_SPEC_INST_GET(inst),                                     \
+    };                                                                         \
+    DEVICE_DT_INST_DEFINE(inst, bme280_dev_init, NULL,                         \
+                          &bme280_data_##inst, &bme280_config_##inst,          \
+                          POST_KERNEL, CONFIG_SENSOR_INIT_PRIORITY, &bme280_api);
+
+DT_INST_FOREACH_STATUS_OKAY(BME280_DEFINE)
+
+#define BME280_DEVICE_GET(inst) DEVICE_DT_INST_GET(inst),
+
+const struct device *const bme280_devices[BME280_COUNT] = {
+    DT_INST_FOREACH_STATUS_OKAY(BME280_DEVICE_GET)
+};
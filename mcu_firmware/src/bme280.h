@@ -2,9 +2,14 @@
 #define BME280_H
 
 #include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
 
-// BME280 I2C address
-#define BME280_I2C_ADDR 0x76
+// Sensors are instantiated from "bosch,bme280" devicetree nodes; the bus
+// and I2C address (0x76 or 0x77) come from the node. Instance 0 is the
+// primary sensor whose reading is advertised.
+#define BME280_COUNT DT_NUM_INST_STATUS_OKAY(bosch_bme280)
+#define BME280_CHIP_ID 0x60
 
 // BME280 registers
 #define BME280_REG_TEMP_MSB    0xFA
@@ -16,6 +21,7 @@
 #define BME280_REG_HUM_MSB     0xFD
 #define BME280_REG_HUM_LSB     0xFE
 #define BME280_REG_CONFIG      0xF5
+#define BME280_REG_STATUS      0xF3
 #define BME280_REG_CTRL_MEAS   0xF4
 #define BME280_REG_CTRL_HUM    0xF2
 #define BME280_REG_CHIP_ID     0xD0
@@ -41,17 +47,100 @@
 #define BME280_REG_DIG_H5      0xE5
 #define BME280_REG_DIG_H6      0xE7
 
+// Calibration burst lengths (0x88-0xA1 and 0xE1-0xE7)
+#define BME280_CALIB_TP_LEN    (BME280_REG_DIG_H1 - BME280_REG_DIG_T1 + 1)
+#define BME280_CALIB_H_LEN     (BME280_REG_DIG_H6 - BME280_REG_DIG_H2 + 1)
+
 // Control register values
 #define BME280_CTRL_HUM_OSRS_H_1X    0x01
 #define BME280_CTRL_MEAS_OSRS_T_1X   0x20
 #define BME280_CTRL_MEAS_OSRS_P_1X   0x04
+#define BME280_CTRL_MEAS_MODE_SLEEP  0x00
 #define BME280_CTRL_MEAS_MODE_FORCED 0x01
+#define BME280_CTRL_MEAS_OSRS_T_MASK 0xE0
+#define BME280_CTRL_MEAS_OSRS_P_MASK 0x1C
+#define BME280_CTRL_HUM_OSRS_H_MASK  0x07
+
+// Status register bits
+#define BME280_STATUS_MEASURING      0x08
+
+// Oversampling settings for the osrs_t / osrs_p / osrs_h fields
+#define BME280_OSRS_SKIP             0x00  // Channel skipped
+#define BME280_OSRS_1X               0x01
+#define BME280_OSRS_2X               0x02
+#define BME280_OSRS_4X               0x03
+#define BME280_OSRS_8X               0x04
+#define BME280_OSRS_16X              0x05
+
+// IIR filter coefficient for the config register filter field
+#define BME280_FILTER_OFF            0x00
+#define BME280_FILTER_2              0x01
+#define BME280_FILTER_4              0x02
+#define BME280_FILTER_8              0x03
+#define BME280_FILTER_16             0x04
+
+// Oversampling factor for a 3-bit osrs_x field (0 = channel skipped)
+#define BME280_OSRS_FACTOR(osrs)     ((osrs) == 0 ? 0 : ((osrs) >= 5 ? 16 : (1 << ((osrs) - 1))))
+
+// Measurement time in microseconds from oversampling factors (datasheet 9.1)
+#define BME280_MEAS_TIME_TYP_US(t, p, h) \
+    (1000 + 2000 * (t) + ((p) ? 2000 * (p) + 500 : 0) + ((h) ? 2000 * (h) + 500 : 0))
+#define BME280_MEAS_TIME_MAX_US(t, p, h) \
+    (1250 + 2300 * (t) + ((p) ? 2300 * (p) + 575 : 0) + ((h) ? 2300 * (h) + 575 : 0))
+
+// Measurement profile: per-channel oversampling, IIR filter and the
+// resulting conversion time. Temperature cannot be skipped because pressure
+// and humidity compensation depend on it.
+struct bme280_profile {
+    uint8_t ctrl_hum;        // ctrl_hum register value
+    uint8_t ctrl_meas;       // ctrl_meas register value without mode bits
+    uint8_t config;          // config register value (IIR filter)
+    uint32_t meas_typ_us;    // Typical conversion time
+    uint32_t meas_max_us;    // Maximum conversion time
+};
+
+// Build a profile; the conversion timing is resolved at compile time
+#define BME280_PROFILE_INIT(osrs_t, osrs_p, osrs_h, filter)                     \
+    {                                                                          \
+        .ctrl_hum = (osrs_h),                                                  \
+        .ctrl_meas = ((osrs_t) << 5) | ((osrs_p) << 2),                        \
+        .config = (filter) << 2,                                               \
+        .meas_typ_us = BME280_MEAS_TIME_TYP_US(BME280_OSRS_FACTOR(osrs_t),     \
+                                               BME280_OSRS_FACTOR(osrs_p),     \
+                                               BME280_OSRS_FACTOR(osrs_h)),    \
+        .meas_max_us = BME280_MEAS_TIME_MAX_US(BME280_OSRS_FACTOR(osrs_t),     \
+                                               BME280_OSRS_FACTOR(osrs_p),     \
+                                               BME280_OSRS_FACTOR(osrs_h)),    \
+    }
+
+// Predefined profiles
+extern const struct bme280_profile bme280_profile_high_precision;   // T 2x, P 16x, H 2x, IIR 2
+extern const struct bme280_profile bme280_profile_standard;         // T/P/H 1x, no filter
+extern const struct bme280_profile bme280_profile_low_power;        // T/H 1x, pressure skipped
+extern const struct bme280_profile bme280_profile_temperature_only; // T 1x, P/H skipped
+
+// Status register poll period once the typical conversion time has elapsed
+#define BME280_STATUS_POLL_US        250
+
+// Channels present in a reading (skipped channels are not compensated)
+#define BME280_CHAN_TEMP       0x01
+#define BME280_CHAN_PRESS      0x02
+#define BME280_CHAN_HUM        0x04
 
 // Sensor data structure
 struct bme280_data {
     float temperature;  // Celsius
     float pressure;     // hPa
     float humidity;     // %
+    uint8_t channels;   // BME280_CHAN_* bits of the valid fields
+};
+
+// Fixed-point sensor data, straight from the Bosch integer formulas
+struct bme280_data_fixed {
+    int32_t temperature;   // 0.01 °C
+    uint32_t pressure;     // Pa
+    uint32_t humidity;     // Q22.10 %RH (1024 = 1 %RH)
+    uint8_t channels;      // BME280_CHAN_* bits of the valid fields
 };
 
 // Calibration data structure
@@ -76,9 +165,23 @@ struct bme280_calib_data {
     int8_t dig_H6;
 };
 
-// Function prototypes
-int bme280_init(void);
-int bme280_read_forced(struct bme280_data *data);
-int bme280_read_calibration_data(void);
+// Devicetree instances, in instance order
+extern const struct device *const bme280_devices[BME280_COUNT];
+
+// Function prototypes. The Zephyr sensor API (sensor_sample_fetch() and
+// sensor_channel_get()) is also available once bme280_init() or
+// bme280_resume() has run; the main loop uses the start/fetch fast path,
+// which writes straight into the caller's struct.
+int bme280_init(const struct device *dev);
+int bme280_resume(const struct device *dev, const struct bme280_calib_data *calib,
+                  const struct bme280_profile *profile);
+int bme280_set_profile(const struct device *dev, const struct bme280_profile *profile);
+int bme280_start_forced(const struct device *dev);
+int bme280_fetch_forced_fixed(const struct device *dev, struct bme280_data_fixed *data);
+int bme280_read_forced(const struct device *dev, struct bme280_data *data);
+int bme280_read_forced_fixed(const struct device *dev, struct bme280_data_fixed *data);
+int bme280_read_calibration_data(const struct device *dev);
+int bme280_sleep(const struct device *dev);
+void bme280_get_calibration(const struct device *dev, struct bme280_calib_data *calib);
 
 #endif // BME280_H
@@ -0,0 +1,154 @@
+#include "cycle_stats.h"
+#include "adaptive_scheduler.h"
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <string.h>
+
+LOG_MODULE_REGISTER(cycle_stats, LOG_LEVEL_INF);
+
+// Completed cycles and running totals
+static struct cycle_stats stats;
+
+// Current cycle. The cycle counter restarts from zero with every boot out
+// of SYSTEM OFF, so the cycle and its init phase start at zero.
+static uint32_t cycle_start;
+static uint32_t phase_start[CYCLE_PHASE_COUNT];
+static uint32_t phase_us[CYCLE_PHASE_COUNT];
+static uint16_t i2c_transactions;
+static uint16_t i2c_errors;
+static int32_t adv_events = -1;
+
+// Warm wake: carry the totals and the previous cycle over. Pass NULL on a
+// cold boot.
+void cycle_stats_init(const struct cycle_stats *prev)
+{
+    if (prev != NULL) {
+        stats = *prev;
+    } else {
+        memset(&stats, 0, sizeof(stats));
+    }
+}
+
+void cycle_stats_begin(enum cycle_phase phase)
+{
+    phase_start[phase] = k_cycle_get_32();
+}
+
+void cycle_stats_end(enum cycle_phase phase)
+{
+    phase_us[phase] = k_cyc_to_us_floor32(k_cycle_get_32() - phase_start[phase]);
+}
+
+// Called by the I2C helpers once per transaction with its result, which is
+// passed through
+int cycle_stats_count_i2c(int ret)
+{
+    if (i2c_transactions < UINT16_MAX) {
+        i2c_transactions++;
+    }
+    if (ret != 0 && i2c_errors < UINT16_MAX) {
+        i2c_errors++;
+    }
+    return ret;
+}
+
+void cycle_stats_count_adv(uint16_t events)
+{
+    adv_events = events;
+}
+
+// Counted straight into the totals so that failures before the end of the
+// cycle are kept even if the cycle never finishes
+void cycle_stats_count_error(enum cycle_error source)
+{
+    if (stats.errors[source] < UINT16_MAX) {
+        stats.errors[source]++;
+    }
+}
+
+// Close the cycle just before SYSTEM OFF and copy the result out for
+// retained RAM
+void cycle_stats_finish(struct cycle_stats *out)
+{
+    uint32_t awake_us = k_cyc_to_us_floor32(k_cycle_get_32() - cycle_start);
+    uint32_t radio_us = phase_us[CYCLE_PHASE_ADV] + phase_us[CYCLE_PHASE_WINDOW];
+    uint32_t radio_idle_us = awake_us - MIN(radio_us, awake_us);
+
+    // The CPU sleeps while the controller runs the set, so the advertising
+    // window is charged per event instead of by time. Maintenance windows
+    // are left out of the estimate.
+    uint64_t wake_nc = (uint64_t)radio_idle_us * CYCLE_STATS_AWAKE_CURRENT_EST_UA;
+
+    if (IS_ENABLED(CONFIG_SERIAL)) {
+        wake_nc += (uint64_t)awake_us * CYCLE_STATS_UART_CURRENT_EST_UA;
+    }
+
+    uint32_t wake_uc = (uint32_t)(wake_nc / 1000000);
+    uint32_t adv_uc = (adv_events > 0) ? (uint32_t)adv_events * ENERGY_ADV_EVENT_CHARGE_UC : 0;
+
+    memcpy(stats.phase_us, phase_us, sizeof(stats.phase_us));
+    stats.awake_us = awake_us;
+    stats.charge_est_uc = wake_uc + adv_uc;
+    stats.charge_est_total_mc += stats.charge_est_uc / 1000;
+    stats.i2c_transactions = i2c_transactions;
+    stats.i2c_errors = i2c_errors;
+    stats.i2c_errors_total += i2c_errors;
+    if (adv_events >= 0) {
+        stats.adv_events = (uint8_t)MIN(adv_events, UINT8_MAX);
+        stats.adv_events_total += adv_events;
+    }
+
+    if (stats.cycles == 0) {
+        stats.wake_charge_est_uc = wake_uc;
+    } else {
+        int32_t avg = stats.wake_charge_est_uc;
+
+        avg += ((int32_t)wake_uc - avg) / (1 << CYCLE_STATS_EWMA_SHIFT);
+        stats.wake_charge_est_uc = avg;
+    }
+    stats.cycles++;
+
+    LOG_INF("Cycle %u: awake %u us, est. %u uC, I2C %u (%u failed), adv %u us",
+            stats.cycles, stats.awake_us, stats.charge_est_uc, stats.i2c_transactions,
+            stats.i2c_errors, stats.phase_us[CYCLE_PHASE_ADV]);
+    LOG_DBG("Errors: bme280 %u, battery %u, rtc %u, ble %u",
+            stats.errors[CYCLE_ERR_BME280], stats.errors[CYCLE_ERR_BATTERY],
+            stats.errors[CYCLE_ERR_RTC], stats.errors[CYCLE_ERR_BLE]);
+    LOG_DBG("Phases (us): init %u, adc %u, bme280 %u, ble %u, window %u, image %u, rtc %u",
+            stats.phase_us[CYCLE_PHASE_INIT], stats.phase_us[CYCLE_PHASE_ADC],
+            stats.phase_us[CYCLE_PHASE_BME280], stats.phase_us[CYCLE_PHASE_BLE_START],
+            stats.phase_us[CYCLE_PHASE_WINDOW], stats.phase_us[CYCLE_PHASE_IMAGE],
+            stats.phase_us[CYCLE_PHASE_RTC]);
+
+    *out = stats;
+}
+
+// Start the next cycle without a reboot, for the simulated board whose
+// SYSTEM OFF returns to the main loop
+void cycle_stats_restart(void)
+{
+    cycle_start = k_cycle_get_32();
+    memset(phase_us, 0, sizeof(phase_us));
+    i2c_transactions = 0;
+    i2c_errors = 0;
+    adv_events = -1;
+}
+
+// Estimated charge of one wake cycle without advertising, for the energy
+// budget: the measured awake time at the assumed awake current, or the
+// configured per-wake estimate until a cycle has been timed
+uint32_t cycle_stats_wake_charge_est_uc(void)
+{
+    return (stats.cycles > 0) ? stats.wake_charge_est_uc : ENERGY_WAKE_CHARGE_UC;
+}
+
+// Summary of the previous cycle for the advertising payload
+size_t cycle_stats_encode_summary(uint8_t *buf)
+{
+    sys_put_le16(MIN(stats.awake_us / 1000, UINT16_MAX), &buf[0]);
+    sys_put_le16(MIN(stats.charge_est_uc, UINT16_MAX), &buf[2]);
+    buf[4] = MIN(stats.i2c_errors, UINT8_MAX);
+    buf[5] = stats.adv_events;
+
+    return CYCLE_STATS_SUMMARY_LEN;
+}
@@ -0,0 +1,77 @@
+#ifndef CYCLE_STATS_H
+#define CYCLE_STATS_H
+
+#include <zephyr/kernel.h>
+
+// Phases of one wake cycle. Phases may overlap; each is timed from its own
+// begin to its own end.
+enum cycle_phase {
+    CYCLE_PHASE_INIT = 0,      // Kernel start to subsystems ready
+    CYCLE_PHASE_ADC,           // Battery read start to result
+    CYCLE_PHASE_BME280,        // Forced conversion trigger to compensated data
+    CYCLE_PHASE_BLE_START,     // Waiting for the controller and starting the set
+    CYCLE_PHASE_ADV,           // Advertising set running
+    CYCLE_PHASE_WINDOW,        // Connectable maintenance window
+    CYCLE_PHASE_IMAGE,         // MCUboot image state check after an update
+    CYCLE_PHASE_RTC,           // Arming the next wake
+    CYCLE_PHASE_COUNT
+};
+
+// Failure sources for the error counters
+enum cycle_error {
+    CYCLE_ERR_BME280 = 0,      // Sensor init, profile or conversion
+    CYCLE_ERR_BATTERY,         // ADC setup or read
+    CYCLE_ERR_RTC,             // RV-3028 setup or wake arming
+    CYCLE_ERR_BLE,             // Controller bring-up or advertising
+    CYCLE_ERR_COUNT
+};
+
+// Assumed average supply current while awake, for the charge estimate.
+// Not a measurement; see CONFIG_APP_CYCLE_STATS_AWAKE_CURRENT_EST_UA.
+#define CYCLE_STATS_AWAKE_CURRENT_EST_UA  CONFIG_APP_CYCLE_STATS_AWAKE_CURRENT_EST_UA
+
+// Assumed extra current of an enabled UARTE, which keeps the high-frequency
+// clock running for the whole awake time, advertising window included. Not a
+// measurement; see CONFIG_APP_CYCLE_STATS_UART_CURRENT_EST_UA.
+#define CYCLE_STATS_UART_CURRENT_EST_UA   CONFIG_APP_CYCLE_STATS_UART_CURRENT_EST_UA
+
+// Filter weight 1 / 2^CYCLE_STATS_EWMA_SHIFT for the wake charge average
+#define CYCLE_STATS_EWMA_SHIFT        3
+
+// Compact summary appended to the v2 advertising payload:
+//   uint16_t awake_ms;        // Previous cycle, kernel start to SYSTEM OFF
+//   uint16_t charge_est_uc;   // Previous cycle estimate, advertising included
+//   uint8_t i2c_errors;       // Failed I2C transactions, previous cycle
+//   uint8_t adv_events;       // Events sent by the previous transmission
+#define CYCLE_STATS_SUMMARY_LEN       6
+
+// Per-cycle statistics, kept in retained RAM. Times and counts are measured;
+// charges are estimates derived from the times.
+struct cycle_stats {
+    uint32_t cycles;                          // Completed wake cycles since cold boot
+    uint32_t phase_us[CYCLE_PHASE_COUNT];     // Phase durations, last cycle
+    uint32_t awake_us;                        // Kernel start to SYSTEM OFF, last cycle
+    uint32_t charge_est_uc;                   // Estimated charge, last cycle
+    uint32_t wake_charge_est_uc;              // Filtered estimate without advertising
+    uint32_t charge_est_total_mc;             // Estimated charge since cold boot
+    uint16_t i2c_transactions;                // Last cycle
+    uint16_t i2c_errors;                      // Failed transactions, last cycle
+    uint32_t i2c_errors_total;
+    uint8_t adv_events;                       // Last transmission
+    uint32_t adv_events_total;
+    uint16_t errors[CYCLE_ERR_COUNT];         // Failures since cold boot, by source
+};
+
+// Function prototypes
+void cycle_stats_init(const struct cycle_stats *prev);
+void cycle_stats_begin(enum cycle_phase phase);
+void cycle_stats_end(enum cycle_phase phase);
+int cycle_stats_count_i2c(int ret);
+void cycle_stats_count_adv(uint16_t events);
+void cycle_stats_count_error(enum cycle_error source);
+void cycle_stats_finish(struct cycle_stats *stats);
+void cycle_stats_restart(void);
+uint32_t cycle_stats_wake_charge_est_uc(void);
+size_t cycle_stats_encode_summary(uint8_t *buf);
+
+#endif // CYCLE_STATS_H
@@ -10,116 +10,375 @@
 #include <zephyr/pm/device.h>
 #include <zephyr/pm/policy.h>
 
+#if defined(CONFIG_APP_OTA)
+#include <zephyr/dfu/mcuboot.h>
+#include <zephyr/drivers/hwinfo.h>
+#endif
+
 #include "bme280.h"
 #include "battery_monitor.h"
 #include "rv3028.h"
 #include "adaptive_scheduler.h"
 #include "ble_advertiser.h"
+#include "retained_state.h"
+#include "cycle_stats.h"
+#include "node_config.h"
+
+#if defined(CONFIG_APP_SIM)
+#include "sim/sim.h"
+#endif
 
 LOG_MODULE_REGISTER(main, LOG_LEVEL_INF);
 
-// Power management callback
-static void pm_state_set(enum pm_state state, uint8_t substate_id)
+// Power state transitions are only traced in builds with logging; the
+// notifier is not registered when the log is compiled out
+static void pm_state_entry(enum pm_state state)
 {
-    ARG_UNUSED(substate_id);
-    LOG_INF("Entering power state %d", state);
+    LOG_DBG("Entering power state %d", state);
 }
 
-static void pm_state_exit_post_ops(enum pm_state state, uint8_t substate_id)
+static void pm_state_exit(enum pm_state state)
 {
-    ARG_UNUSED(state);
-    ARG_UNUSED(substate_id);
-    LOG_INF("Exiting power state");
+    LOG_DBG("Exiting power state %d", state);
 }
 
-// Power management callbacks
-PM_STATE_SET_AND_EXIT_POST_OPS(pm_state_set, pm_state_exit_post_ops);
+static struct pm_notifier pm_trace = {
+    .state_entry = pm_state_entry,
+    .state_exit = pm_state_exit,
+};
+
+// Count a failure in the retained error counters, then log it. Production
+// builds compile the log out, so the counters are all that remains.
+#define REPORT_ERR(source, ...)                 \
+    do {                                        \
+        cycle_stats_count_error(source);        \
+        LOG_ERR(__VA_ARGS__);                   \
+    } while (0)
+
+// Snapshot driver and scheduler state into retained RAM before SYSTEM OFF
+static void save_retained_state(void)
+{
+    for (size_t i = 0; i < BME280_COUNT; i++) {
+        bme280_get_calibration(bme280_devices[i], &retained.bme280_calib[i]);
+    }
+    rv3028_get_config(&retained.rv3028_config);
+    retained.power_tier = (uint8_t)adaptive_scheduler_get_current_tier();
+    retained.epoch_s = adaptive_scheduler_get_epoch();
+    retained.config = *node_config_get();
+    cycle_stats_finish(&retained.stats);
+    retained_state_update();
+    retained_state_retain();
+}
 
 // Main application thread
 static void main_thread(void)
 {
     int ret;
-    struct bme280_data sensor_data;
+    struct bme280_data_fixed sensor_data[BME280_COUNT];
+    bool sensor_ready[BME280_COUNT];
+    struct sample_record record;
     uint16_t battery_mv;
     power_tier_t current_tier;
-    uint32_t next_wake_interval;
+    struct wake_plan plan;
 
     LOG_INF("Temperature Sensor Node Starting...");
 
-    // Initialize subsystems
-    ret = bme280_init();
-    if (ret != 0) {
-        LOG_ERR("Failed to initialize BME280: %d", ret);
-        return;
+    if (IS_ENABLED(CONFIG_LOG)) {
+        pm_notifier_register(&pm_trace);
     }
 
-    ret = battery_monitor_init();
-    if (ret != 0) {
-        LOG_ERR("Failed to initialize battery monitor: %d", ret);
-        return;
+    // A valid snapshot means this is a wake from SYSTEM OFF
+    bool warm = retained_state_init();
+
+    cycle_stats_init(warm ? &retained.stats : NULL);
+
+    // Runtime configuration: from retained RAM, or from flash after a cold
+    // boot. The scheduler reads it from the first plan on.
+    node_config_init(warm ? &retained.config : NULL);
+
+    // Profile on the sensors, or NULL when the last write did not complete;
+    // resuming with NULL makes the first bme280_set_profile() write it
+    const struct bme280_profile *profile = (retained.profile_tier <= POWER_TIER_SURVIVAL) ?
+        adaptive_scheduler_get_profile((power_tier_t)retained.profile_tier) : NULL;
+
+    // Initialize subsystems. Only the primary sensor is required; a
+    // secondary one that fails is reported and skipped for this wake. A
+    // sensor without retained calibration (it failed before) is probed
+    // again from scratch.
+    for (size_t i = 0; i < BME280_COUNT; i++) {
+        ret = -ENODATA;
+        if (warm) {
+            ret = bme280_resume(bme280_devices[i], &retained.bme280_calib[i], profile);
+        }
+        if (ret == -ENODATA) {
+            ret = bme280_init(bme280_devices[i]);
+        }
+        sensor_ready[i] = (ret == 0);
+        if (ret != 0) {
+            REPORT_ERR(CYCLE_ERR_BME280, "Failed to initialize %s: %d",
+                       bme280_devices[i]->name, ret);
+            if (i == 0) {
+                return;
+            }
+        }
     }
 
-    ret = adaptive_scheduler_init();
+    ret = battery_monitor_init();
     if (ret != 0) {
-        LOG_ERR("Failed to initialize adaptive scheduler: %d", ret);
+        REPORT_ERR(CYCLE_ERR_BATTERY, "Failed to initialize battery monitor: %d", ret);
         return;
     }
 
-    ret = ble_advertiser_init();
+    if (warm) {
+        ret = adaptive_scheduler_resume((power_tier_t)retained.power_tier,
+                                        retained.epoch_s, &retained.rv3028_config);
+    } else {
+        ret = adaptive_scheduler_init();
+    }
     if (ret != 0) {
-        LOG_ERR("Failed to initialize BLE advertiser: %d", ret);
+        REPORT_ERR(CYCLE_ERR_RTC, "Failed to initialize adaptive scheduler: %d", ret);
         return;
     }
 
     LOG_INF("All subsystems initialized successfully");
+    cycle_stats_end(CYCLE_PHASE_INIT);
+
+#if defined(CONFIG_APP_OTA)
+    // MCUboot swaps an update in on the boot after its upload: the reset
+    // the gateway sends, or else the wake after the window. Only those boots
+    // read the image state from flash; plain wakes from SYSTEM OFF skip it.
+    // Reset reasons add up until cleared.
+    uint32_t reset_cause = 0;
+
+    (void)hwinfo_get_reset_cause(&reset_cause);
+    (void)hwinfo_clear_reset_cause();
+    if (!warm || reset_cause != RESET_LOW_POWER_WAKE || retained.image_check) {
+        retained.image_check = false;
+        cycle_stats_begin(CYCLE_PHASE_IMAGE);
+
+        // A new image runs once on test. It is kept only if it also brings
+        // the controller up, which the next update needs; otherwise the
+        // reset out of the coming SYSTEM OFF lets MCUboot swap the old
+        // image back.
+        if (!boot_is_img_confirmed()) {
+            ret = ble_advertiser_init();
+            if (ret == 0) {
+                ret = ble_advertiser_wait_ready(K_MSEC(ADV_READY_TIMEOUT_MS));
+            }
+            if (ret == 0) {
+                ret = boot_write_img_confirmed();
+                LOG_INF("Image confirmed: %d", ret);
+            } else {
+                REPORT_ERR(CYCLE_ERR_BLE, "Image on test failed Bluetooth bring-up: %d", ret);
+            }
+        }
+        cycle_stats_end(CYCLE_PHASE_IMAGE);
+    }
+#endif
 
     while (1) {
-        // Read battery voltage and determine power tier
-        battery_mv = battery_monitor_read_voltage();
-        current_tier = adaptive_scheduler_get_tier(battery_mv);
-        next_wake_interval = adaptive_scheduler_get_interval(current_tier);
+        // A maintenance wake transmits whatever the deadbands say, so the
+        // window it opens afterwards is announced
+        bool maintenance = adaptive_scheduler_maintenance_due(
+            retained.maintenance_s, adaptive_scheduler_get_current_tier());
 
-        LOG_INF("Battery: %d mV, Tier: %d, Next wake: %lu ms", 
-                battery_mv, current_tier, next_wake_interval);
+        // When this cycle is bound to transmit, bring the controller up in
+        // the background while the sensors are read. Otherwise the radio
+        // stays off unless a reading moves past its deadband.
+        if (maintenance || (sample_ring_tx_due_next(&retained.samples) &&
+                            adaptive_scheduler_heartbeat_due(&retained.report))) {
+            ret = ble_advertiser_init();
+            if (ret != 0) {
+                REPORT_ERR(CYCLE_ERR_BLE, "Failed to initialize BLE advertiser: %d", ret);
+            }
+        }
 
-        // Read sensor data
-        ret = bme280_read_forced(&sensor_data);
-        if (ret == 0) {
-            LOG_INF("Sensor: T=%.2f°C, P=%.2f hPa, H=%.2f%%", 
-                    sensor_data.temperature, sensor_data.pressure, sensor_data.humidity);
-        } else {
-            LOG_ERR("Failed to read sensor: %d", ret);
-            // Use last known values or defaults
-            sensor_data.temperature = 0.0f;
-            sensor_data.pressure = 1013.25f;
-            sensor_data.humidity = 50.0f;
+        // Start the battery sample and the BME280 conversions together; all
+        // run in hardware while the controller finishes coming up. The
+        // profile follows the tier of the previous cycle, so a tier change
+        // takes effect on the next wake.
+        cycle_stats_begin(CYCLE_PHASE_ADC);
+        bool adc_started = battery_monitor_start_read() == 0;
+
+        // Every sensor is triggered before any is read, so their
+        // conversions run in parallel.
+        cycle_stats_begin(CYCLE_PHASE_BME280);
+        retained.profile_tier = (uint8_t)adaptive_scheduler_get_current_tier();
+        for (size_t i = 0; i < BME280_COUNT; i++) {
+            const struct device *dev = bme280_devices[i];
+
+            if (!sensor_ready[i]) {
+                continue;
+            }
+
+            ret = bme280_set_profile(dev, adaptive_scheduler_get_profile(
+                                     (power_tier_t)retained.profile_tier));
+            if (ret != 0) {
+                REPORT_ERR(CYCLE_ERR_BME280, "Failed to set %s profile: %d", dev->name, ret);
+                retained.profile_tier = RETAINED_PROFILE_UNKNOWN;
+            }
+
+            ret = bme280_start_forced(dev);
+            if (ret != 0) {
+                REPORT_ERR(CYCLE_ERR_BME280, "Failed to start %s: %d", dev->name, ret);
+            }
         }
 
-        // Start BLE advertising with sensor data
-        ret = ble_advertiser_start(&sensor_data, battery_mv, current_tier);
+        // Determine power tier once the battery sample lands. The sample is
+        // taken with the radio idle, and filtered so one noisy reading
+        // cannot push the scheduler into a worse tier.
+        battery_mv = adc_started ?
+                     battery_monitor_finish_read(K_MSEC(BATTERY_READ_TIMEOUT_MS)) : 0;
+        cycle_stats_end(CYCLE_PHASE_ADC);
+        if (battery_mv == 0) {
+            // The monitor logs the cause; the filter keeps the last value
+            cycle_stats_count_error(CYCLE_ERR_BATTERY);
+        }
+        battery_mv = battery_monitor_filter(&retained.battery, battery_mv);
+        current_tier = adaptive_scheduler_get_tier(battery_mv);
+        ret = adaptive_scheduler_update_runtime();
         if (ret != 0) {
-            LOG_ERR("Failed to start advertising: %d", ret);
+            REPORT_ERR(CYCLE_ERR_RTC, "Failed to read RTC runtime: %d", ret);
         }
+        adaptive_scheduler_plan(current_tier, battery_mv, &plan);
 
-        // Wait for advertising to complete
-        k_sleep(K_MSEC(ADV_DURATION_MS));
+        LOG_INF("Battery: %d mV, Tier: %d, Next wake: %u ms, Adv events: %u",
+                battery_mv, current_tier, plan.interval_ms, plan.adv_events);
 
-        // Stop advertising
-        ble_advertiser_stop();
+        // Collect the conversions; only the time each still needs is slept
+        for (size_t i = 0; i < BME280_COUNT; i++) {
+            const struct device *dev = bme280_devices[i];
+
+            ret = sensor_ready[i] ? bme280_fetch_forced_fixed(dev, &sensor_data[i]) : -ENODEV;
+            if (ret == 0) {
+                LOG_INF("%s: T=%d (0.01 C), P=%u Pa, H=%u (1/1024 %%RH)", dev->name,
+                        sensor_data[i].temperature, sensor_data[i].pressure,
+                        sensor_data[i].humidity);
+            } else {
+                if (sensor_ready[i]) {
+                    REPORT_ERR(CYCLE_ERR_BME280, "Failed to read %s: %d", dev->name, ret);
+                }
+                // Report every channel as not measured
+                sensor_data[i].channels = 0;
+            }
+        }
+        cycle_stats_end(CYCLE_PHASE_BME280);
+
+        // Queue the primary reading; it covers the time until the next wake
+        ble_advertiser_make_record(&sensor_data[0], plan.interval_ms, &record);
+        sample_ring_push(&retained.samples, &record);
+
+        // Advertise the batch for the planned event count once it is due and
+        // the newest reading is worth reporting
+        if (maintenance || (sample_ring_tx_due(&retained.samples) &&
+                            adaptive_scheduler_report_due(&retained.report, &record))) {
+            // Join the controller bring-up, starting it now if it was deferred
+            cycle_stats_begin(CYCLE_PHASE_BLE_START);
+            ret = ble_advertiser_init();
+            if (ret == 0) {
+                ret = ble_advertiser_wait_ready(K_MSEC(ADV_READY_TIMEOUT_MS));
+            }
+            if (ret == 0) {
+                ret = ble_advertiser_start(&retained.samples, battery_mv,
+                                           current_tier, plan.adv_events, maintenance);
+            }
+            cycle_stats_end(CYCLE_PHASE_BLE_START);
+            if (ret != 0) {
+                REPORT_ERR(CYCLE_ERR_BLE, "Failed to start advertising: %d", ret);
+            } else {
+                sample_ring_mark_sent(&retained.samples);
+                adaptive_scheduler_report_sent(&retained.report, &record);
+                cycle_stats_begin(CYCLE_PHASE_ADV);
+                ret = ble_advertiser_wait_complete(
+                    K_MSEC(node_config_get()->adv_duration_ms + 1000));
+                cycle_stats_end(CYCLE_PHASE_ADV);
+                if (ret != 0) {
+                    // Controller never reported completion, stop the set ourselves
+                    ble_advertiser_stop();
+                } else if (IS_ENABLED(CONFIG_APP_BATTERY_LOAD_SAMPLE)) {
+                    // Catch the cell before it recovers from the burst
+                    battery_monitor_record_load(&retained.battery,
+                                                battery_monitor_read_voltage());
+                }
+
+#if defined(CONFIG_APP_MAINTENANCE)
+                // The window is counted as held even if nobody connects, so
+                // an absent gateway costs one window per interval
+                if (maintenance) {
+                    retained.maintenance_s = adaptive_scheduler_get_runtime();
+#if defined(CONFIG_APP_OTA)
+                    // The window may leave an update for the next boot
+                    retained.image_check = true;
+#endif
+                    cycle_stats_begin(CYCLE_PHASE_WINDOW);
+                    ret = ble_advertiser_open_window(
+                        CONFIG_APP_MAINTENANCE_WINDOW_S * MSEC_PER_SEC,
+                        CONFIG_APP_MAINTENANCE_SESSION_S * MSEC_PER_SEC);
+                    cycle_stats_end(CYCLE_PHASE_WINDOW);
+                    if (ret != 0) {
+                        REPORT_ERR(CYCLE_ERR_BLE, "Maintenance window failed: %d", ret);
+                    }
+                }
+#endif
+
+#if defined(CONFIG_APP_REMOTE_CONFIG_SCAN_TRIGGER)
+                // A scan request during the burst asks for a short window in
+                // which the gateway can read and write the configuration
+                if (!maintenance && ble_advertiser_scan_requested() &&
+                    adaptive_scheduler_config_window_due(retained.config_window_s,
+                                                         current_tier)) {
+                    retained.config_window_s = adaptive_scheduler_get_runtime();
+                    cycle_stats_begin(CYCLE_PHASE_WINDOW);
+                    ret = ble_advertiser_open_window(CONFIG_APP_REMOTE_CONFIG_WINDOW_MS,
+                                                     NODE_CONFIG_SESSION_MS);
+                    cycle_stats_end(CYCLE_PHASE_WINDOW);
+                    if (ret != 0) {
+                        REPORT_ERR(CYCLE_ERR_BLE, "Configuration window failed: %d", ret);
+                    }
+                }
+#endif
+            }
+        } else {
+            LOG_DBG("Reading within deadband, radio stays off");
+        }
 
         // Set RTC alarm for next wake
-        ret = adaptive_scheduler_set_next_wake(next_wake_interval);
+        cycle_stats_begin(CYCLE_PHASE_RTC);
+        ret = adaptive_scheduler_set_next_wake(plan.interval_ms);
+        cycle_stats_end(CYCLE_PHASE_RTC);
         if (ret != 0) {
-            LOG_ERR("Failed to set RTC alarm: %d", ret);
+            REPORT_ERR(CYCLE_ERR_RTC, "Failed to set RTC alarm: %d", ret);
+        }
+
+        LOG_INF("Entering deep sleep for %u ms", plan.interval_ms);
+
+        // Park the sensors; the TWIM and SAADC are already suspended
+        for (size_t i = 0; i < BME280_COUNT; i++) {
+            if (!sensor_ready[i]) {
+                continue;
+            }
+            ret = bme280_sleep(bme280_devices[i]);
+            if (ret != 0) {
+                REPORT_ERR(CYCLE_ERR_BME280, "Failed to put %s to sleep: %d",
+                           bme280_devices[i]->name, ret);
+            }
         }
 
-        LOG_INF("Entering deep sleep for %lu ms", next_wake_interval);
+        save_retained_state();
 
+#if defined(CONFIG_APP_SIM)
+        // Simulated SYSTEM OFF returns at the RTC wake with RAM intact; check
+        // the snapshot as a warm boot would and run the next cycle
+        sim_system_off(&retained);
+        (void)retained_state_init();
+        cycle_stats_restart();
+#else
         // Enter system OFF mode
-        pm_state_force(0u, PM_STATE_SOFT_OFF);
+        pm_state_force(0u, &(struct pm_state_info){PM_STATE_SOFT_OFF, 0, 0});
         
         // This should not be reached - system will wake from RTC
         k_sleep(K_MSEC(100));
+#endif
     }
 }
 
@@ -0,0 +1,225 @@
+#include "node_config.h"
+#include "adaptive_scheduler.h"
+#include "ble_advertiser.h"
+#include "rv3028.h"
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+#if defined(CONFIG_APP_REMOTE_CONFIG)
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/bluetooth/uuid.h>
+#include <zephyr/settings/settings.h>
+#endif
+
+LOG_MODULE_REGISTER(node_config, LOG_LEVEL_INF);
+
+BUILD_ASSERT(NODE_CONFIG_TIERS == POWER_TIER_SURVIVAL + 1,
+             "One table entry per power tier");
+
+// Settings key of the stored table
+#define NODE_CONFIG_KEY         "node/config"
+
+// Advertising interval range of the Core specification
+#define NODE_CONFIG_ADV_INTERVAL_MIN_MS  20
+#define NODE_CONFIG_ADV_INTERVAL_MAX_MS  10240
+
+static const struct node_config defaults = {
+    .version = NODE_CONFIG_VERSION,
+    .wake_interval_ms = {
+        WAKE_INTERVAL_NORMAL, WAKE_INTERVAL_CONSERVE,
+        WAKE_INTERVAL_RESERVE, WAKE_INTERVAL_SURVIVAL,
+    },
+    .adv_events = {
+        ADV_EVENTS_NORMAL, ADV_EVENTS_CONSERVE, ADV_EVENTS_RESERVE, ADV_EVENTS_SURVIVAL,
+    },
+    .battery_high_mv = {
+        BATTERY_THRESHOLD_NORMAL_HIGH, BATTERY_THRESHOLD_CONSERVE_HIGH,
+        BATTERY_THRESHOLD_RESERVE_HIGH,
+    },
+    .battery_low_mv = {
+        BATTERY_THRESHOLD_NORMAL_LOW, BATTERY_THRESHOLD_CONSERVE_LOW,
+        BATTERY_THRESHOLD_RESERVE_LOW,
+    },
+    .adv_interval_ms = {
+        ADV_INTERVAL_NORMAL, ADV_INTERVAL_CONSERVE, ADV_INTERVAL_RESERVE, ADV_INTERVAL_RESERVE,
+    },
+    .adv_duration_ms = ADV_DURATION_MS,
+};
+
+// Table in use; copied into retained RAM before SYSTEM OFF
+static struct node_config config;
+
+// A table is accepted only if the scheduler can run on it: intervals the
+// RTC can time, worse tiers never waking faster or sending more events,
+// and thresholds that keep their hysteresis
+int node_config_validate(const struct node_config *cfg)
+{
+    if (cfg->version != NODE_CONFIG_VERSION) {
+        return -EINVAL;
+    }
+
+    for (size_t i = 0; i < NODE_CONFIG_TIERS; i++) {
+        if (cfg->wake_interval_ms[i] < CONFIG_APP_WAKE_INTERVAL_MIN_S * 1000U ||
+            cfg->wake_interval_ms[i] > RV3028_TIMER_MAX_S * 1000U ||
+            cfg->adv_events[i] == 0 ||
+            cfg->adv_interval_ms[i] < NODE_CONFIG_ADV_INTERVAL_MIN_MS ||
+            cfg->adv_interval_ms[i] > NODE_CONFIG_ADV_INTERVAL_MAX_MS ||
+            cfg->adv_duration_ms < cfg->adv_interval_ms[i]) {
+            return -EINVAL;
+        }
+
+        if (i > 0 && (cfg->wake_interval_ms[i] < cfg->wake_interval_ms[i - 1] ||
+                      cfg->adv_events[i] > cfg->adv_events[i - 1])) {
+            return -EINVAL;
+        }
+    }
+
+    for (size_t i = 0; i < NODE_CONFIG_TIERS - 1; i++) {
+        if (cfg->battery_low_mv[i] >= cfg->battery_high_mv[i]) {
+            return -EINVAL;
+        }
+
+        if (i > 0 && (cfg->battery_high_mv[i] > cfg->battery_high_mv[i - 1] ||
+                      cfg->battery_low_mv[i] > cfg->battery_low_mv[i - 1])) {
+            return -EINVAL;
+        }
+    }
+
+    return 0;
+}
+
+#if defined(CONFIG_APP_REMOTE_CONFIG)
+// Stored table, read on cold boot. One that no longer validates, from
+// older firmware or with different limits, leaves the defaults in place.
+static int config_settings_set(const char *key, size_t len, settings_read_cb read_cb,
+                               void *cb_arg)
+{
+    struct node_config stored;
+    ssize_t ret;
+
+    if (strcmp(key, "config") != 0) {
+        return -ENOENT;
+    }
+
+    if (len != sizeof(stored)) {
+        LOG_WRN("Stored configuration has %zu bytes, ignored", len);
+        return 0;
+    }
+
+    ret = read_cb(cb_arg, &stored, sizeof(stored));
+    if (ret < 0) {
+        return (int)ret;
+    }
+
+    if (node_config_validate(&stored) != 0) {
+        LOG_WRN("Stored configuration invalid, using defaults");
+        return 0;
+    }
+
+    config = stored;
+    LOG_INF("Configuration loaded");
+    return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(node, "node", NULL, config_settings_set, NULL, NULL);
+
+static ssize_t table_read(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                          void *buf, uint16_t len, uint16_t offset)
+{
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, &config, sizeof(config));
+}
+
+// The whole table in one write; the default ATT MTU is raised in prj.conf
+// so that it fits
+static ssize_t table_write(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                           const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+    struct node_config update;
+    int ret;
+
+    ARG_UNUSED(conn);
+    ARG_UNUSED(attr);
+    ARG_UNUSED(flags);
+
+    if (offset != 0) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+    }
+    if (len != sizeof(update)) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+    }
+
+    memcpy(&update, buf, sizeof(update));
+    ret = node_config_set(&update);
+    if (ret == -EINVAL) {
+        return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+    } else if (ret != 0) {
+        return BT_GATT_ERR(BT_ATT_ERR_UNLIKELY);
+    }
+
+    return len;
+}
+
+// Reachable only while a connect window is open, and only over a link
+// paired with the deployment passkey
+BT_GATT_SERVICE_DEFINE(config_service,
+    BT_GATT_PRIMARY_SERVICE(BT_UUID_DECLARE_128(NODE_CONFIG_UUID_SERVICE)),
+    BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_128(NODE_CONFIG_UUID_TABLE),
+                           BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE,
+                           BT_GATT_PERM_READ_AUTHEN | BT_GATT_PERM_WRITE_AUTHEN,
+                           table_read, table_write, NULL),
+);
+#endif
+
+// Warm wake: continue with the table from retained RAM. Pass NULL on a
+// cold boot to start from the defaults and load the stored table.
+void node_config_init(const struct node_config *saved)
+{
+    if (saved != NULL && node_config_validate(saved) == 0) {
+        config = *saved;
+        return;
+    }
+
+    config = defaults;
+
+#if defined(CONFIG_APP_REMOTE_CONFIG)
+    int ret = settings_subsys_init();
+
+    if (ret == 0) {
+        ret = settings_load_subtree("node");
+    }
+    if (ret != 0) {
+        LOG_ERR("Failed to load stored configuration: %d", ret);
+    }
+#endif
+}
+
+const struct node_config *node_config_get(void)
+{
+    return &config;
+}
+
+// Store a new table and use it from the next plan on. Returns -EINVAL if
+// it does not validate, -ENOTSUP without settings storage.
+int node_config_set(const struct node_config *cfg)
+{
+    int ret = node_config_validate(cfg);
+
+    if (ret != 0) {
+        LOG_WRN("Configuration rejected");
+        return ret;
+    }
+
+#if defined(CONFIG_APP_REMOTE_CONFIG)
+    ret = settings_save_one(NODE_CONFIG_KEY, cfg, sizeof(*cfg));
+    if (ret != 0) {
+        LOG_ERR("Failed to store configuration: %d", ret);
+        return ret;
+    }
+
+    config = *cfg;
+    LOG_INF("Configuration updated");
+    return 0;
+#else
+    return -ENOTSUP;
+#endif
+}
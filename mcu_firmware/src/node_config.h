@@ -0,0 +1,41 @@
+#ifndef NODE_CONFIG_H
+#define NODE_CONFIG_H
+
+#include <zephyr/kernel.h>
+
+// Entries of the per-tier tables, one per power tier
+#define NODE_CONFIG_TIERS       4
+
+// Bump when the layout of struct node_config changes; stored and pushed
+// tables of another version are rejected
+#define NODE_CONFIG_VERSION     1
+
+// Gateway connection that only reads and writes the table
+#define NODE_CONFIG_SESSION_MS  10000
+
+// Configuration GATT service and its read/write table characteristic
+#define NODE_CONFIG_UUID_SERVICE \
+    BT_UUID_128_ENCODE(0x5e1f0000, 0x7a3c, 0x4b8e, 0x9a51, 0x6c2d8f3b1e40)
+#define NODE_CONFIG_UUID_TABLE \
+    BT_UUID_128_ENCODE(0x5e1f0001, 0x7a3c, 0x4b8e, 0x9a51, 0x6c2d8f3b1e40)
+
+// Scheduler and advertising parameters that can change at runtime. The
+// defaults are the compile-time constants of adaptive_scheduler.h and
+// ble_advertiser.h. The table goes over the air as is, little endian.
+struct node_config {
+    uint8_t version;                                   // NODE_CONFIG_VERSION
+    uint32_t wake_interval_ms[NODE_CONFIG_TIERS];      // Slowest wake rate per tier
+    uint8_t adv_events[NODE_CONFIG_TIERS];             // Fewest events per transmission
+    uint16_t battery_high_mv[NODE_CONFIG_TIERS - 1];   // Enter tier i from below
+    uint16_t battery_low_mv[NODE_CONFIG_TIERS - 1];    // Leave tier i downward
+    uint16_t adv_interval_ms[NODE_CONFIG_TIERS];       // Advertising interval per tier
+    uint16_t adv_duration_ms;                          // Backstop on one advertising set
+} __packed;
+
+// Function prototypes
+void node_config_init(const struct node_config *saved);
+const struct node_config *node_config_get(void);
+int node_config_validate(const struct node_config *config);
+int node_config_set(const struct node_config *config);
+
+#endif // NODE_CONFIG_H
@@ -0,0 +1,103 @@
+#include "retained_state.h"
+#include <zephyr/devicetree.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/crc.h>
+
+#if defined(CONFIG_SOC_NRF52840)
+#include <hal/nrf_power.h>
+#endif
+
+#if DT_NODE_EXISTS(DT_NODELABEL(retained_ram))
+#include <zephyr/linker/devicetree_regions.h>
+#endif
+
+LOG_MODULE_REGISTER(retained_state, LOG_LEVEL_INF);
+
+// Not zeroed at boot; survives SYSTEM OFF as long as its RAM section is
+// retained. On hardware it has a RAM block of its own (retained_ram in
+// the board overlay) that neither MCUboot nor the application's other
+// data can overwrite on the way back from a reset.
+#if DT_NODE_EXISTS(DT_NODELABEL(retained_ram))
+BUILD_ASSERT(sizeof(struct retained_state) <= DT_REG_SIZE(DT_NODELABEL(retained_ram)),
+             "Retained state does not fit its memory region");
+
+Z_GENERIC_SECTION(LINKER_DT_NODE_REGION_NAME(DT_NODELABEL(retained_ram)))
+struct retained_state retained;
+#else
+__noinit struct retained_state retained;
+#endif
+
+#define RETAINED_CRC_LEN offsetof(struct retained_state, crc)
+
+#if defined(CONFIG_SOC_NRF52840)
+// nRF52840 RAM layout: RAM0-RAM7 are 8 KB blocks with two 4 KB sections,
+// RAM8 is 256 KB with six 32 KB sections
+#define RAM_BASE            0x20000000UL
+#define RAM_SMALL_BLOCKS    8
+#define RAM_SMALL_BLOCK     0x2000UL
+#define RAM_SMALL_SECTION   0x1000UL
+#define RAM_LARGE_SECTION   0x8000UL
+
+BUILD_ASSERT(sizeof(struct retained_state) <= RAM_SMALL_SECTION,
+             "Retained state must not span more than two RAM sections");
+
+static void ram_section_retain(uintptr_t addr)
+{
+    uint32_t offset = addr - RAM_BASE;
+    uint8_t block;
+    uint8_t section;
+
+    if (offset < RAM_SMALL_BLOCKS * RAM_SMALL_BLOCK) {
+        block = offset / RAM_SMALL_BLOCK;
+        section = (offset % RAM_SMALL_BLOCK) / RAM_SMALL_SECTION;
+    } else {
+        block = RAM_SMALL_BLOCKS;
+        section = (offset - RAM_SMALL_BLOCKS * RAM_SMALL_BLOCK) / RAM_LARGE_SECTION;
+    }
+
+    nrf_power_rampower_mask_on(NRF_POWER, block,
+                               NRF_POWER_RAMPOWER_S0RETENTION_MASK << section);
+}
+#endif
+
+static uint32_t retained_state_crc(void)
+{
+    return crc32_ieee((const uint8_t *)&retained, RETAINED_CRC_LEN);
+}
+
+// Returns true when retained RAM holds a valid snapshot (warm wake)
+bool retained_state_init(void)
+{
+    if (retained.magic == RETAINED_STATE_MAGIC && retained.crc == retained_state_crc()) {
+        retained.wake_count++;
+        LOG_INF("Retained state valid (wake %u)", retained.wake_count);
+        return true;
+    }
+
+    LOG_INF("No retained state, cold boot");
+    retained_state_invalidate();
+    return false;
+}
+
+// Recompute the CRC after the snapshot fields have been filled in
+void retained_state_update(void)
+{
+    retained.magic = RETAINED_STATE_MAGIC;
+    retained.crc = retained_state_crc();
+}
+
+void retained_state_invalidate(void)
+{
+    memset(&retained, 0, sizeof(retained));
+}
+
+// Keep the RAM sections holding the snapshot powered through SYSTEM OFF
+void retained_state_retain(void)
+{
+#if defined(CONFIG_SOC_NRF52840)
+    uintptr_t start = (uintptr_t)&retained;
+
+    ram_section_retain(start);
+    ram_section_retain(start + sizeof(retained) - 1);
+#endif
+}
@@ -0,0 +1,48 @@
+#ifndef RETAINED_STATE_H
+#define RETAINED_STATE_H
+
+#include <zephyr/kernel.h>
+#include "battery_monitor.h"
+#include "bme280.h"
+#include "rv3028.h"
+#include "sample_ring.h"
+#include "adaptive_scheduler.h"
+#include "cycle_stats.h"
+#include "node_config.h"
+
+// Bump when the layout of struct retained_state changes so that stale
+// snapshots from older firmware are rejected
+#define RETAINED_STATE_MAGIC    0x52544E0D
+
+// profile_tier when a sensor may not hold the profile of any tier
+#define RETAINED_PROFILE_UNKNOWN UINT8_MAX
+
+// State kept in retained RAM across SYSTEM OFF
+struct retained_state {
+    uint32_t magic;
+    uint32_t wake_count;                     // Warm wakes since last cold boot
+    struct bme280_calib_data bme280_calib[BME280_COUNT];  // Per-sensor compensation coefficients
+    struct rv3028_config rv3028_config;      // RV-3028 control registers and timer
+    uint8_t power_tier;                      // Scheduler tier (keeps hysteresis)
+    uint8_t profile_tier;                    // Tier whose BME280 profile is on the sensors
+    uint32_t epoch_s;                        // RV-3028 UNIX counter at cold boot
+    struct battery_filter battery;           // Battery median/EWMA filter state
+    struct sample_ring samples;              // Recent readings for batched advertising
+    struct report_state report;              // Last transmitted reading (deadbands)
+    uint32_t maintenance_s;                  // Runtime of the last maintenance window
+    bool image_check;                        // Check the image state on the next boot
+    uint32_t config_window_s;                // Runtime of the last scan-triggered window
+    struct node_config config;               // Runtime configuration in use
+    struct cycle_stats stats;                // Per-cycle timing and charge estimates
+    uint32_t crc;                            // CRC32 over all fields above
+};
+
+extern struct retained_state retained;
+
+// Function prototypes
+bool retained_state_init(void);
+void retained_state_update(void);
+void retained_state_invalidate(void);
+void retained_state_retain(void);
+
+#endif // RETAINED_STATE_H
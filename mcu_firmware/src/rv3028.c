@@ -1,13 +1,21 @@
 #include "rv3028.h"
+#include "cycle_stats.h"
 #include <zephyr/device.h>
 #include <zephyr/drivers/i2c.h>
+#include <zephyr/pm/device_runtime.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
 
 LOG_MODULE_REGISTER(rv3028, LOG_LEVEL_INF);
 
 static const struct device *i2c_dev;
 
+// Shadow of CONTROL1, CONTROL2 and the timer value. The driver is the only
+// writer of these registers, so changes are computed against the shadow
+// instead of being read back over I2C first.
+static struct rv3028_config rtc_config;
+
 // Helper functions for BCD conversion
 static uint8_t bcd_to_bin(uint8_t bcd)
 {
@@ -22,27 +30,86 @@ static uint8_t bin_to_bcd(uint8_t bin)
 // I2C read/write helper functions
 static int rv3028_read_reg(uint8_t reg, uint8_t *data, size_t len)
 {
-    return i2c_write_read(i2c_dev, RV3028_I2C_ADDR, &reg, 1, data, len);
+    int ret = pm_device_runtime_get(i2c_dev);
+
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = cycle_stats_count_i2c(i2c_write_read(i2c_dev, RV3028_I2C_ADDR, &reg, 1, data, len));
+    (void)pm_device_runtime_put(i2c_dev);
+    return ret;
 }
 
-static int rv3028_write_reg(uint8_t reg, uint8_t data)
+// Write consecutive registers starting at reg in one I2C transaction
+static int rv3028_write_regs(uint8_t reg, const uint8_t *data, size_t len)
 {
-    uint8_t buf[2] = {reg, data};
-    return i2c_write(i2c_dev, buf, 2, RV3028_I2C_ADDR);
+    uint8_t buf[1 + RV3028_REG_CONTROL2 + 1];
+
+    if (len > sizeof(buf) - 1) {
+        return -EINVAL;
+    }
+
+    buf[0] = reg;
+    memcpy(&buf[1], data, len);
+
+    int ret = pm_device_runtime_get(i2c_dev);
+
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = cycle_stats_count_i2c(i2c_write(i2c_dev, buf, len + 1, RV3028_I2C_ADDR));
+    (void)pm_device_runtime_put(i2c_dev);
+    return ret;
 }
 
-static uint8_t rv3028_read_reg8(uint8_t reg)
+// Apply flag clears and control bit changes to STATUS, CONTROL1 and
+// CONTROL2 in a single burst write. Only the span of registers that
+// actually changes is written; untouched registers in between get their
+// shadow value, and untouched status flags get 1, which leaves them as is.
+int rv3028_update(const struct rv3028_update *update)
 {
-    uint8_t data;
-    if (rv3028_read_reg(reg, &data, 1) != 0) {
+    uint8_t regs[3];
+    uint8_t first = 3;
+    uint8_t last = 0;
+    int ret;
+
+    regs[0] = (uint8_t)~update->status_clear;
+    regs[1] = (rtc_config.control1 & ~update->ctrl1_clear) | update->ctrl1_set;
+    regs[2] = (rtc_config.control2 & ~update->ctrl2_clear) | update->ctrl2_set;
+
+    if (update->status_clear != 0) {
+        first = 0;
+        last = 0;
+    }
+    if (regs[1] != rtc_config.control1) {
+        first = MIN(first, 1);
+        last = 1;
+    }
+    if (regs[2] != rtc_config.control2) {
+        first = MIN(first, 2);
+        last = 2;
+    }
+    if (first > last) {
         return 0;
     }
-    return data;
+
+    ret = rv3028_write_regs(RV3028_REG_STATUS + first, &regs[first], last - first + 1);
+    if (ret != 0) {
+        LOG_ERR("Failed to update control registers: %d", ret);
+        return ret;
+    }
+
+    rtc_config.control1 = regs[1];
+    rtc_config.control2 = regs[2];
+    return 0;
 }
 
 int rv3028_init(void)
 {
-    uint8_t status, ctrl1, ctrl2;
+    uint8_t regs[3];
+    int ret;
     
     i2c_dev = DEVICE_DT_GET(DT_CHOSEN(zephyr,i2c));
     if (!device_is_ready(i2c_dev)) {
@@ -50,32 +117,62 @@ int rv3028_init(void)
         return -ENODEV;
     }
 
-    // Read status register
-    status = rv3028_read_reg8(RV3028_REG_STATUS);
-    LOG_INF("RV3028 status: 0x%02x", status);
-
-    // Check for voltage low flag
-    if (status & RV3028_STATUS_VLF) {
-        LOG_WRN("RV3028 voltage low flag set");
+    // Read status and control registers in one burst
+    ret = rv3028_read_reg(RV3028_REG_STATUS, regs, sizeof(regs));
+    if (ret != 0) {
+        LOG_ERR("Failed to read RV3028 registers: %d", ret);
+        return ret;
     }
+    LOG_INF("RV3028 status: 0x%02x, control1: 0x%02x, control2: 0x%02x",
+            regs[0], regs[1], regs[2]);
 
-    // Read control registers
-    ctrl1 = rv3028_read_reg8(RV3028_REG_CONTROL1);
-    ctrl2 = rv3028_read_reg8(RV3028_REG_CONTROL2);
-    LOG_INF("RV3028 control1: 0x%02x, control2: 0x%02x", ctrl1, ctrl2);
+    // Power-on reset: time-keeping restarted and the time is not valid
+    if (regs[0] & RV3028_STATUS_PORF) {
+        LOG_WRN("RV3028 power-on reset flag set");
+    }
 
-    // Configure for 24-hour mode and enable clock interrupt
-    ctrl1 |= RV3028_CTRL1_12_24 | RV3028_CTRL1_CLKINT;
-    rv3028_write_reg(RV3028_REG_CONTROL1, ctrl1);
+    // Stop any countdown timer left running (the scheduler arms it again),
+    // select 24-hour mode with no interrupts, and clear pending flags
+    regs[0] = 0x00;
+    regs[1] &= ~(RV3028_CTRL1_TE | RV3028_CTRL1_TRPT);
+    regs[2] &= ~(RV3028_CTRL2_12_24 | RV3028_CTRL2_UIE | RV3028_CTRL2_TIE |
+                 RV3028_CTRL2_AIE | RV3028_CTRL2_EIE);
+    ret = rv3028_write_regs(RV3028_REG_STATUS, regs, sizeof(regs));
+    if (ret != 0) {
+        LOG_ERR("Failed to configure RV3028: %d", ret);
+        return ret;
+    }
 
-    // Clear any pending flags
-    ctrl2 &= ~(RV3028_CTRL2_AF | RV3028_CTRL2_TF | RV3028_CTRL2_UF);
-    rv3028_write_reg(RV3028_REG_CONTROL2, ctrl2);
+    rtc_config.control1 = regs[1];
+    rtc_config.control2 = regs[2];
+    rtc_config.timer_value = 0;
 
     LOG_INF("RV3028 initialized successfully");
     return 0;
 }
 
+// Warm wake: the RTC runs from its own supply through SYSTEM OFF and keeps
+// its configuration, so skip the register reads and writes done by init
+int rv3028_resume(const struct rv3028_config *config)
+{
+    i2c_dev = DEVICE_DT_GET(DT_CHOSEN(zephyr,i2c));
+    if (!device_is_ready(i2c_dev)) {
+        LOG_ERR("I2C device not ready");
+        return -ENODEV;
+    }
+
+    rtc_config = *config;
+
+    LOG_DBG("RV3028 resumed (control1: 0x%02x, control2: 0x%02x)",
+            rtc_config.control1, rtc_config.control2);
+    return 0;
+}
+
+void rv3028_get_config(struct rv3028_config *config)
+{
+    *config = rtc_config;
+}
+
 int rv3028_get_time(struct rv3028_time *time)
 {
     uint8_t data[7];
@@ -98,11 +195,40 @@ int rv3028_get_time(struct rv3028_time *time)
     return 0;
 }
 
+// The UNIX counter ticks once a second on its own, independent of the
+// calendar. It is not latched while it is read, so a burst that straddles a
+// carry can be torn; the datasheet asks for two reads that agree.
+int rv3028_get_unix_time(uint32_t *seconds)
+{
+    uint8_t data[4];
+    uint32_t value, prev = 0;
+    int ret;
+
+    for (int i = 0; i < 3; i++) {
+        ret = rv3028_read_reg(RV3028_REG_UNIX_TIME0, data, sizeof(data));
+        if (ret != 0) {
+            LOG_ERR("Failed to read UNIX time: %d", ret);
+            return ret;
+        }
+
+        value = sys_get_le32(data);
+        if (i > 0 && value == prev) {
+            *seconds = value;
+            return 0;
+        }
+        prev = value;
+    }
+
+    return -EIO;
+}
+
 int rv3028_set_time(const struct rv3028_time *time)
 {
     uint8_t data[7];
     int ret;
 
+    // Writing the seconds register resets the prescaler, so the new time
+    // starts counting from a whole second
     data[0] = bin_to_bcd(time->seconds);
     data[1] = bin_to_bcd(time->minutes);
     data[2] = bin_to_bcd(time->hours);
@@ -111,22 +237,12 @@ int rv3028_set_time(const struct rv3028_time *time)
     data[5] = bin_to_bcd(time->month);
     data[6] = bin_to_bcd(time->year - 2000);
 
-    // Stop clock before writing
-    uint8_t ctrl2 = rv3028_read_reg8(RV3028_REG_CONTROL2);
-    ctrl2 |= RV3028_CTRL2_STOP;
-    rv3028_write_reg(RV3028_REG_CONTROL2, ctrl2);
-
-    // Write time data
-    ret = i2c_write(i2c_dev, data, 7, RV3028_I2C_ADDR);
+    ret = rv3028_write_regs(RV3028_REG_SECONDS, data, sizeof(data));
     if (ret != 0) {
         LOG_ERR("Failed to write time: %d", ret);
         return ret;
     }
 
-    // Start clock
-    ctrl2 &= ~RV3028_CTRL2_STOP;
-    rv3028_write_reg(RV3028_REG_CONTROL2, ctrl2);
-
     LOG_INF("Time set to: %04d-%02d-%02d %02d:%02d:%02d", 
             time->year, time->month, time->date, 
             time->hours, time->minutes, time->seconds);
@@ -134,82 +250,141 @@ int rv3028_set_time(const struct rv3028_time *time)
     return 0;
 }
 
+// Program the alarm, clear AF, select date matching and enable the alarm
+// interrupt in one burst from the alarm registers through CONTROL2. The
+// timer value registers in between are rewritten from the shadow and the
+// read-only timer status registers ignore the write.
 int rv3028_set_alarm(const struct rv3028_alarm *alarm)
 {
-    uint8_t data[5];
+    uint8_t data[RV3028_REG_CONTROL2 - RV3028_REG_ALARM_MIN + 1];
+    uint8_t ctrl1 = rtc_config.control1 | RV3028_CTRL1_WADA;
+    uint8_t ctrl2 = rtc_config.control2 | RV3028_CTRL2_AIE;
     int ret;
 
-    data[0] = bin_to_bcd(alarm->seconds);
-    data[1] = bin_to_bcd(alarm->minutes);
-    data[2] = bin_to_bcd(alarm->hours);
-    data[3] = alarm->weekday;
-    data[4] = bin_to_bcd(alarm->date);
-
-    ret = i2c_write(i2c_dev, data, 5, RV3028_I2C_ADDR);
+    // Match minutes, hours and date (AE bits cleared)
+    data[RV3028_REG_ALARM_MIN - RV3028_REG_ALARM_MIN] = bin_to_bcd(alarm->minutes);
+    data[RV3028_REG_ALARM_HOUR - RV3028_REG_ALARM_MIN] = bin_to_bcd(alarm->hours);
+    data[RV3028_REG_ALARM_DATE - RV3028_REG_ALARM_MIN] = bin_to_bcd(alarm->date);
+    data[RV3028_REG_TIMER_VAL0 - RV3028_REG_ALARM_MIN] = rtc_config.timer_value & 0xFF;
+    data[RV3028_REG_TIMER_VAL1 - RV3028_REG_ALARM_MIN] = (rtc_config.timer_value >> 8) & 0x0F;
+    data[RV3028_REG_TIMER_STAT0 - RV3028_REG_ALARM_MIN] = 0;
+    data[RV3028_REG_TIMER_STAT1 - RV3028_REG_ALARM_MIN] = 0;
+    data[RV3028_REG_STATUS - RV3028_REG_ALARM_MIN] = (uint8_t)~RV3028_STATUS_AF;
+    data[RV3028_REG_CONTROL1 - RV3028_REG_ALARM_MIN] = ctrl1;
+    data[RV3028_REG_CONTROL2 - RV3028_REG_ALARM_MIN] = ctrl2;
+
+    ret = rv3028_write_regs(RV3028_REG_ALARM_MIN, data, sizeof(data));
     if (ret != 0) {
         LOG_ERR("Failed to set alarm: %d", ret);
         return ret;
     }
 
-    LOG_INF("Alarm set to: %02d:%02d:%02d", 
-            alarm->hours, alarm->minutes, alarm->seconds);
+    rtc_config.control1 = ctrl1;
+    rtc_config.control2 = ctrl2;
+
+    LOG_INF("Alarm set to: date %02d %02d:%02d", 
+            alarm->date, alarm->hours, alarm->minutes);
 
     return 0;
 }
 
 int rv3028_clear_alarm(void)
 {
-    uint8_t ctrl2 = rv3028_read_reg8(RV3028_REG_CONTROL2);
-    ctrl2 &= ~RV3028_CTRL2_AF;
-    return rv3028_write_reg(RV3028_REG_CONTROL2, ctrl2);
+    return rv3028_update(&(struct rv3028_update){ .status_clear = RV3028_STATUS_AF });
 }
 
 int rv3028_enable_alarm_interrupt(void)
 {
-    uint8_t ctrl2 = rv3028_read_reg8(RV3028_REG_CONTROL2);
-    ctrl2 |= RV3028_CTRL2_AIE;
-    return rv3028_write_reg(RV3028_REG_CONTROL2, ctrl2);
+    return rv3028_update(&(struct rv3028_update){ .ctrl2_set = RV3028_CTRL2_AIE });
 }
 
 int rv3028_disable_alarm_interrupt(void)
 {
-    uint8_t ctrl2 = rv3028_read_reg8(RV3028_REG_CONTROL2);
-    ctrl2 &= ~RV3028_CTRL2_AIE;
-    return rv3028_write_reg(RV3028_REG_CONTROL2, ctrl2);
+    return rv3028_update(&(struct rv3028_update){ .ctrl2_clear = RV3028_CTRL2_AIE });
 }
 
-int rv3028_set_wakeup_time(uint32_t seconds_from_now)
+// Start the countdown timer in repeat mode. It reloads itself and pulses INT
+// low every period (released after tRTN, whether or not TF is cleared), so
+// the wake cycle needs no I2C traffic to re-arm. Does nothing if the timer already runs with this period.
+int rv3028_start_periodic_timer(uint32_t period_s)
 {
-    struct rv3028_time current_time;
-    struct rv3028_alarm alarm;
-    uint32_t target_seconds;
+    uint8_t data[RV3028_REG_CONTROL2 - RV3028_REG_TIMER_VAL0 + 1];
+    uint8_t ctrl1, ctrl2;
+    uint8_t td;
+    uint16_t value;
     int ret;
 
-    // Get current time
-    ret = rv3028_get_time(&current_time);
-    if (ret != 0) {
-        return ret;
+    if (period_s == 0 || period_s > RV3028_TIMER_MAX_S) {
+        return -EINVAL;
+    }
+
+    // 1 Hz ticks up to 4095 s, minute ticks beyond
+    if (period_s <= RV3028_TIMER_VALUE_MAX) {
+        td = RV3028_CTRL1_TD_1HZ;
+        value = period_s;
+    } else {
+        td = RV3028_CTRL1_TD_1_60HZ;
+        value = MIN(DIV_ROUND_CLOSEST(period_s, 60), RV3028_TIMER_VALUE_MAX);
     }
 
-    // Calculate target time
-    target_seconds = (current_time.hours * 3600) + 
-                    (current_time.minutes * 60) + 
-                    current_time.seconds + 
-                    seconds_from_now;
+    ctrl1 = (rtc_config.control1 & ~RV3028_CTRL1_TD_MASK) |
+            RV3028_CTRL1_TE | RV3028_CTRL1_TRPT | td;
+    ctrl2 = rtc_config.control2 | RV3028_CTRL2_TIE;
 
-    // Convert back to time components
-    alarm.hours = (target_seconds / 3600) % 24;
-    alarm.minutes = (target_seconds / 60) % 60;
-    alarm.seconds = target_seconds % 60;
-    alarm.weekday = current_time.weekday;
-    alarm.date = current_time.date;
+    if (ctrl1 == rtc_config.control1 && ctrl2 == rtc_config.control2 &&
+        value == rtc_config.timer_value) {
+        return 0;
+    }
+
+    // The timer value can only be changed while the timer is stopped
+    if (rtc_config.control1 & RV3028_CTRL1_TE) {
+        ret = rv3028_update(&(struct rv3028_update){ .ctrl1_clear = RV3028_CTRL1_TE });
+        if (ret != 0) {
+            return ret;
+        }
+    }
 
-    // Set alarm
-    ret = rv3028_set_alarm(&alarm);
+    // Timer value, clear TF, enable TIE and start the timer in one burst;
+    // the read-only timer status registers in between ignore the write
+    data[RV3028_REG_TIMER_VAL0 - RV3028_REG_TIMER_VAL0] = value & 0xFF;
+    data[RV3028_REG_TIMER_VAL1 - RV3028_REG_TIMER_VAL0] = (value >> 8) & 0x0F;
+    data[RV3028_REG_TIMER_STAT0 - RV3028_REG_TIMER_VAL0] = 0;
+    data[RV3028_REG_TIMER_STAT1 - RV3028_REG_TIMER_VAL0] = 0;
+    data[RV3028_REG_STATUS - RV3028_REG_TIMER_VAL0] = (uint8_t)~RV3028_STATUS_TF;
+    data[RV3028_REG_CONTROL1 - RV3028_REG_TIMER_VAL0] = ctrl1;
+    data[RV3028_REG_CONTROL2 - RV3028_REG_TIMER_VAL0] = ctrl2;
+
+    ret = rv3028_write_regs(RV3028_REG_TIMER_VAL0, data, sizeof(data));
     if (ret != 0) {
+        LOG_ERR("Failed to start timer: %d", ret);
         return ret;
     }
 
-    // Enable alarm interrupt
-    return rv3028_enable_alarm_interrupt();
+    rtc_config.control1 = ctrl1;
+    rtc_config.control2 = ctrl2;
+    rtc_config.timer_value = value;
+
+    LOG_INF("Periodic timer started: %u %s", value,
+            td == RV3028_CTRL1_TD_1HZ ? "s" : "min");
+    return 0;
+}
+
+int rv3028_stop_timer(void)
+{
+    int ret = rv3028_update(&(struct rv3028_update){
+        .status_clear = RV3028_STATUS_TF,
+        .ctrl1_clear = RV3028_CTRL1_TE | RV3028_CTRL1_TRPT,
+        .ctrl2_clear = RV3028_CTRL2_TIE,
+    });
+
+    if (ret == 0) {
+        rtc_config.timer_value = 0;
+    }
+    return ret;
+}
+
+// Release INT after a timer period; one register write, no read
+int rv3028_clear_timer_flag(void)
+{
+    return rv3028_update(&(struct rv3028_update){ .status_clear = RV3028_STATUS_TF });
 }
@@ -14,50 +14,67 @@
 #define RV3028_REG_DATE         0x04
 #define RV3028_REG_MONTH        0x05
 #define RV3028_REG_YEAR         0x06
-#define RV3028_REG_ALARM_SEC    0x07
-#define RV3028_REG_ALARM_MIN    0x08
-#define RV3028_REG_ALARM_HOUR   0x09
-#define RV3028_REG_ALARM_WEEK   0x0A
-#define RV3028_REG_ALARM_DATE   0x0B
+#define RV3028_REG_ALARM_MIN    0x07
+#define RV3028_REG_ALARM_HOUR   0x08
+#define RV3028_REG_ALARM_DATE   0x09  // Weekday or date, selected by WADA
+#define RV3028_REG_TIMER_VAL0   0x0A  // Countdown timer value, bits 7:0
+#define RV3028_REG_TIMER_VAL1   0x0B  // Countdown timer value, bits 11:8
+#define RV3028_REG_TIMER_STAT0  0x0C
+#define RV3028_REG_TIMER_STAT1  0x0D
 #define RV3028_REG_STATUS       0x0E
 #define RV3028_REG_CONTROL1     0x0F
 #define RV3028_REG_CONTROL2     0x10
-#define RV3028_REG_CONTROL3     0x11
-#define RV3028_REG_TIMESTAMP0   0x1A
-#define RV3028_REG_TIMESTAMP1   0x1B
-#define RV3028_REG_TIMESTAMP2   0x1C
-#define RV3028_REG_TIMESTAMP3   0x1D
-#define RV3028_REG_TIMESTAMP4   0x1E
-#define RV3028_REG_TIMESTAMP5   0x1F
+#define RV3028_REG_GP_BITS      0x11
+#define RV3028_REG_CLOCK_INT    0x12
+#define RV3028_REG_EVENT_CTRL   0x13
+#define RV3028_REG_TS_COUNT     0x14
+#define RV3028_REG_TS_SECONDS   0x15
+#define RV3028_REG_TS_MINUTES   0x16
+#define RV3028_REG_TS_HOURS     0x17
+#define RV3028_REG_TS_DATE      0x18
+#define RV3028_REG_TS_MONTH     0x19
+#define RV3028_REG_TS_YEAR      0x1A
+#define RV3028_REG_UNIX_TIME0   0x1B  // 32-bit seconds counter, LSB first
 
-// Control register bits
-#define RV3028_CTRL1_EERD       0x80  // EEPROM read enable
-#define RV3028_CTRL1_WADA       0x40  // Week/date alarm
-#define RV3028_CTRL1_UTSM       0x20  // Update time stamp mode
-#define RV3028_CTRL1_12_24      0x10  // 12/24 hour mode
-#define RV3028_CTRL1_RESET      0x08  // Software reset
-#define RV3028_CTRL1_EERE       0x04  // EEPROM read enable
-#define RV3028_CTRL1_TD         0x02  // Temperature compensation disable
-#define RV3028_CTRL1_CLKINT     0x01  // Clock interrupt enable
+// Control 1 register bits
+#define RV3028_CTRL1_TRPT       0x80  // Timer repeat (auto-reload)
+#define RV3028_CTRL1_WADA       0x20  // Alarm on date (1) or weekday (0)
+#define RV3028_CTRL1_USEL       0x10  // Update interrupt every minute (1) or second (0)
+#define RV3028_CTRL1_EERD       0x08  // Disable automatic EEPROM refresh
+#define RV3028_CTRL1_TE         0x04  // Countdown timer enable
+#define RV3028_CTRL1_TD_MASK    0x03  // Countdown timer clock
+#define RV3028_CTRL1_TD_4096HZ  0x00
+#define RV3028_CTRL1_TD_64HZ    0x01
+#define RV3028_CTRL1_TD_1HZ     0x02
+#define RV3028_CTRL1_TD_1_60HZ  0x03
 
-#define RV3028_CTRL2_HF         0x80  // High frequency output
-#define RV3028_CTRL2_AF         0x40  // Alarm flag
-#define RV3028_CTRL2_TF         0x20  // Timer flag
-#define RV3028_CTRL2_UF         0x10  // Update flag
+// Control 2 register bits
+#define RV3028_CTRL2_TSE        0x80  // Time stamp enable
+#define RV3028_CTRL2_CLKIE      0x40  // Clock output on interrupt enable
+#define RV3028_CTRL2_UIE        0x20  // Update interrupt enable
+#define RV3028_CTRL2_TIE        0x10  // Timer interrupt enable
 #define RV3028_CTRL2_AIE        0x08  // Alarm interrupt enable
-#define RV3028_CTRL2_TIE        0x04  // Timer interrupt enable
-#define RV3028_CTRL2_UIE        0x02  // Update interrupt enable
-#define RV3028_CTRL2_STOP       0x01  // Stop clock
+#define RV3028_CTRL2_EIE        0x04  // Event interrupt enable
+#define RV3028_CTRL2_12_24      0x02  // 12-hour mode (1) or 24-hour mode (0)
+#define RV3028_CTRL2_RESET      0x01  // Reset the prescaler (time-keeping)
 
-// Status register bits
-#define RV3028_STATUS_VLF       0x80  // Voltage low flag
-#define RV3028_STATUS_AF        0x40  // Alarm flag
-#define RV3028_STATUS_TF        0x20  // Timer flag
+// Status register bits; flags are cleared by writing 0, writing 1 has no effect
+#define RV3028_STATUS_EEBUSY    0x80  // EEPROM busy
+#define RV3028_STATUS_CLKF      0x40  // Clock output interrupt flag
+#define RV3028_STATUS_BSF       0x20  // Backup switch flag
 #define RV3028_STATUS_UF        0x10  // Update flag
-#define RV3028_STATUS_BSF       0x08  // Battery switch flag
-#define RV3028_STATUS_CLKF      0x04  // Clock fail flag
-#define RV3028_STATUS_EEBUSY    0x02  // EEPROM busy
-#define RV3028_STATUS_BUSY      0x01  // Busy
+#define RV3028_STATUS_TF        0x08  // Timer flag
+#define RV3028_STATUS_AF        0x04  // Alarm flag
+#define RV3028_STATUS_EVF       0x02  // Event flag
+#define RV3028_STATUS_PORF      0x01  // Power-on reset flag
+
+// Alarm registers: the enable bit is active low
+#define RV3028_ALARM_AE         0x80
+
+// Countdown timer: 12-bit value, periods up to 4095 s at 1 Hz and up to
+// 4095 min at 1/60 Hz
+#define RV3028_TIMER_VALUE_MAX  0x0FFF
+#define RV3028_TIMER_MAX_S      ((uint32_t)RV3028_TIMER_VALUE_MAX * 60)
 
 // Time structure
 struct rv3028_time {
@@ -70,23 +87,43 @@ struct rv3028_time {
     uint16_t year;
 };
 
-// Alarm structure
+// Alarm structure (the RV-3028 alarm has minute resolution)
 struct rv3028_alarm {
-    uint8_t seconds;
     uint8_t minutes;
     uint8_t hours;
-    uint8_t weekday;
     uint8_t date;
 };
 
+// Cached register configuration (restored on warm wake)
+struct rv3028_config {
+    uint8_t control1;
+    uint8_t control2;
+    uint16_t timer_value;      // Countdown timer reload value
+};
+
+// Bit changes applied together by rv3028_update()
+struct rv3028_update {
+    uint8_t status_clear;      // Status flags to clear
+    uint8_t ctrl1_set;
+    uint8_t ctrl1_clear;
+    uint8_t ctrl2_set;
+    uint8_t ctrl2_clear;
+};
+
 // Function prototypes
 int rv3028_init(void);
+int rv3028_resume(const struct rv3028_config *config);
+void rv3028_get_config(struct rv3028_config *config);
+int rv3028_update(const struct rv3028_update *update);
 int rv3028_get_time(struct rv3028_time *time);
 int rv3028_set_time(const struct rv3028_time *time);
+int rv3028_get_unix_time(uint32_t *seconds);
 int rv3028_set_alarm(const struct rv3028_alarm *alarm);
 int rv3028_clear_alarm(void);
 int rv3028_enable_alarm_interrupt(void);
 int rv3028_disable_alarm_interrupt(void);
-int rv3028_set_wakeup_time(uint32_t seconds_from_now);
+int rv3028_start_periodic_timer(uint32_t period_s);
+int rv3028_stop_timer(void);
+int rv3028_clear_timer_flag(void);
 
 #endif // RV3028_H
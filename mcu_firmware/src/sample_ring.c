@@ -0,0 +1,49 @@
+#include "sample_ring.h"
+
+BUILD_ASSERT(SAMPLE_RING_SIZE <= UINT8_MAX, "Ring indices are 8 bits");
+BUILD_ASSERT(CONFIG_APP_ADV_BATCH_SAMPLES <= SAMPLE_RING_SIZE,
+             "Cannot advertise more readings than the ring holds");
+BUILD_ASSERT(CONFIG_APP_ADV_EVERY_N_SAMPLES <= CONFIG_APP_ADV_BATCH_SAMPLES,
+             "Readings between transmissions would never be advertised");
+
+void sample_ring_push(struct sample_ring *ring, const struct sample_record *record)
+{
+    ring->records[ring->head] = *record;
+    ring->head = (ring->head + 1) % SAMPLE_RING_SIZE;
+    ring->seq++;
+
+    if (ring->count < SAMPLE_RING_SIZE) {
+        ring->count++;
+    }
+    if (ring->pending < UINT8_MAX) {
+        ring->pending++;
+    }
+}
+
+// Get a reading by age: 0 is the newest, count - 1 the oldest.
+// Returns NULL if the ring does not hold a reading that old.
+const struct sample_record *sample_ring_get(const struct sample_ring *ring, uint8_t age)
+{
+    if (age >= ring->count) {
+        return NULL;
+    }
+
+    return &ring->records[(ring->head + SAMPLE_RING_SIZE - 1 - age) % SAMPLE_RING_SIZE];
+}
+
+// True once enough readings have accumulated to be worth a radio wakeup
+bool sample_ring_tx_due(const struct sample_ring *ring)
+{
+    return ring->pending >= CONFIG_APP_ADV_EVERY_N_SAMPLES;
+}
+
+// True when the next push will make a transmission due
+bool sample_ring_tx_due_next(const struct sample_ring *ring)
+{
+    return ring->pending + 1 >= CONFIG_APP_ADV_EVERY_N_SAMPLES;
+}
+
+void sample_ring_mark_sent(struct sample_ring *ring)
+{
+    ring->pending = 0;
+}
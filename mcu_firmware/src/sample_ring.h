@@ -0,0 +1,37 @@
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+
+#include <zephyr/kernel.h>
+
+// Number of readings kept in retained RAM
+#define SAMPLE_RING_SIZE CONFIG_APP_SAMPLE_RING_SIZE
+
+// Record values for a channel that was not measured (skipped or failed)
+#define SAMPLE_VALUE_NOT_MEASURED 0xFFFF
+#define SAMPLE_TEMP_NOT_MEASURED  INT16_MIN
+
+// Compact reading, stored in the same units as the advertising payload
+struct sample_record {
+    int16_t temperature;       // Temperature * 100
+    uint16_t pressure;         // Pressure * 10 (hPa)
+    uint16_t humidity;         // Humidity * 100
+    uint16_t interval_s;       // Seconds from this reading to the next one
+};
+
+// Ring of the most recent readings, oldest overwritten first
+struct sample_ring {
+    uint8_t head;              // Slot the next reading is written to
+    uint8_t count;             // Valid readings in the ring
+    uint8_t pending;           // Readings taken since the last transmission
+    uint8_t seq;               // Sequence number of the newest reading
+    struct sample_record records[SAMPLE_RING_SIZE];
+};
+
+// Function prototypes
+void sample_ring_push(struct sample_ring *ring, const struct sample_record *record);
+const struct sample_record *sample_ring_get(const struct sample_ring *ring, uint8_t age);
+bool sample_ring_tx_due(const struct sample_ring *ring);
+bool sample_ring_tx_due_next(const struct sample_ring *ring);
+void sample_ring_mark_sent(struct sample_ring *ring);
+
+#endif // SAMPLE_RING_H
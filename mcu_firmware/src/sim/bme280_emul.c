@@ -0,0 +1,153 @@
+// BME280 register model on the emulated I2C bus (native_sim)
+
+#define DT_DRV_COMPAT bosch_bme280
+
+#include "bme280.h"
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/drivers/i2c_emul.h>
+#include <string.h>
+
+// Calibration and raw readings of the datasheet's worked example (section
+// 8.1): 25.08 C and 100653 Pa. The humidity word gives about 49 %RH.
+static const uint8_t calib_tp[BME280_CALIB_TP_LEN] = {
+    0x70, 0x6B,  // dig_T1 27504
+    0x43, 0x67,  // dig_T2 26435
+    0x18, 0xFC,  // dig_T3 -1000
+    0x7D, 0x8E,  // dig_P1 36477
+    0x43, 0xD6,  // dig_P2 -10685
+    0xD0, 0x0B,  // dig_P3 3024
+    0x27, 0x0B,  // dig_P4 2855
+    0x8C, 0x00,  // dig_P5 140
+    0xF9, 0xFF,  // dig_P6 -7
+    0x8C, 0x3C,  // dig_P7 15500
+    0xF8, 0xC6,  // dig_P8 -14600
+    0x70, 0x17,  // dig_P9 6000
+    0x00,        // Reserved 0xA0
+    0x4B,        // dig_H1 75
+};
+
+static const uint8_t calib_h[BME280_CALIB_H_LEN] = {
+    0x6A, 0x01,  // dig_H2 362
+    0x00,        // dig_H3 0
+    0x13, 0x29,  // dig_H4 313 (0x13 << 4 | 0x9), dig_H5 low nibble 0x2
+    0x03,        // dig_H5 50 (0x03 << 4 | 0x2)
+    0x1E,        // dig_H6 30
+};
+
+#define EMUL_ADC_T          519888
+#define EMUL_ADC_P          415148
+#define EMUL_ADC_H          29000
+
+// Daily temperature swing: a triangle wave of +-EMUL_ADC_T_SWING counts
+// (about +-1.5 C with this calibration) over one simulated day
+#define EMUL_ADC_T_SWING    4800
+#define EMUL_DAY_S          (24 * 3600)
+
+struct bme280_emul_data {
+    uint8_t regs[256];
+    uint8_t addr;          // Register pointer for reads
+};
+
+// Skipped channels read back as 0x80000 (pressure, temperature) or 0x8000
+static void bme280_emul_convert(struct bme280_emul_data *data)
+{
+    uint8_t ctrl_meas = data->regs[BME280_REG_CTRL_MEAS];
+    uint8_t osrs_t = (ctrl_meas & BME280_CTRL_MEAS_OSRS_T_MASK) >> 5;
+    uint8_t osrs_p = (ctrl_meas & BME280_CTRL_MEAS_OSRS_P_MASK) >> 2;
+    uint8_t osrs_h = data->regs[BME280_REG_CTRL_HUM] & BME280_CTRL_HUM_OSRS_H_MASK;
+    uint32_t phase = (uint32_t)(k_uptime_get() / 1000) % EMUL_DAY_S;
+    int32_t swing = (int32_t)(phase < EMUL_DAY_S / 2 ? phase : EMUL_DAY_S - phase) *
+                    (4 * EMUL_ADC_T_SWING) / EMUL_DAY_S - EMUL_ADC_T_SWING;
+    uint32_t adc_t = osrs_t ? EMUL_ADC_T + swing : 0x80000;
+    uint32_t adc_p = osrs_p ? EMUL_ADC_P : 0x80000;
+    uint32_t adc_h = osrs_h ? EMUL_ADC_H : 0x8000;
+
+    data->regs[BME280_REG_PRESS_MSB] = adc_p >> 12;
+    data->regs[BME280_REG_PRESS_LSB] = adc_p >> 4;
+    data->regs[BME280_REG_PRESS_XLSB] = (adc_p & 0x0F) << 4;
+    data->regs[BME280_REG_TEMP_MSB] = adc_t >> 12;
+    data->regs[BME280_REG_TEMP_LSB] = adc_t >> 4;
+    data->regs[BME280_REG_TEMP_XLSB] = (adc_t & 0x0F) << 4;
+    data->regs[BME280_REG_HUM_MSB] = adc_h >> 8;
+    data->regs[BME280_REG_HUM_LSB] = adc_h;
+
+    // The conversion is done by the time the driver looks: it sleeps the
+    // typical conversion time first, which is what advances the clock.
+    // Forced mode falls back to sleep once the conversion ends.
+    data->regs[BME280_REG_CTRL_MEAS] &= ~0x03;
+}
+
+static void bme280_emul_reset(struct bme280_emul_data *data)
+{
+    memset(data->regs, 0, sizeof(data->regs));
+    data->regs[BME280_REG_CHIP_ID] = BME280_CHIP_ID;
+    memcpy(&data->regs[BME280_REG_DIG_T1], calib_tp, sizeof(calib_tp));
+    memcpy(&data->regs[BME280_REG_DIG_H2], calib_h, sizeof(calib_h));
+    data->regs[BME280_REG_PRESS_MSB] = 0x80;
+    data->regs[BME280_REG_TEMP_MSB] = 0x80;
+    data->regs[BME280_REG_HUM_MSB] = 0x80;
+}
+
+// Writes are register/value pairs; a lone byte only sets the read pointer.
+// Reads auto-increment from the pointer.
+static int bme280_emul_transfer(const struct emul *target, struct i2c_msg *msgs,
+                                int num_msgs, int addr)
+{
+    struct bme280_emul_data *data = target->data;
+
+    ARG_UNUSED(addr);
+
+    for (int i = 0; i < num_msgs; i++) {
+        struct i2c_msg *msg = &msgs[i];
+
+        if (msg->flags & I2C_MSG_READ) {
+            for (uint32_t n = 0; n < msg->len; n++) {
+                msg->buf[n] = data->regs[(uint8_t)(data->addr + n)];
+            }
+            continue;
+        }
+
+        if (msg->len == 1) {
+            data->addr = msg->buf[0];
+            continue;
+        }
+        for (uint32_t n = 0; n + 1 < msg->len; n += 2) {
+            uint8_t reg = msg->buf[n];
+            uint8_t value = msg->buf[n + 1];
+
+            if (reg == BME280_REG_RESET) {
+                if (value == 0xB6) {
+                    bme280_emul_reset(data);
+                }
+                continue;
+            }
+            data->regs[reg] = value;
+            if (reg == BME280_REG_CTRL_MEAS && (value & 0x03) != BME280_CTRL_MEAS_MODE_SLEEP) {
+                bme280_emul_convert(data);
+            }
+        }
+    }
+
+    return 0;
+}
+
+static const struct i2c_emul_api bme280_emul_api = {
+    .transfer = bme280_emul_transfer,
+};
+
+static int bme280_emul_init(const struct emul *target, const struct device *parent)
+{
+    ARG_UNUSED(parent);
+
+    bme280_emul_reset(target->data);
+    return 0;
+}
+
+#define BME280_EMUL_DEFINE(n)                                                   \
+    static struct bme280_emul_data bme280_emul_data_##n;                        \
+    EMUL_DT_INST_DEFINE(n, bme280_emul_init, &bme280_emul_data_##n, NULL,       \
+                        &bme280_emul_api, NULL);
+
+DT_INST_FOREACH_STATUS_OKAY(BME280_EMUL_DEFINE)
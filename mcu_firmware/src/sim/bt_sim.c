@@ -0,0 +1,201 @@
+// Mocked Bluetooth advertising API for native_sim. Implements the part of
+// the host API ble_advertiser.c uses: bring-up completes after
+// SIM_BT_ENABLE_MS, and a started set reports its events as sent once
+// their air time has passed. Each event is charged to the power model from
+// its packet lengths, PHY and channel count.
+
+#include "sim.h"
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(bt_sim, LOG_LEVEL_INF);
+
+// Maximum advertising data of a legacy and an extended set
+#define BT_SIM_LEGACY_AD_MAX   31
+#define BT_SIM_EXT_AD_MAX      251
+
+#define BT_SIM_CHANNELS        3
+
+// PDU bytes around the advertising data: AdvA for a legacy PDU, the
+// extended header with AuxPtr (primary) or AdvA (auxiliary) otherwise
+#define BT_SIM_LEGACY_HDR      6
+#define BT_SIM_EXT_PRIMARY_HDR 7
+#define BT_SIM_EXT_AUX_HDR     10
+
+enum bt_sim_phy {
+    BT_SIM_PHY_1M,
+    BT_SIM_PHY_2M,
+    BT_SIM_PHY_CODED,
+};
+
+struct bt_le_ext_adv {
+    const struct bt_le_ext_adv_cb *cb;
+    struct k_work_delayable sent_work;
+    struct bt_le_ext_adv_sent_info info;
+    uint32_t options;
+    uint32_t interval;         // 0.625 ms units
+    size_t ad_len;
+    bool created;
+};
+
+static struct bt_le_ext_adv adv_set;
+static bt_ready_cb_t ready_cb;
+static bool enabled;
+static uint64_t radio_charge_nc;
+
+static void enable_done(struct k_work *work)
+{
+    ARG_UNUSED(work);
+
+    if (ready_cb != NULL) {
+        ready_cb(0);
+    }
+}
+
+static K_WORK_DELAYABLE_DEFINE(enable_work, enable_done);
+
+// On-air time of one packet carrying len PDU payload bytes: preamble,
+// access address, header and CRC around it; Coded PHY at S=8
+static uint32_t packet_us(size_t len, enum bt_sim_phy phy)
+{
+    switch (phy) {
+        case BT_SIM_PHY_2M:
+            return (2 + 4 + 2 + len + 3) * 4;
+        case BT_SIM_PHY_CODED:
+            return 80 + 256 + 16 + 24 + (2 + len + 3) * 64 + 24;
+        default:
+            return (1 + 4 + 2 + len + 3) * 8;
+    }
+}
+
+// Radio charge of one advertising event of the set
+static uint64_t event_charge_nc(const struct bt_le_ext_adv *adv)
+{
+    uint32_t air_us;
+
+    if (!(adv->options & BT_LE_ADV_OPT_EXT_ADV)) {
+        air_us = BT_SIM_CHANNELS *
+                 (SIM_RADIO_RAMP_US + packet_us(BT_SIM_LEGACY_HDR + adv->ad_len, BT_SIM_PHY_1M));
+    } else {
+        enum bt_sim_phy primary = (adv->options & BT_LE_ADV_OPT_CODED) ?
+                                  BT_SIM_PHY_CODED : BT_SIM_PHY_1M;
+        enum bt_sim_phy secondary = (adv->options & BT_LE_ADV_OPT_CODED) ? BT_SIM_PHY_CODED :
+                                    (adv->options & BT_LE_ADV_OPT_NO_2M) ? BT_SIM_PHY_1M :
+                                    BT_SIM_PHY_2M;
+
+        air_us = BT_SIM_CHANNELS *
+                 (SIM_RADIO_RAMP_US + packet_us(BT_SIM_EXT_PRIMARY_HDR, primary)) +
+                 SIM_RADIO_RAMP_US + packet_us(BT_SIM_EXT_AUX_HDR + adv->ad_len, secondary);
+    }
+
+    return (uint64_t)air_us * SIM_RADIO_TX_CURRENT_UA / 1000 + SIM_ADV_EVENT_OVERHEAD_NC;
+}
+
+static void sent_done(struct k_work *work)
+{
+    struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+    struct bt_le_ext_adv *adv = CONTAINER_OF(dwork, struct bt_le_ext_adv, sent_work);
+
+    radio_charge_nc += adv->info.num_sent * event_charge_nc(adv);
+    if (adv->cb != NULL && adv->cb->sent != NULL) {
+        adv->cb->sent(adv, &adv->info);
+    }
+}
+
+uint64_t bt_sim_take_charge_nc(void)
+{
+    uint64_t charge_nc = radio_charge_nc;
+
+    radio_charge_nc = 0;
+    return charge_nc;
+}
+
+int bt_enable(bt_ready_cb_t cb)
+{
+    if (enabled) {
+        return -EALREADY;
+    }
+
+    enabled = true;
+    ready_cb = cb;
+    k_work_schedule(&enable_work, K_MSEC(SIM_BT_ENABLE_MS));
+    return 0;
+}
+
+int bt_le_ext_adv_create(const struct bt_le_adv_param *param,
+                         const struct bt_le_ext_adv_cb *cb,
+                         struct bt_le_ext_adv **adv)
+{
+    if (!enabled) {
+        return -EAGAIN;
+    }
+    if (adv_set.created) {
+        return -ENOMEM;
+    }
+
+    adv_set.created = true;
+    adv_set.cb = cb;
+    adv_set.options = param->options;
+    adv_set.interval = param->interval_min;
+    k_work_init_delayable(&adv_set.sent_work, sent_done);
+
+    *adv = &adv_set;
+    return 0;
+}
+
+int bt_le_ext_adv_update_param(struct bt_le_ext_adv *adv, const struct bt_le_adv_param *param)
+{
+    adv->options = param->options;
+    adv->interval = param->interval_min;
+    return 0;
+}
+
+int bt_le_ext_adv_set_data(struct bt_le_ext_adv *adv,
+                           const struct bt_data *ad, size_t ad_len,
+                           const struct bt_data *sd, size_t sd_len)
+{
+    size_t max = (adv->options & BT_LE_ADV_OPT_EXT_ADV) ?
+                 BT_SIM_EXT_AD_MAX : BT_SIM_LEGACY_AD_MAX;
+    size_t len = 0;
+
+    ARG_UNUSED(sd);
+    ARG_UNUSED(sd_len);
+
+    for (size_t i = 0; i < ad_len; i++) {
+        len += 2 + ad[i].data_len;
+    }
+
+    // The controller rejects data that does not fit the PDU
+    if (len > max) {
+        LOG_ERR("Advertising data of %zu bytes exceeds %zu", len, max);
+        return -EINVAL;
+    }
+
+    adv->ad_len = len;
+    return 0;
+}
+
+int bt_le_ext_adv_start(struct bt_le_ext_adv *adv,
+                        const struct bt_le_ext_adv_start_param *param)
+{
+    k_timeout_t done;
+
+    // Events go out one interval apart; the last ends after its own air time
+    if (param->num_events > 0) {
+        adv->info.num_sent = param->num_events;
+        done = K_USEC((param->num_events - 1) * adv->interval * 625 + 10 * USEC_PER_MSEC);
+    } else {
+        adv->info.num_sent = MIN(param->timeout * 10 / MAX(adv->interval * 5 / 8, 1),
+                                 UINT8_MAX);
+        done = K_MSEC(param->timeout * 10);
+    }
+
+    k_work_schedule(&adv->sent_work, done);
+    return 0;
+}
+
+int bt_le_ext_adv_stop(struct bt_le_ext_adv *adv)
+{
+    k_work_cancel_delayable(&adv->sent_work);
+    return 0;
+}
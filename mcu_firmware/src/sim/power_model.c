@@ -0,0 +1,235 @@
+// Power and battery model of the simulated board. Each wake cycle is
+// charged from the firmware's own phase timings and counters, the sleep
+// from the modeled RTC wake time; the cell is coulomb counted and its
+// open-circuit voltage fed to the ADC emulator, so the scheduler sees the
+// battery run down as it would in the field.
+
+#include "sim.h"
+#include "battery_monitor.h"
+#include <zephyr/device.h>
+#include <zephyr/drivers/adc.h>
+#include <zephyr/drivers/adc/adc_emul.h>
+#include <zephyr/init.h>
+#include <zephyr/sys/printk.h>
+#include <posix_board_if.h>
+
+#define SIM_CAPACITY_NC     ((uint64_t)CONFIG_APP_BATTERY_CAPACITY_MAH * 3600 * 1000000)
+#define SIM_END_MS          ((int64_t)CONFIG_APP_SIM_DAYS * 24 * 3600 * 1000)
+#define SIM_REPORT_MS       ((int64_t)CONFIG_APP_SIM_REPORT_DAYS * 24 * 3600 * 1000)
+#define SIM_ADC_CHANNEL     0
+
+// Without a load switch the divider draws from the cell all the time
+#define SIM_DIVIDER_ALWAYS_ON \
+    !DT_NODE_HAS_PROP(DT_PATH(zephyr_user), vbat_divider_en_gpios)
+
+// Where the charge goes, summed over the run
+enum sim_bucket {
+    SIM_BUCKET_BOOT = 0,
+    SIM_BUCKET_AWAKE,
+    SIM_BUCKET_ADC,
+    SIM_BUCKET_BME280,
+    SIM_BUCKET_I2C,
+    SIM_BUCKET_BT_ENABLE,
+    SIM_BUCKET_RADIO,
+    SIM_BUCKET_SLEEP,
+    SIM_BUCKET_COUNT
+};
+
+static const char *const bucket_names[SIM_BUCKET_COUNT] = {
+    "boot", "awake", "adc", "bme280", "i2c", "bt enable", "radio", "sleep",
+};
+
+// Open-circuit voltage of a 1-cell LiPo at room temperature by state of
+// charge, highest first. Kept apart from the firmware's curve; the
+// firmware's estimate of the charge left is judged against this one.
+static const struct {
+    uint16_t mv;
+    uint8_t percent;
+} ocv_curve[] = {
+    { 4190, 100 },
+    { 4080, 90 },
+    { 4000, 80 },
+    { 3930, 70 },
+    { 3870, 60 },
+    { 3830, 50 },
+    { 3800, 40 },
+    { 3770, 30 },
+    { 3740, 20 },
+    { 3680, 10 },
+    { 3580, 5 },
+    { 3000, 0 },
+};
+
+static uint64_t used_nc;
+static uint64_t bucket_nc[SIM_BUCKET_COUNT];
+static uint32_t cycles;
+static uint32_t tier_cycles[POWER_TIER_SURVIVAL + 1];
+static int64_t next_report_ms = SIM_REPORT_MS;
+
+// State of charge in 0.01 % steps
+static uint32_t sim_soc(void)
+{
+    uint64_t start_nc = SIM_CAPACITY_NC * CONFIG_APP_SIM_START_PERCENT / 100;
+
+    if (used_nc >= start_nc) {
+        return 0;
+    }
+    return (uint32_t)((start_nc - used_nc) * 10000 / SIM_CAPACITY_NC);
+}
+
+static uint16_t sim_cell_mv(void)
+{
+    uint32_t soc = sim_soc();
+
+    for (size_t i = 1; i < ARRAY_SIZE(ocv_curve); i++) {
+        uint32_t lo = ocv_curve[i].percent * 100;
+        uint32_t hi = ocv_curve[i - 1].percent * 100;
+
+        if (soc >= lo) {
+            return ocv_curve[i].mv + (ocv_curve[i - 1].mv - ocv_curve[i].mv) *
+                   (MIN(soc, hi) - lo) / (hi - lo);
+        }
+    }
+
+    return ocv_curve[ARRAY_SIZE(ocv_curve) - 1].mv;
+}
+
+// ADC emulator input: the cell seen through the battery divider
+static int sim_vbat_sense(const struct device *dev, unsigned int chan, void *data,
+                          uint32_t *result)
+{
+    ARG_UNUSED(dev);
+    ARG_UNUSED(chan);
+    ARG_UNUSED(data);
+
+    *result = (uint32_t)sim_cell_mv() * BATTERY_DIVIDER_BOTTOM_KOHM /
+              (BATTERY_DIVIDER_TOP_KOHM + BATTERY_DIVIDER_BOTTOM_KOHM);
+    return 0;
+}
+
+static void charge(enum sim_bucket bucket, uint64_t nc)
+{
+    bucket_nc[bucket] += nc;
+    used_nc += nc;
+}
+
+// Charge in nC of a current in uA drawn for a time in us
+static uint64_t us_at_ua(uint32_t us, uint32_t ua)
+{
+    return (uint64_t)us * ua / 1000;
+}
+
+static void charge_cycle(const struct cycle_stats *stats)
+{
+    uint32_t adv_us = MIN(stats->phase_us[CYCLE_PHASE_ADV] + stats->phase_us[CYCLE_PHASE_WINDOW],
+                          stats->awake_us);
+
+    charge(SIM_BUCKET_BOOT, SIM_BOOT_CHARGE_NC);
+    charge(SIM_BUCKET_AWAKE, us_at_ua(stats->awake_us - adv_us, SIM_AWAKE_CURRENT_UA));
+    charge(SIM_BUCKET_ADC, us_at_ua(stats->phase_us[CYCLE_PHASE_ADC], SIM_ADC_CURRENT_UA));
+    charge(SIM_BUCKET_BME280, us_at_ua(stats->phase_us[CYCLE_PHASE_BME280],
+                                       SIM_BME280_CURRENT_UA * BME280_COUNT));
+    charge(SIM_BUCKET_I2C, (uint64_t)stats->i2c_transactions * SIM_I2C_TRANSFER_NC);
+
+    // Every wake that transmits brings the controller up from scratch
+    if (stats->phase_us[CYCLE_PHASE_BLE_START] > 0) {
+        charge(SIM_BUCKET_BT_ENABLE, SIM_BT_ENABLE_CHARGE_NC);
+    }
+    charge(SIM_BUCKET_RADIO, us_at_ua(adv_us, SIM_ADV_IDLE_CURRENT_UA) + bt_sim_take_charge_nc());
+}
+
+static void charge_sleep(int64_t sleep_ms)
+{
+    uint64_t na = SIM_SLEEP_SOC_NA + SIM_SLEEP_RTC_NA + SIM_SLEEP_BME280_NA * BME280_COUNT;
+
+    if (SIM_DIVIDER_ALWAYS_ON) {
+        na += (uint64_t)sim_cell_mv() * 1000 /
+              (BATTERY_DIVIDER_TOP_KOHM + BATTERY_DIVIDER_BOTTOM_KOHM);
+    }
+
+    // nA for ms gives pC
+    charge(SIM_BUCKET_SLEEP, na * (uint64_t)sleep_ms / 1000);
+}
+
+// Average current since the start in nA
+static uint64_t average_na(int64_t now_ms)
+{
+    return (now_ms > 0) ? used_nc * 1000 / (uint64_t)now_ms : 0;
+}
+
+static void report(int64_t now_ms)
+{
+    uint32_t soc = sim_soc();
+
+    printk("sim: day %u: %u.%02u %%, %u mV, avg %u nA, %u cycles\n",
+           (uint32_t)(now_ms / (24 * 3600 * 1000)), soc / 100, soc % 100,
+           sim_cell_mv(), (uint32_t)average_na(now_ms), cycles);
+}
+
+static void summary(int64_t now_ms)
+{
+    uint64_t avg_na = average_na(now_ms);
+
+    report(now_ms);
+    printk("sim: charge by use (mC):\n");
+    for (size_t i = 0; i < SIM_BUCKET_COUNT; i++) {
+        printk("sim:   %-10s %8u (%u.%u %%)\n", bucket_names[i],
+               (uint32_t)(bucket_nc[i] / 1000000),
+               (uint32_t)(bucket_nc[i] * 100 / MAX(used_nc, 1)),
+               (uint32_t)(bucket_nc[i] * 1000 / MAX(used_nc, 1) % 10));
+    }
+    printk("sim: cycles by tier: normal %u, conserve %u, reserve %u, survival %u\n",
+           tier_cycles[POWER_TIER_NORMAL], tier_cycles[POWER_TIER_CONSERVE],
+           tier_cycles[POWER_TIER_RESERVE], tier_cycles[POWER_TIER_SURVIVAL]);
+    if (avg_na > 0) {
+        // nC / nA gives seconds
+        printk("sim: predicted battery life %u days at this average\n",
+               (uint32_t)(SIM_CAPACITY_NC / avg_na / (24 * 3600)));
+    }
+}
+
+void sim_system_off(const struct retained_state *state)
+{
+    int64_t wake_ms = rv3028_emul_next_wake_ms();
+    int64_t now_ms = k_uptime_get();
+
+    cycles++;
+    tier_cycles[MIN(state->power_tier, POWER_TIER_SURVIVAL)]++;
+    charge_cycle(&state->stats);
+
+    // A node without a wake source would stay off for good
+    if (wake_ms < 0) {
+        printk("sim: RTC wake not armed, the node would never wake\n");
+        summary(now_ms);
+        posix_exit(1);
+    }
+
+    k_sleep(K_TIMEOUT_ABS_MS(wake_ms));
+    charge_sleep(k_uptime_get() - now_ms);
+    now_ms = k_uptime_get();
+
+    if (now_ms >= next_report_ms) {
+        report(now_ms);
+        next_report_ms += SIM_REPORT_MS;
+    }
+
+    if (now_ms >= SIM_END_MS || sim_soc() == 0) {
+        printk("sim: %s after %u days\n", sim_soc() == 0 ? "battery empty" : "done",
+               (uint32_t)(now_ms / (24 * 3600 * 1000)));
+        summary(now_ms);
+        posix_exit(0);
+    }
+}
+
+static int sim_power_init(void)
+{
+    const struct device *adc_dev = DEVICE_DT_GET(DT_CHOSEN(zephyr_adc));
+
+    if (!device_is_ready(adc_dev)) {
+        return -ENODEV;
+    }
+
+    return adc_emul_value_func_set(adc_dev, SIM_ADC_CHANNEL, sim_vbat_sense, NULL);
+}
+
+SYS_INIT(sim_power_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
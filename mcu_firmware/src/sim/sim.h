@@ -0,0 +1,52 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <zephyr/kernel.h>
+#include "retained_state.h"
+
+// Power model of the nRF52840 + BME280 + RV-3028 board for native_sim.
+// Datasheet typicals at 3 V through the DC/DC; replace them with power
+// analyser measurements where available. The model is kept apart from the
+// firmware's own estimates (APP_CYCLE_STATS_*_EST_UA, APP_ENERGY_*) so it
+// can judge them.
+
+// Awake: CPU and HFINT, charged for the awake time outside the advertising
+// window, plus the extra draw of each peripheral while its phase runs
+#define SIM_BOOT_CHARGE_NC          150000 // Wake from SYSTEM OFF to main()
+#define SIM_AWAKE_CURRENT_UA        1500
+#define SIM_ADC_CURRENT_UA          700    // SAADC, divider settling
+#define SIM_BME280_CURRENT_UA       350    // Forced conversion
+#define SIM_I2C_TRANSFER_NC         150    // TWIM resume, transfer, suspend
+#define SIM_BT_ENABLE_CHARGE_NC     100000 // Controller bring-up and HFXO start
+
+// Advertising: the CPU sleeps between events with the LFCLK running; each
+// event costs its air time at the TX current plus a fixed overhead for the
+// HFXO and radio ramp-up on each channel
+#define SIM_ADV_IDLE_CURRENT_UA     3
+#define SIM_RADIO_TX_CURRENT_UA     14800  // +8 dBm
+#define SIM_RADIO_RAMP_US           40     // Per packet
+#define SIM_ADV_EVENT_OVERHEAD_NC   1000
+
+// SYSTEM OFF: SoC with one retained RAM section, RTC and each BME280 in
+// sleep mode. The battery divider is charged from the cell voltage unless
+// the board switches it.
+#define SIM_SLEEP_SOC_NA            430
+#define SIM_SLEEP_RTC_NA            45
+#define SIM_SLEEP_BME280_NA         100
+
+// Simulated Bluetooth controller bring-up time
+#define SIM_BT_ENABLE_MS            15
+
+// Uptime in ms at which the RV-3028 model next pulls INT low, or -1 if no
+// timer wake is armed
+int64_t rv3028_emul_next_wake_ms(void);
+
+// Radio charge of the advertising events sent since the last call
+uint64_t bt_sim_take_charge_nc(void);
+
+// Stand-in for SYSTEM OFF: charge the cycle just finished and the sleep
+// to the power model, then return at the modeled RTC wake. Ends the
+// simulation once CONFIG_APP_SIM_DAYS have passed or the cell is empty.
+void sim_system_off(const struct retained_state *state);
+
+#endif // SIM_H
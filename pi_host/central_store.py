@@ -0,0 +1,177 @@
+#!/usr/bin/env python3
+"""
+Central Store for Multi-Gateway Deployments
+
+Gateways run sensor_scanner.py --forward HOST:PORT and send each reading
+they store as a JSON line. A node in range of several gateways is heard
+by all of them, so the store holds each reading for a short window,
+keeps the copy of the gateway with the best RSSI and writes it once into
+its own database, which has the scanner's layout (data_viewer.py and
+mqtt_bridge.py work on it unchanged).
+"""
+
+import asyncio
+import argparse
+import json
+import logging
+import time
+from collections import deque
+from dataclasses import dataclass, field
+from typing import Deque, Dict, List, Optional, Set, Tuple
+
+from sensor_scanner import SensorData, SensorDatabase, SensorIngest
+
+# Configure logging
+logging.basicConfig(
+    level=logging.INFO,
+    format='%(asctime)s - %(name)s - %(levelname)s - %(message)s'
+)
+logger = logging.getLogger(__name__)
+
+@dataclass
+class MergedSample:
+    """One reading of a node as reported by the gateways so far"""
+    readings: List[SensorData]      # Readings of the best gateway
+    first_seen: float               # time.monotonic() of the first report
+    gateways: Set[str] = field(default_factory=set)
+
+    @property
+    def rssi(self) -> int:
+        return self.readings[0].rssi_max if self.readings[0].rssi_max is not None \
+            else self.readings[0].rssi
+
+class CentralStore:
+    """Merges the readings forwarded by several gateways
+
+    Reports are keyed on the node address and the scanner's dedup key, which
+    is the sequence number for v2 payloads. A report arriving after its
+    reading was stored, or repeating batched history another gateway already
+    delivered, is dropped using the sequence numbers recently stored per node.
+    """
+
+    RECENT_SEQS = 64    # Stored sequence numbers remembered per node
+
+    def __init__(self, db_path: str, window: float = 10.0, queue_size: int = 1000,
+                 batch_size: int = 100, flush_interval: float = 1.0):
+        self.db = SensorDatabase(db_path)
+        self.ingest = SensorIngest(self.db, queue_size, batch_size, flush_interval)
+        self.window = window
+        self.pending: Dict[Tuple, MergedSample] = {}
+        self.recent_keys: Dict[str, Deque[Tuple]] = {}
+        self.recent_seqs: Dict[str, Deque[int]] = {}
+        self.reports = 0
+        self.duplicates = 0
+        self.stored = 0
+
+    def submit_report(self, gateway: str, key: Tuple, readings: List[SensorData]):
+        """Merge one gateway's report of a reading"""
+        self.reports += 1
+        if not readings:
+            return
+        address = readings[0].device_address
+        pending_key = (address, key)
+
+        if key in self.recent_keys.get(address, ()):
+            self.duplicates += 1
+            logger.debug(f"Late report of {key} for {address} from {gateway}")
+            return
+
+        merged = self.pending.get(pending_key)
+        if merged is None:
+            self.pending[pending_key] = MergedSample(readings, time.monotonic(), {gateway})
+            return
+
+        self.duplicates += 1
+        merged.gateways.add(gateway)
+        report = MergedSample(readings, merged.first_seen)
+        if report.rssi > merged.rssi:
+            # The better gateway's copy wins; history only the other gateway
+            # received is kept
+            seqs = {data.seq for data in readings if data.seq is not None}
+            extra = [data for data in merged.readings[1:]
+                     if data.seq is not None and data.seq not in seqs]
+            merged.readings = readings + extra
+
+    def _store(self, address: str, key: Tuple, merged: MergedSample):
+        recent_keys = self.recent_keys.setdefault(address, deque(maxlen=self.RECENT_SEQS))
+        recent_seqs = self.recent_seqs.setdefault(address, deque(maxlen=self.RECENT_SEQS))
+        recent_keys.append(key)
+        for data in merged.readings:
+            if data.seq is not None:
+                if data.seq in recent_seqs:
+                    continue
+                recent_seqs.append(data.seq)
+            self.ingest.submit(data)
+            self.stored += 1
+        if len(merged.gateways) > 1:
+            logger.debug(f"Reading {key} of {address} heard by {len(merged.gateways)} "
+                         f"gateways, kept {merged.readings[0].gateway}")
+
+    def flush_pending(self, older_than: Optional[float] = None):
+        """Store merged readings first reported older_than seconds ago, or all"""
+        now = time.monotonic()
+        for pending_key, merged in list(self.pending.items()):
+            if older_than is None or now - merged.first_seen >= older_than:
+                del self.pending[pending_key]
+                self._store(*pending_key, merged)
+
+    async def _flush_pending_loop(self):
+        while True:
+            await asyncio.sleep(1)
+            self.flush_pending(self.window)
+
+    async def handle_gateway(self, reader: asyncio.StreamReader, writer: asyncio.StreamWriter):
+        """Read JSON lines from one gateway connection"""
+        peer = writer.get_extra_info('peername')
+        logger.info(f"Gateway connected from {peer}")
+        try:
+            while True:
+                line = await reader.readline()
+                if not line:
+                    break
+                try:
+                    report = json.loads(line)
+                    readings = [SensorData.from_dict(data) for data in report['readings']]
+                    self.submit_report(report['gateway'], tuple(report['key']), readings)
+                except (ValueError, KeyError, TypeError) as e:
+                    logger.warning(f"Bad report from {peer}: {e}")
+        except ConnectionError as e:
+            logger.warning(f"Gateway {peer} disconnected: {e}")
+        finally:
+            writer.close()
+            logger.info(f"Gateway {peer} disconnected")
+
+    async def run(self, host: str, port: int):
+        """Accept gateway connections until cancelled"""
+        server = await asyncio.start_server(self.handle_gateway, host, port)
+        logger.info(f"Central store listening on {host}:{port}")
+        ingest_task = asyncio.create_task(self.ingest.run())
+        flush_task = asyncio.create_task(self._flush_pending_loop())
+        try:
+            async with server:
+                await server.serve_forever()
+        finally:
+            flush_task.cancel()
+            self.flush_pending()
+            ingest_task.cancel()
+            await asyncio.gather(flush_task, ingest_task, return_exceptions=True)
+            self.db.close()
+
+async def main():
+    parser = argparse.ArgumentParser(description='Central store for sensor gateways')
+    parser.add_argument('--listen', default='0.0.0.0:7878', metavar='HOST:PORT',
+                        help='Address gateways forward to')
+    parser.add_argument('--db', default='sensor_data.db', help='Database file path')
+    parser.add_argument('--window', type=float, default=10.0,
+                        help='Seconds to wait for other gateways before storing a reading')
+    parser.add_argument('--log-level', default='INFO', help='Logging level')
+
+    args = parser.parse_args()
+    logging.getLogger().setLevel(getattr(logging, args.log_level.upper()))
+
+    host, _, port = args.listen.rpartition(':')
+    store = CentralStore(args.db, args.window)
+    await store.run(host, int(port))
+
+if __name__ == "__main__":
+    asyncio.run(main())
@@ -6,36 +6,112 @@ Sensor Data Viewer - Query and display sensor data from the database
 import sqlite3
 import argparse
 import sys
+import time
 from datetime import datetime, timedelta
-from typing import List, Dict, Any
+from typing import List, Dict, Any, Optional, Tuple
+
+# Tables written by sensor_scanner.py, finest first: (table, time column,
+# seconds per row). Raw rows are counted at the 60 s shortest wake interval.
+RAW_TABLE = 'sensor_data'
+ROLLUP_TABLES = (('rollup_1m', 60), ('rollup_1h', 3600), ('rollup_1d', 86400))
+TABLES = ((RAW_TABLE, 'ts', 60),) + tuple((t, 'bucket', b) for t, b in ROLLUP_TABLES)
+
+def choose_table(conn: sqlite3.Connection, since: int, hours: int, limit: int) -> str:
+    """Pick the coarsest table the range needs
+    
+    That is the finest table whose rows still span the whole range within
+    the row limit. When no table reaches back far enough (a young database,
+    or raw rows pruned past the start), the finest one holding the earliest
+    data is used instead, so a fresh database is not answered from daily
+    rows. The daily rollup always counts, however coarse the step.
+    """
+    step_s = hours * 3600 / max(limit, 1)
+    best, best_end = None, None
+    for table, column, row_s in TABLES:
+        if row_s < step_s and table != TABLES[-1][0]:
+            continue
+        try:
+            oldest = conn.execute(f'SELECT MIN({column}) FROM {table}').fetchone()[0]
+        except sqlite3.OperationalError:
+            continue  # Database from before the rollups
+        if oldest is None:
+            continue
+        
+        # Rollup rows are keyed on the bucket start, so a bucket starting
+        # before the range may still hold only later data; a table reaches
+        # back far enough once its first row has ended
+        first_end = oldest if table == RAW_TABLE else oldest + row_s
+        if first_end <= since:
+            return table
+        if best is None or first_end < best_end:
+            best, best_end = table, first_end
+    
+    return best or RAW_TABLE
 
 def query_sensor_data(db_path: str, device_address: str = None, 
-                     hours: int = 24, limit: int = 100) -> List[Dict[str, Any]]:
-    """Query sensor data from the database"""
+                     hours: int = 24, limit: int = 100,
+                     table: str = 'auto') -> List[Dict[str, Any]]:
+    """Query sensor data from the database
+    
+    Rollup rows come back with the bucket mean in the reading fields and the
+    bucket aggregates alongside, so the statistics stay exact.
+    """
     with sqlite3.connect(db_path) as conn:
         cursor = conn.cursor()
+        since = int(time.time()) - hours * 3600
+        if table == 'auto':
+            table = choose_table(conn, since, hours, limit)
         
         # Build query
-        query = '''
-            SELECT device_address, device_name, timestamp, temperature, 
-                   pressure, humidity, battery_mv, power_tier, rssi
-            FROM sensor_data
-            WHERE timestamp >= datetime('now', '-{} hours')
-        '''.format(hours)
+        if table == RAW_TABLE:
+            query = '''
+                SELECT device_address, device_name, timestamp, temperature, 
+                       pressure, humidity, battery_mv, power_tier, rssi
+                FROM sensor_data
+                WHERE ts >= ?
+            '''
+            time_column = 'ts'
+        else:
+            query = f'''
+                SELECT device_address, NULL AS device_name,
+                       datetime(bucket, 'unixepoch', 'localtime') AS timestamp,
+                       temp_sum / NULLIF(temp_n, 0) AS temperature,
+                       press_sum / NULLIF(press_n, 0) AS pressure,
+                       hum_sum / NULLIF(hum_n, 0) AS humidity,
+                       CAST(ROUND(1.0 * batt_sum / n) AS INTEGER) AS battery_mv,
+                       tier_max AS power_tier,
+                       CAST(ROUND(1.0 * rssi_sum / n) AS INTEGER) AS rssi,
+                       n, temp_n, temp_sum, temp_min, temp_max,
+                       press_n, press_sum, press_min, press_max,
+                       hum_n, hum_sum, hum_min, hum_max,
+                       batt_sum, batt_min, batt_max
+                FROM {table}
+                WHERE bucket >= ?
+            '''
+            time_column = 'bucket'
         
-        params = []
+        params = [since - since % dict(ROLLUP_TABLES).get(table, 1)]
         if device_address:
             query += " AND device_address = ?"
             params.append(device_address)
             
-        query += " ORDER BY timestamp DESC LIMIT ?"
+        query += f" ORDER BY {time_column} DESC LIMIT ?"
         params.append(limit)
         
         cursor.execute(query, params)
         
         # Convert to list of dictionaries
         columns = [desc[0] for desc in cursor.description]
-        return [dict(zip(columns, row)) for row in cursor.fetchall()]
+        rows = [dict(zip(columns, row)) for row in cursor.fetchall()]
+        for row in rows:
+            row['source'] = table
+        return rows
+
+def format_value(value, spec: str, width: int) -> str:
+    """Format a reading; channels the node did not measure are stored as NULL"""
+    if value is None:
+        return f"{'n/a':<{width}}"
+    return format(value, spec)
 
 def print_sensor_data(data: List[Dict[str, Any]]):
     """Print sensor data in a formatted table"""
@@ -43,7 +119,7 @@ def print_sensor_data(data: List[Dict[str, Any]]):
         print("No data found")
         return
         
-    print(f"\nSensor Data ({len(data)} records):")
+    print(f"\nSensor Data ({len(data)} records from {data[0]['source']}):")
     print("-" * 120)
     print(f"{'Device':<18} {'Time':<20} {'Temp(°C)':<8} {'Press(hPa)':<10} {'Hum(%)':<7} {'Batt(mV)':<9} {'Tier':<4} {'RSSI':<5}")
     print("-" * 120)
@@ -52,13 +128,35 @@ def print_sensor_data(data: List[Dict[str, Any]]):
         timestamp = datetime.fromisoformat(record['timestamp'])
         print(f"{record['device_address']:<18} "
               f"{timestamp.strftime('%Y-%m-%d %H:%M:%S'):<20} "
-              f"{record['temperature']:<8.2f} "
-              f"{record['pressure']:<10.1f} "
-              f"{record['humidity']:<7.2f} "
+              f"{format_value(record['temperature'], '<8.2f', 8)} "
+              f"{format_value(record['pressure'], '<10.1f', 10)} "
+              f"{format_value(record['humidity'], '<7.2f', 7)} "
               f"{record['battery_mv']:<9} "
               f"{record['power_tier']:<4} "
               f"{record['rssi']:<5}")
 
+def channel_stats(data: List[Dict[str, Any]], field: str,
+                  prefix: str) -> Optional[Tuple[Any, Any, float]]:
+    """Min, max and mean of a channel over raw rows or rollup rows"""
+    count, total, lows, highs = 0, 0, [], []
+    for r in data:
+        if f'{prefix}_sum' in r:
+            n = r.get(f'{prefix}_n', r['n'])
+            if not n:
+                continue
+            count += n
+            total += r[f'{prefix}_sum']
+            lows.append(r[f'{prefix}_min'])
+            highs.append(r[f'{prefix}_max'])
+        elif r[field] is not None:
+            count += 1
+            total += r[field]
+            lows.append(r[field])
+            highs.append(r[field])
+    if not count:
+        return None
+    return min(lows), max(highs), total / count
+
 def print_statistics(data: List[Dict[str, Any]]):
     """Print statistical summary of the data"""
     if not data:
@@ -68,30 +166,31 @@ def print_statistics(data: List[Dict[str, Any]]):
     print("-" * 50)
     
     # Temperature stats
-    temps = [r['temperature'] for r in data if r['temperature'] is not None]
+    temps = channel_stats(data, 'temperature', 'temp')
     if temps:
-        print(f"Temperature: {min(temps):.2f}°C - {max(temps):.2f}°C (avg: {sum(temps)/len(temps):.2f}°C)")
+        print(f"Temperature: {temps[0]:.2f}°C - {temps[1]:.2f}°C (avg: {temps[2]:.2f}°C)")
     
     # Pressure stats
-    pressures = [r['pressure'] for r in data if r['pressure'] is not None]
+    pressures = channel_stats(data, 'pressure', 'press')
     if pressures:
-        print(f"Pressure: {min(pressures):.1f} - {max(pressures):.1f} hPa (avg: {sum(pressures)/len(pressures):.1f} hPa)")
+        print(f"Pressure: {pressures[0]:.1f} - {pressures[1]:.1f} hPa (avg: {pressures[2]:.1f} hPa)")
     
     # Humidity stats
-    humidities = [r['humidity'] for r in data if r['humidity'] is not None]
+    humidities = channel_stats(data, 'humidity', 'hum')
     if humidities:
-        print(f"Humidity: {min(humidities):.2f} - {max(humidities):.2f}% (avg: {sum(humidities)/len(humidities):.2f}%)")
+        print(f"Humidity: {humidities[0]:.2f} - {humidities[1]:.2f}% (avg: {humidities[2]:.2f}%)")
     
     # Battery stats
-    batteries = [r['battery_mv'] for r in data if r['battery_mv'] is not None]
+    batteries = channel_stats(data, 'battery_mv', 'batt')
     if batteries:
-        print(f"Battery: {min(batteries)} - {max(batteries)} mV (avg: {sum(batteries)/len(batteries):.0f} mV)")
+        print(f"Battery: {batteries[0]} - {batteries[1]} mV (avg: {batteries[2]:.0f} mV)")
     
-    # Power tier distribution
+    # Power tier distribution (rollups count their readings under the
+    # worst tier of the bucket)
     tiers = {}
     for r in data:
         tier = r['power_tier']
-        tiers[tier] = tiers.get(tier, 0) + 1
+        tiers[tier] = tiers.get(tier, 0) + r.get('n', 1)
     
     print(f"Power Tiers: {dict(tiers)}")
 
@@ -99,7 +198,8 @@ def list_devices(db_path: str) -> List[str]:
     """List all unique device addresses in the database"""
     with sqlite3.connect(db_path) as conn:
         cursor = conn.cursor()
-        cursor.execute("SELECT DISTINCT device_address FROM sensor_data ORDER BY device_address")
+        # One row per device, kept by the scanner
+        cursor.execute("SELECT device_address FROM latest ORDER BY device_address")
         return [row[0] for row in cursor.fetchall()]
 
 def main():
@@ -108,6 +208,9 @@ def main():
     parser.add_argument('--device', help='Filter by device address')
     parser.add_argument('--hours', type=int, default=24, help='Hours of data to show')
     parser.add_argument('--limit', type=int, default=100, help='Maximum number of records')
+    parser.add_argument('--table', default='auto',
+                        choices=['auto', RAW_TABLE] + [t for t, _ in ROLLUP_TABLES],
+                        help='Table to read; auto picks the coarsest one the range needs')
     parser.add_argument('--list-devices', action='store_true', help='List all devices')
     parser.add_argument('--stats', action='store_true', help='Show statistics')
     
@@ -122,7 +225,7 @@ def main():
             return
         
         # Query data
-        data = query_sensor_data(args.db, args.device, args.hours, args.limit)
+        data = query_sensor_data(args.db, args.device, args.hours, args.limit, args.table)
         
         # Display data
         print_sensor_data(data)
@@ -2,8 +2,12 @@
 """
 MQTT Bridge for Sensor Data
 
-Forwards sensor data from SQLite database to MQTT topics for integration
-with Home Assistant, Node-RED, or other IoT platforms.
+Forwards sensor data to MQTT topics for integration with Home Assistant,
+Node-RED, or other IoT platforms.
+
+Run inside the scanner (sensor_scanner.py --mqtt-host), the bridge is pushed
+each reading as it arrives. Run standalone, it polls the scanner's latest
+table instead.
 """
 
 import asyncio
@@ -36,22 +40,45 @@ class MQTTBridge:
         self.topic_prefix = topic_prefix
         self.publish_interval = publish_interval
         self.last_published = {}  # Track last published timestamp per device
+        self.discovered = set()   # Devices with Home Assistant discovery sent
+        
+        # Readings pushed by the scanner; None when polling the database
+        self.queue: Optional[asyncio.Queue] = None
+        self.dropped = 0
+    
+    def attach(self, queue_size: int = 256):
+        """Switch to push mode; returns the callback the scanner feeds"""
+        self.queue = asyncio.Queue(maxsize=queue_size)
+        return self.submit_sample
+    
+    def submit_sample(self, sample):
+        """Queue a reading (a sensor_scanner.SensorData) without blocking.
+        When the broker is unreachable the oldest queued reading gives way."""
+        data = {
+            'device_name': sample.device_name,
+            'timestamp': sample.timestamp.isoformat(),
+            'temperature': sample.temperature,
+            'pressure': sample.pressure,
+            'humidity': sample.humidity,
+            'battery_mv': sample.battery_mv,
+            'power_tier': sample.power_tier,
+            'rssi': sample.rssi
+        }
+        if self.queue.full():
+            self.queue.get_nowait()
+            self.dropped += 1
+        self.queue.put_nowait((sample.device_address, data))
         
     def get_latest_sensor_data(self) -> Dict[str, Any]:
         """Get latest sensor data for each device"""
         with sqlite3.connect(self.db_path) as conn:
             cursor = conn.cursor()
             
-            # Get latest data for each device
+            # The scanner keeps one row per device current at ingest
             cursor.execute('''
                 SELECT device_address, device_name, timestamp, temperature, 
                        pressure, humidity, battery_mv, power_tier, rssi
-                FROM sensor_data s1
-                WHERE timestamp = (
-                    SELECT MAX(timestamp) 
-                    FROM sensor_data s2 
-                    WHERE s2.device_address = s1.device_address
-                )
+                FROM latest
                 ORDER BY device_address
             ''')
             
@@ -248,6 +275,10 @@ class MQTTBridge:
                     devices = self.get_latest_sensor_data()
                     for device_address, data in devices.items():
                         await self.publish_discovery_info(client, device_address, data)
+                        self.discovered.add(device_address)
+                    
+                    if self.queue is not None:
+                        await self.run_push(client)
                     
                     # Main publishing loop
                     while True:
@@ -264,6 +295,22 @@ class MQTTBridge:
             except Exception as e:
                 logger.error(f"MQTT connection error: {e}")
                 await asyncio.sleep(30)  # Wait before reconnecting
+    
+    async def run_push(self, client: mqtt.Client):
+        """Publish readings as the scanner pushes them"""
+        # Catch up on readings stored while the bridge was down
+        for device_address, data in self.get_new_sensor_data().items():
+            await self.publish_device_data(client, device_address, data)
+        
+        while True:
+            device_address, data = await self.queue.get()
+            if device_address not in self.discovered:
+                await self.publish_discovery_info(client, device_address, data)
+                self.discovered.add(device_address)
+            
+            last_published = self.last_published.get(device_address)
+            if last_published is None or data['timestamp'] > last_published:
+                await self.publish_device_data(client, device_address, data)
 
 async def main():
     """Main entry point"""
@@ -11,15 +11,28 @@ import logging
 import sqlite3
 import argparse
 import time
-from datetime import datetime
-from typing import Optional, Dict, Any
-from dataclasses import dataclass
+import json
+import socket
+import zlib
+from concurrent.futures import ThreadPoolExecutor
+from datetime import datetime, timedelta
+from typing import Optional, Dict, Any, List, Tuple, Callable
+from dataclasses import dataclass, asdict
 import struct
 
-from bleak import BleakScanner
+from bleak import BleakClient, BleakScanner
+from bleak.exc import BleakError
 from bleak.backends.scanner import AdvertisementData
 from bleak.backends.device import BLEDevice
 
+try:
+    # BlueZ advertisement monitor patterns, needed for passive scanning
+    from bleak.assigned_numbers import AdvertisementDataType
+    from bleak.backends.bluezdbus.advertisement_monitor import OrPattern
+    from bleak.backends.bluezdbus.scanner import BlueZScannerArgs
+except ImportError:
+    OrPattern = None
+
 # Configure logging
 logging.basicConfig(
     level=logging.INFO,
@@ -27,18 +40,63 @@ logging.basicConfig(
 )
 logger = logging.getLogger(__name__)
 
+def format_reading(value: Optional[float], spec: str) -> str:
+    """Format a reading, showing channels the node did not measure as n/a"""
+    return 'n/a' if value is None else format(value, spec)
+
 @dataclass
 class SensorData:
     """Container for decoded sensor data"""
     device_address: str
     device_name: str
     timestamp: datetime
-    temperature: float
-    pressure: float
-    humidity: float
+    temperature: Optional[float]
+    pressure: Optional[float]
+    humidity: Optional[float]
     battery_mv: int
     power_tier: int
-    rssi: int
+    rssi: int                       # Mean RSSI over the copies received
+    seq: Optional[int] = None       # v2 payload sequence number
+    rssi_min: Optional[int] = None
+    rssi_max: Optional[int] = None
+    copies: int = 1                 # Advertisements that carried this reading
+    gateway: Optional[str] = None   # Gateway and adapter with the best RSSI
+    
+    def to_dict(self) -> Dict[str, Any]:
+        """JSON-ready form for forwarding between gateways"""
+        data = asdict(self)
+        data['timestamp'] = self.timestamp.isoformat()
+        return data
+    
+    @classmethod
+    def from_dict(cls, data: Dict[str, Any]) -> 'SensorData':
+        data = dict(data)
+        data['timestamp'] = datetime.fromisoformat(data['timestamp'])
+        return cls(**data)
+
+@dataclass
+class PendingSample:
+    """Newest reading of a node, held while its advertising window repeats it"""
+    key: Tuple
+    readings: List[SensorData]      # The reading, then its batched history
+    last_seen: float                # time.monotonic() of the latest copy
+    rssi_sum: int = 0
+    rssi_min: int = 0
+    rssi_max: int = 0
+    copies: int = 0
+    source: Optional[str] = None    # Receiver of the strongest copy
+    
+    def add_copy(self, rssi: int, now: float, source: Optional[str] = None):
+        if self.copies == 0 or rssi > self.rssi_max:
+            self.source = source
+        if self.copies == 0:
+            self.rssi_min = self.rssi_max = rssi
+        else:
+            self.rssi_min = min(self.rssi_min, rssi)
+            self.rssi_max = max(self.rssi_max, rssi)
+        self.rssi_sum += rssi
+        self.copies += 1
+        self.last_seen = now
 
 class SensorDataDecoder:
     """Decodes BLE advertisement data from sensor nodes"""
@@ -46,10 +104,200 @@ class SensorDataDecoder:
     # Nordic Semiconductor Company ID
     NORDIC_COMPANY_ID = 0x0059
     
+    # Payload values for channels skipped by the node's measurement profile
+    TEMP_NOT_MEASURED = -32768
+    VALUE_NOT_MEASURED = 0xFFFF
+    
+    # Size of struct sensor_adv_data
+    PAYLOAD_V1_SIZE = 14
+    
+    # Size and bit fields of the compact v2 payload, (name, bits) from bit 0
+    # of the 48-bit word following the version and sequence bytes
+    PAYLOAD_V2_SIZE = 8
+    V2_FIELDS = (('tier', 2), ('battery', 8), ('temperature', 14),
+                 ('humidity', 10), ('pressure', 13), ('stats', 1))
+    V2_BATTERY_BASE_MV = 2000
+    V2_BATTERY_STEP_MV = 10
+    V2_TEMP_OFFSET = 4000
+    V2_PRESS_OFFSET = 3000
+    
+    # Previous-cycle statistics following the v2 payload when its stats bit
+    # is set: awake ms, estimated charge uC, failed I2C transactions,
+    # advertising events
+    STATS_FORMAT = '<HHBB'
+    STATS_SIZE = struct.calcsize(STATS_FORMAT)
+    
+    # History delta byte announcing that the full 16-bit value follows
+    DELTA_ESCAPE = 0x80
+    
+    # The low nibble of the first payload byte is the version, the high
+    # nibble carries flags
+    VERSION_MASK = 0x0F
+    FLAG_MAINTENANCE = 0x80  # A connectable maintenance window follows
+    
+    @staticmethod
+    def convert_values(temp_raw: int, pressure_raw: int,
+                       humidity_raw: int) -> Tuple[Optional[float], Optional[float], Optional[float]]:
+        """Convert raw v1 payload values to measurements (None = channel not measured)"""
+        temperature = None if temp_raw == SensorDataDecoder.TEMP_NOT_MEASURED else temp_raw / 100.0
+        pressure = None if pressure_raw == SensorDataDecoder.VALUE_NOT_MEASURED else pressure_raw / 10.0
+        humidity = None if humidity_raw == SensorDataDecoder.VALUE_NOT_MEASURED else humidity_raw / 100.0
+        return temperature, pressure, humidity
+    
+    @staticmethod
+    def convert_values_v2(temp_field: int, pressure_field: int,
+                          humidity_field: int) -> Tuple[Optional[float], Optional[float], Optional[float]]:
+        """Convert v2 field values to measurements (all ones = channel not measured)"""
+        temperature = None if temp_field == (1 << 14) - 1 else \
+            (temp_field - SensorDataDecoder.V2_TEMP_OFFSET) / 100.0
+        pressure = None if pressure_field == (1 << 13) - 1 else \
+            (pressure_field + SensorDataDecoder.V2_PRESS_OFFSET) / 10.0
+        humidity = None if humidity_field == (1 << 10) - 1 else humidity_field / 10.0
+        return temperature, pressure, humidity
+    
+    @staticmethod
+    def decode_history(data: bytes, newest: Tuple[int, int, int], version: int = 1,
+                       seq: Optional[int] = None) -> List[Dict[str, Any]]:
+        """Decode the batched readings that follow the payload, newest first.
+        
+        Each reading carries the seconds to the newer reading, then temperature,
+        pressure and humidity as int8 deltas from the newer reading, or the
+        escape byte followed by the full 16-bit value. Values are in the units
+        of the payload version.
+        """
+        history = []
+        if not data:
+            return history
+        
+        if version == 1:
+            formats, convert = ('<h', '<H', '<H'), SensorDataDecoder.convert_values
+        else:
+            formats, convert = ('<H', '<H', '<H'), SensorDataDecoder.convert_values_v2
+        
+        count = data[0]
+        pos = 1
+        age_s = 0
+        ref = list(newest)
+        for age in range(1, count + 1):
+            if pos + 5 > len(data):
+                break
+            interval_s = struct.unpack('<H', data[pos:pos + 2])[0]
+            pos += 2
+            values = []
+            for i, fmt in enumerate(formats):
+                if pos >= len(data):
+                    return history
+                if data[pos] == SensorDataDecoder.DELTA_ESCAPE:
+                    if pos + 3 > len(data):
+                        return history
+                    values.append(struct.unpack(fmt, data[pos + 1:pos + 3])[0])
+                    pos += 3
+                else:
+                    values.append(ref[i] + struct.unpack('<b', data[pos:pos + 1])[0])
+                    pos += 1
+            age_s += interval_s
+            ref = values
+            temperature, pressure, humidity = convert(*values)
+            history.append({
+                'age_s': age_s,
+                'seq': None if seq is None else (seq - age) & 0xFF,
+                'temperature': temperature,
+                'pressure': pressure,
+                'humidity': humidity
+            })
+        return history
+    
+    @staticmethod
+    def decode_payload_v1(payload: bytes) -> Optional[Dict[str, Any]]:
+        """Decode the byte-aligned v1 payload"""
+        if len(payload) < SensorDataDecoder.PAYLOAD_V1_SIZE:
+            return None
+        
+        # struct sensor_adv_data {
+        #     uint8_t version;           // 1 byte
+        #     uint8_t tier;              // 1 byte
+        #     uint16_t battery_mv;       // 2 bytes
+        #     int16_t temperature;       // 2 bytes (temp * 100)
+        #     uint16_t pressure;         // 2 bytes (pressure * 10)
+        #     uint16_t humidity;         // 2 bytes (humidity * 100)
+        #     uint32_t timestamp;        // 4 bytes
+        # }                              // 14 bytes
+        version, tier, battery_mv, temp_raw, pressure_raw, humidity_raw, timestamp = \
+            struct.unpack('<BBHhHHI', payload[:SensorDataDecoder.PAYLOAD_V1_SIZE])
+        
+        # Convert raw values to actual measurements (None = channel not measured)
+        temperature, pressure, humidity = SensorDataDecoder.convert_values(
+            temp_raw, pressure_raw, humidity_raw)
+        
+        # Batched nodes append older readings after the payload
+        history = SensorDataDecoder.decode_history(
+            payload[SensorDataDecoder.PAYLOAD_V1_SIZE:], (temp_raw, pressure_raw, humidity_raw))
+        
+        return {
+            'version': version,
+            'seq': None,
+            'tier': tier,
+            'battery_mv': battery_mv,
+            'temperature': temperature,
+            'pressure': pressure,
+            'humidity': humidity,
+            'timestamp': timestamp,
+            'history': history
+        }
+    
+    @staticmethod
+    def decode_payload_v2(payload: bytes) -> Optional[Dict[str, Any]]:
+        """Decode the bit-packed v2 payload"""
+        if len(payload) < SensorDataDecoder.PAYLOAD_V2_SIZE:
+            return None
+        
+        version, seq = payload[0], payload[1]
+        word = int.from_bytes(payload[2:SensorDataDecoder.PAYLOAD_V2_SIZE], 'little')
+        fields = {}
+        for name, bits in SensorDataDecoder.V2_FIELDS:
+            fields[name] = word & ((1 << bits) - 1)
+            word >>= bits
+        
+        temperature, pressure, humidity = SensorDataDecoder.convert_values_v2(
+            fields['temperature'], fields['pressure'], fields['humidity'])
+        
+        rest = payload[SensorDataDecoder.PAYLOAD_V2_SIZE:]
+        stats = None
+        if fields['stats']:
+            if len(rest) < SensorDataDecoder.STATS_SIZE:
+                return None
+            awake_ms, charge_est_uc, i2c_errors, adv_events = struct.unpack(
+                SensorDataDecoder.STATS_FORMAT, rest[:SensorDataDecoder.STATS_SIZE])
+            stats = {
+                'awake_ms': awake_ms,
+                'charge_est_uc': charge_est_uc,
+                'i2c_errors': i2c_errors,
+                'adv_events': adv_events,
+            }
+            rest = rest[SensorDataDecoder.STATS_SIZE:]
+        
+        history = SensorDataDecoder.decode_history(
+            rest, (fields['temperature'], fields['pressure'], fields['humidity']),
+            version=2, seq=seq)
+        
+        return {
+            'version': version,
+            'seq': seq,
+            'tier': fields['tier'],
+            'battery_mv': SensorDataDecoder.V2_BATTERY_BASE_MV +
+                          fields['battery'] * SensorDataDecoder.V2_BATTERY_STEP_MV,
+            'temperature': temperature,
+            'pressure': pressure,
+            'humidity': humidity,
+            'timestamp': None,
+            'history': history,
+            'stats': stats
+        }
+    
     @staticmethod
     def decode_manufacturer_data(data: bytes) -> Optional[Dict[str, Any]]:
         """Decode manufacturer-specific data from BLE advertisement"""
-        if len(data) < 6:  # Minimum length: 2 bytes company ID + 4 bytes payload
+        if len(data) < 3:  # Minimum length: 2 bytes company ID + version byte
             return None
             
         # Check company ID (little endian)
@@ -57,55 +305,188 @@ class SensorDataDecoder:
         if company_id != SensorDataDecoder.NORDIC_COMPANY_ID:
             return None
             
-        # Extract sensor payload
-        payload = data[2:]
-        if len(payload) < 12:  # Minimum payload size
+        return SensorDataDecoder.decode_payload(data[2:])
+    
+    @staticmethod
+    def decode_payload(payload: bytes) -> Optional[Dict[str, Any]]:
+        """Decode the sensor payload following the company ID, as bleak
+        hands it out in AdvertisementData.manufacturer_data"""
+        if not payload:
+            return None
+        
+        # The version byte selects the layout
+        decoders = {
+            1: SensorDataDecoder.decode_payload_v1,
+            2: SensorDataDecoder.decode_payload_v2,
+        }
+        version = payload[0] & SensorDataDecoder.VERSION_MASK
+        decoder = decoders.get(version)
+        if decoder is None:
+            logger.debug(f"Unknown payload version {payload[0]}")
             return None
             
         try:
-            # Decode payload structure
-            # struct sensor_adv_data {
-            #     uint8_t version;           // 1 byte
-            #     uint8_t tier;              // 1 byte
-            #     uint16_t battery_mv;       // 2 bytes
-            #     int16_t temperature;       // 2 bytes (temp * 100)
-            #     uint16_t pressure;         // 2 bytes (pressure * 10)
-            #     uint16_t humidity;         // 2 bytes (humidity * 100)
-            #     uint32_t timestamp;        // 4 bytes
-            # }
-            
-            version, tier, battery_mv, temp_raw, pressure_raw, humidity_raw, timestamp = \
-                struct.unpack('<BBHhhHI', payload[:12])
-                
-            # Convert raw values to actual measurements
-            temperature = temp_raw / 100.0
-            pressure = pressure_raw / 10.0
-            humidity = humidity_raw / 100.0
-            
-            return {
-                'version': version,
-                'tier': tier,
-                'battery_mv': battery_mv,
-                'temperature': temperature,
-                'pressure': pressure,
-                'humidity': humidity,
-                'timestamp': timestamp
-            }
-            
+            decoded = decoder(payload)
         except struct.error as e:
             logger.warning(f"Failed to decode payload: {e}")
             return None
+        if decoded is not None:
+            decoded['version'] = version
+            decoded['maintenance'] = bool(payload[0] & SensorDataDecoder.FLAG_MAINTENANCE)
+        return decoded
+
+class NodeConfig:
+    """Runtime configuration table of a node (node_config.h)
+    
+    Read and written whole through one GATT characteristic while the node
+    holds a connect window open. Per-tier lists run normal, conserve,
+    reserve, survival; the thresholds have no survival entry.
+    """
+    
+    SERVICE_UUID = '5e1f0000-7a3c-4b8e-9a51-6c2d8f3b1e40'
+    TABLE_UUID = '5e1f0001-7a3c-4b8e-9a51-6c2d8f3b1e40'
+    VERSION = 1
+    
+    # Field name and entry count, in table order after the version byte
+    FIELDS = [
+        ('wake_interval_ms', 4, 'I'),
+        ('adv_events', 4, 'B'),
+        ('battery_high_mv', 3, 'H'),
+        ('battery_low_mv', 3, 'H'),
+        ('adv_interval_ms', 4, 'H'),
+        ('adv_duration_ms', 1, 'H'),
+    ]
+    FORMAT = '<B' + ''.join(f'{count}{code}' for _, count, code in FIELDS)
+    
+    @classmethod
+    def decode(cls, data: bytes) -> Dict[str, Any]:
+        """Table bytes to a dict of fields; raises ValueError if the node
+        runs another table version"""
+        if len(data) != struct.calcsize(cls.FORMAT) or data[0] != cls.VERSION:
+            raise ValueError(f"unsupported configuration table ({len(data)} bytes)")
+        values = list(struct.unpack(cls.FORMAT, data)[1:])
+        config = {}
+        for name, count, _ in cls.FIELDS:
+            config[name] = values[:count] if count > 1 else values[0]
+            values = values[count:]
+        return config
+    
+    @classmethod
+    def encode(cls, config: Dict[str, Any]) -> bytes:
+        values = [cls.VERSION]
+        for name, count, _ in cls.FIELDS:
+            values.extend(config[name] if count > 1 else [config[name]])
+        return struct.pack(cls.FORMAT, *values)
+    
+    @classmethod
+    def merge(cls, config: Dict[str, Any], overrides: Dict[str, Any]) -> Dict[str, Any]:
+        """Apply overrides to a table read from a node; the node validates
+        the result and refuses a table it cannot run on"""
+        fields = {name: count for name, count, _ in cls.FIELDS}
+        merged = dict(config)
+        for name, value in overrides.items():
+            if name not in fields:
+                raise ValueError(f"unknown configuration field {name}")
+            if fields[name] > 1 and (not isinstance(value, list) or len(value) != fields[name]):
+                raise ValueError(f"{name} needs {fields[name]} values")
+            merged[name] = value
+        return merged
 
 class SensorDatabase:
-    """SQLite database for storing sensor data"""
+    """SQLite database for storing sensor data
+    
+    One connection stays open for the lifetime of the scanner. WAL mode lets
+    the viewer and the MQTT bridge read while a batch is being written.
+    Writes from the event loop go through call(), which runs them on a
+    single writer thread so a commit never blocks the loop and statements
+    on the connection never overlap.
+    """
+    
+    INSERT_SQL = '''
+        INSERT INTO sensor_data 
+        (device_address, device_name, timestamp, temperature, pressure, 
+         humidity, battery_mv, power_tier, rssi, seq, rssi_min, rssi_max, copies, ts,
+         gateway)
+        VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)
+    '''
+    
+    # Newest reading per node, kept current at ingest so readers need not
+    # search sensor_data for it
+    UPSERT_LATEST_SQL = '''
+        INSERT INTO latest
+        (device_address, device_name, timestamp, temperature, pressure,
+         humidity, battery_mv, power_tier, rssi, seq)
+        VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?)
+        ON CONFLICT(device_address) DO UPDATE SET
+            device_name = excluded.device_name,
+            timestamp = excluded.timestamp,
+            temperature = excluded.temperature,
+            pressure = excluded.pressure,
+            humidity = excluded.humidity,
+            battery_mv = excluded.battery_mv,
+            power_tier = excluded.power_tier,
+            rssi = excluded.rssi,
+            seq = excluded.seq
+        WHERE excluded.timestamp > latest.timestamp
+    '''
     
-    def __init__(self, db_path: str):
+    # Columns added after the first release; older databases are migrated
+    ADDED_COLUMNS = (
+        ('seq', 'INTEGER'),
+        ('rssi_min', 'INTEGER'),
+        ('rssi_max', 'INTEGER'),
+        ('copies', 'INTEGER DEFAULT 1'),
+        ('ts', 'INTEGER'),                  # Unix epoch seconds of timestamp
+        ('gateway', 'TEXT'),                # Receiver of the strongest copy
+    )
+    
+    # Rollup tables maintained at ingest: (table, bucket length in seconds).
+    # Buckets start on multiples of their length in Unix time (UTC).
+    ROLLUPS = (
+        ('rollup_1m', 60),
+        ('rollup_1h', 3600),
+        ('rollup_1d', 86400),
+    )
+    
+    # Per-channel aggregates in each rollup row; sums are 0 and min/max NULL
+    # when a channel had no measurement in the bucket
+    ROLLUP_CHANNELS = (('temp', 'temperature'), ('press', 'pressure'), ('hum', 'humidity'))
+    
+    # Days of data kept per table; None keeps it forever
+    DEFAULT_RETENTION_DAYS = {
+        'sensor_data': 30,
+        'rollup_1m': 90,
+        'rollup_1h': 730,
+        'rollup_1d': None,
+    }
+    
+    def __init__(self, db_path: str, retention_days: Optional[Dict[str, Optional[int]]] = None):
         self.db_path = db_path
+        self.retention_days = dict(self.DEFAULT_RETENTION_DAYS)
+        if retention_days:
+            self.retention_days.update(retention_days)
+        self.writer = ThreadPoolExecutor(max_workers=1, thread_name_prefix='sensor-db')
+        # Opened here, then used only from the writer thread
+        self.conn = sqlite3.connect(db_path, check_same_thread=False)
+        self.conn.execute('PRAGMA journal_mode=WAL')
+        # Under WAL, NORMAL is safe against application crashes; FULL would
+        # fsync the SD card on every batch
+        self.conn.execute('PRAGMA synchronous=NORMAL')
         self.init_database()
     
+    async def call(self, func, *args):
+        """Run a database method on the writer thread and await its result"""
+        loop = asyncio.get_running_loop()
+        return await loop.run_in_executor(self.writer, func, *args)
+    
+    def close(self):
+        """Finish queued writes, then close the database connection"""
+        self.writer.shutdown(wait=True)
+        self.conn.close()
+    
     def init_database(self):
         """Initialize the database with required tables"""
-        with sqlite3.connect(self.db_path) as conn:
+        with self.conn as conn:
             cursor = conn.cursor()
             
             # Create sensor_data table
@@ -125,50 +506,380 @@ class SensorDatabase:
                 )
             ''')
             
+            existing = {row[1] for row in cursor.execute('PRAGMA table_info(sensor_data)')}
+            for name, decl in self.ADDED_COLUMNS:
+                if name not in existing:
+                    cursor.execute(f'ALTER TABLE sensor_data ADD COLUMN {name} {decl}')
+            
+            # Rows from before the epoch column carry local ISO times
+            cursor.execute('''
+                UPDATE sensor_data SET ts = CAST(strftime('%s', timestamp, 'utc') AS INTEGER)
+                WHERE ts IS NULL
+            ''')
+            
             # Create index for efficient queries
             cursor.execute('''
                 CREATE INDEX IF NOT EXISTS idx_device_timestamp 
                 ON sensor_data(device_address, timestamp)
             ''')
+            cursor.execute('CREATE INDEX IF NOT EXISTS idx_device_ts ON sensor_data(device_address, ts)')
+            cursor.execute('CREATE INDEX IF NOT EXISTS idx_ts ON sensor_data(ts)')
             
-            conn.commit()
-            logger.info(f"Database initialized: {self.db_path}")
-    
-    def insert_sensor_data(self, data: SensorData):
-        """Insert sensor data into the database"""
-        with sqlite3.connect(self.db_path) as conn:
-            cursor = conn.cursor()
+            self._init_rollups(cursor)
             
             cursor.execute('''
-                INSERT INTO sensor_data 
-                (device_address, device_name, timestamp, temperature, pressure, 
-                 humidity, battery_mv, power_tier, rssi)
-                VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)
-            ''', (
-                data.device_address,
-                data.device_name,
-                data.timestamp.isoformat(),
-                data.temperature,
-                data.pressure,
-                data.humidity,
-                data.battery_mv,
-                data.power_tier,
-                data.rssi
-            ))
+                CREATE TABLE IF NOT EXISTS latest (
+                    device_address TEXT PRIMARY KEY,
+                    device_name TEXT,
+                    timestamp DATETIME NOT NULL,
+                    temperature REAL,
+                    pressure REAL,
+                    humidity REAL,
+                    battery_mv INTEGER,
+                    power_tier INTEGER,
+                    rssi INTEGER,
+                    seq INTEGER
+                )
+            ''')
+            
+            # Databases from before the latest table are backfilled once
+            if cursor.execute('SELECT COUNT(*) FROM latest').fetchone()[0] == 0:
+                cursor.execute('''
+                    INSERT INTO latest
+                    SELECT device_address, device_name, MAX(timestamp), temperature,
+                           pressure, humidity, battery_mv, power_tier, rssi, seq
+                    FROM sensor_data GROUP BY device_address
+                ''')
             
-            conn.commit()
-            logger.debug(f"Data inserted for device {data.device_address}")
+            logger.info(f"Database initialized: {self.db_path}")
+    
+    @staticmethod
+    def _row(data: SensorData) -> Tuple:
+        return (
+            data.device_address,
+            data.device_name,
+            data.timestamp.isoformat(),
+            data.temperature,
+            data.pressure,
+            data.humidity,
+            data.battery_mv,
+            data.power_tier,
+            data.rssi,
+            data.seq,
+            data.rssi_min,
+            data.rssi_max,
+            data.copies,
+            int(data.timestamp.timestamp()),
+            data.gateway
+        )
+    
+    def _init_rollups(self, cursor: sqlite3.Cursor):
+        """Create the rollup tables, building new ones from the raw data"""
+        channel_columns = ''.join(
+            f'{c}_n INTEGER NOT NULL, {c}_sum REAL NOT NULL, {c}_min REAL, {c}_max REAL, '
+            for c, _ in self.ROLLUP_CHANNELS)
+        channel_select = ''.join(
+            f'COUNT({col}), TOTAL({col}), MIN({col}), MAX({col}), '
+            for _, col in self.ROLLUP_CHANNELS)
+        
+        for table, bucket_s in self.ROLLUPS:
+            exists = cursor.execute(
+                "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = ?", (table,)).fetchone()
+            cursor.execute(f'''
+                CREATE TABLE IF NOT EXISTS {table} (
+                    device_address TEXT NOT NULL,
+                    bucket INTEGER NOT NULL,
+                    n INTEGER NOT NULL,
+                    {channel_columns}
+                    batt_sum INTEGER NOT NULL,
+                    batt_min INTEGER,
+                    batt_max INTEGER,
+                    rssi_sum INTEGER NOT NULL,
+                    tier_max INTEGER,
+                    PRIMARY KEY (device_address, bucket)
+                )
+            ''')
+            cursor.execute(f'CREATE INDEX IF NOT EXISTS idx_{table}_bucket ON {table}(bucket)')
+            if not exists:
+                cursor.execute(f'''
+                    INSERT INTO {table}
+                    SELECT device_address, ts - ts % {bucket_s}, COUNT(*), {channel_select}
+                           TOTAL(battery_mv), MIN(battery_mv), MAX(battery_mv),
+                           TOTAL(rssi), MAX(power_tier)
+                    FROM sensor_data WHERE ts IS NOT NULL
+                    GROUP BY device_address, ts - ts % {bucket_s}
+                ''')
+        
+        # Upserts add a batch's partial aggregates to the stored bucket
+        columns = ['n'] + [f'{c}_{f}' for c, _ in self.ROLLUP_CHANNELS
+                           for f in ('n', 'sum', 'min', 'max')] + \
+                  ['batt_sum', 'batt_min', 'batt_max', 'rssi_sum', 'tier_max']
+        
+        def merge(column: str) -> str:
+            if column.endswith('_min') or column.endswith('_max'):
+                fn = 'MIN' if column.endswith('_min') else 'MAX'
+                return (f'{column} = {fn}(COALESCE({column}, excluded.{column}), '
+                        f'COALESCE(excluded.{column}, {column}))')
+            return f'{column} = {column} + excluded.{column}'
+        
+        self.rollup_upsert_sql = {}
+        for table, _ in self.ROLLUPS:
+            self.rollup_upsert_sql[table] = f'''
+                INSERT INTO {table} (device_address, bucket, {', '.join(columns)})
+                VALUES ({', '.join('?' * (len(columns) + 2))})
+                ON CONFLICT(device_address, bucket) DO UPDATE SET
+                {', '.join(merge(c) for c in columns)}
+            '''
+    
+    def _rollup_rows(self, batch: List[SensorData], bucket_s: int) -> List[Tuple]:
+        """Aggregate a batch into one partial rollup row per node and bucket"""
+        buckets: Dict[Tuple[str, int], List[SensorData]] = {}
+        for data in batch:
+            ts = int(data.timestamp.timestamp())
+            buckets.setdefault((data.device_address, ts - ts % bucket_s), []).append(data)
+        
+        rows = []
+        for (address, bucket), readings in buckets.items():
+            row = [address, bucket, len(readings)]
+            for _, field in self.ROLLUP_CHANNELS:
+                values = [getattr(r, field) for r in readings if getattr(r, field) is not None]
+                row += [len(values), sum(values),
+                        min(values) if values else None, max(values) if values else None]
+            batteries = [r.battery_mv for r in readings]
+            row += [sum(batteries), min(batteries), max(batteries),
+                    sum(r.rssi for r in readings), max(r.power_tier for r in readings)]
+            rows.append(tuple(row))
+        return rows
+    
+    def prune(self):
+        """Delete data older than each table's retention"""
+        now = int(time.time())
+        with self.conn:
+            for table, days in self.retention_days.items():
+                if days is None:
+                    continue
+                column = 'ts' if table == 'sensor_data' else 'bucket'
+                deleted = self.conn.execute(f'DELETE FROM {table} WHERE {column} < ?',
+                                            (now - days * 86400,)).rowcount
+                if deleted:
+                    logger.info(f"Pruned {deleted} rows older than {days} days from {table}")
+    
+    def insert_batch(self, batch: List[SensorData]):
+        """Insert several readings in one transaction"""
+        newest: Dict[str, SensorData] = {}
+        for data in batch:
+            current = newest.get(data.device_address)
+            if current is None or data.timestamp > current.timestamp:
+                newest[data.device_address] = data
+        
+        with self.conn:
+            self.conn.executemany(self.INSERT_SQL, [self._row(data) for data in batch])
+            self.conn.executemany(self.UPSERT_LATEST_SQL,
+                                  [self._row(data)[:10] for data in newest.values()])
+            for table, bucket_s in self.ROLLUPS:
+                self.conn.executemany(self.rollup_upsert_sql[table],
+                                      self._rollup_rows(batch, bucket_s))
+        logger.debug(f"Inserted batch of {len(batch)} readings")
+    
+    def insert_sensor_data(self, data: SensorData):
+        """Insert a single reading into the database"""
+        self.insert_batch([data])
+
+class SensorIngest:
+    """Bounded queue between the advertisement callback and the database
+    
+    The callback only enqueues. A single task drains the queue and hands
+    batches to the database writer thread, committing when a batch is full or
+    its first reading has waited flush_interval seconds. Readings arriving while the queue is full are
+    dropped and counted, so a writer that falls behind shows up in the
+    statistics instead of as a stalled event loop.
+    """
+    
+    def __init__(self, db: SensorDatabase, queue_size: int = 1000,
+                 batch_size: int = 100, flush_interval: float = 1.0):
+        self.db = db
+        self.queue: asyncio.Queue = asyncio.Queue(maxsize=queue_size)
+        self.batch_size = batch_size
+        self.flush_interval = flush_interval
+        self.dropped = 0
+        self.batches = 0
+        self.rows = 0
+        self.high_water = 0
+    
+    def submit(self, data: SensorData) -> bool:
+        """Queue a reading without blocking; returns False if it was dropped"""
+        try:
+            self.queue.put_nowait(data)
+        except asyncio.QueueFull:
+            self.dropped += 1
+            if self.dropped == 1 or self.dropped % 100 == 0:
+                logger.warning(f"Ingest queue full, {self.dropped} readings dropped")
+            return False
+        self.high_water = max(self.high_water, self.queue.qsize())
+        return True
+    
+    async def _flush(self, batch: List[SensorData]):
+        if not batch:
+            return
+        try:
+            await self.db.call(self.db.insert_batch, batch)
+            self.batches += 1
+            self.rows += len(batch)
+        except sqlite3.Error as e:
+            logger.error(f"Failed to store {len(batch)} readings: {e}")
+    
+    async def run(self):
+        """Drain the queue into the database until cancelled"""
+        loop = asyncio.get_running_loop()
+        batch: List[SensorData] = []
+        try:
+            while True:
+                batch.append(await self.queue.get())
+                deadline = loop.time() + self.flush_interval
+                while len(batch) < self.batch_size:
+                    timeout = deadline - loop.time()
+                    if timeout <= 0:
+                        break
+                    try:
+                        batch.append(await asyncio.wait_for(self.queue.get(), timeout))
+                    except asyncio.TimeoutError:
+                        break
+                await self._flush(batch)
+                batch = []
+        finally:
+            # Store what was already accepted before shutting down
+            while not self.queue.empty():
+                batch.append(self.queue.get_nowait())
+            await self._flush(batch)
+    
+    def stats(self) -> Dict[str, int]:
+        """Ingest counters for monitoring"""
+        return {
+            'queued': self.queue.qsize(),
+            'high_water': self.high_water,
+            'dropped': self.dropped,
+            'batches': self.batches,
+            'rows': self.rows,
+        }
+
+class GatewayForwarder:
+    """Sends this gateway's deduplicated readings to a central store
+    
+    Each reading goes out as one JSON line over TCP, together with its
+    dedup key, so the store can merge the copies several gateways receive
+    (see central_store.py). The queue is bounded; while the store is
+    unreachable the oldest readings give way.
+    """
+    
+    def __init__(self, host: str, port: int, gateway_id: str, queue_size: int = 1000):
+        self.host = host
+        self.port = port
+        self.gateway_id = gateway_id
+        self.queue: asyncio.Queue = asyncio.Queue(maxsize=queue_size)
+        self.dropped = 0
+        self.sent = 0
+    
+    def submit(self, key: Tuple, readings: List[SensorData]):
+        """Queue a reading and its batched history without blocking"""
+        line = json.dumps({
+            'gateway': self.gateway_id,
+            'key': list(key),
+            'readings': [data.to_dict() for data in readings],
+        }).encode() + b'\n'
+        if self.queue.full():
+            self.queue.get_nowait()
+            self.dropped += 1
+        self.queue.put_nowait(line)
+    
+    async def run(self):
+        """Keep a connection to the store and drain the queue into it"""
+        line = None
+        while True:
+            try:
+                reader, writer = await asyncio.open_connection(self.host, self.port)
+                logger.info(f"Forwarding to central store {self.host}:{self.port}")
+                try:
+                    while True:
+                        if line is None:
+                            line = await self.queue.get()
+                        writer.write(line)
+                        await writer.drain()
+                        line = None
+                        self.sent += 1
+                finally:
+                    writer.close()
+            except OSError as e:
+                # The line in flight is resent after reconnecting
+                logger.warning(f"Central store unreachable: {e}")
+                await asyncio.sleep(5)
 
 class BLESensorScanner:
     """Main BLE scanner for sensor nodes"""
     
-    def __init__(self, db_path: str, scan_duration: int = 30):
-        self.db = SensorDatabase(db_path)
-        self.scan_duration = scan_duration
+    # A node's reading is stored once no copy has arrived for this long; it
+    # must exceed the slowest advertising interval (10 s in the reserve tier)
+    SAMPLE_TIMEOUT_S = 15.0
+    
+    # Seconds between retention passes over the database
+    PRUNE_INTERVAL_S = 3600
+    
+    # A node flags every event of a maintenance wake's advertising set and
+    # of the window that follows; act on the first copy only
+    WINDOW_HOLDOFF_S = 600
+    
+    # Connection attempt to a node in a configuration window, which closes
+    # after 3 s (CONFIG_APP_REMOTE_CONFIG_WINDOW_MS)
+    CONFIG_CONNECT_TIMEOUT_S = 5.0
+    
+    def __init__(self, db_path: str, stats_interval: int = 30, queue_size: int = 1000,
+                 batch_size: int = 100, flush_interval: float = 1.0,
+                 sample_timeout: float = SAMPLE_TIMEOUT_S, passive: bool = True,
+                 retention_days: Optional[Dict[str, Optional[int]]] = None,
+                 adapters: Optional[List[str]] = None, gateway_id: Optional[str] = None,
+                 forwarder: Optional[GatewayForwarder] = None,
+                 window_command: Optional[str] = None,
+                 config_push: Optional[Dict[str, Any]] = None,
+                 config_nodes: Optional[List[str]] = None):
+        self.db = SensorDatabase(db_path, retention_days)
+        # One scanning task per adapter; None is the system default adapter
+        self.adapters: List[Optional[str]] = list(adapters) if adapters else [None]
+        self.gateway_id = gateway_id or socket.gethostname()
+        self.forwarder = forwarder
+        self.ingest = SensorIngest(self.db, queue_size, batch_size, flush_interval)
+        self.stats_interval = stats_interval
+        self.passive = passive
+        self.sample_timeout = sample_timeout
         self.decoder = SensorDataDecoder()
         self.known_devices = set()
         
-    def advertisement_callback(self, device: BLEDevice, advertisement_data: AdvertisementData):
+        # Per-node dedup cache: the key of the newest reading, and the reading
+        # itself until its advertising window is over
+        self.last_seq: Dict[str, int] = {}
+        self.last_key: Dict[str, Tuple] = {}
+        self.pending: Dict[str, PendingSample] = {}
+        self.copies_received = 0
+        self.samples_stored = 0
+        
+        # Called with each new reading as soon as its first copy arrives
+        self.listeners: List[Callable[[SensorData], None]] = []
+        
+        # Shell command run when a node opens its maintenance window, with
+        # {address} replaced by the node address
+        self.window_command = window_command
+        self.window_seen: Dict[str, float] = {}
+        
+        # Configuration overrides written to each node (or to config_nodes
+        # only) in its next connect window, once per node
+        self.config_push = config_push
+        self.config_nodes = {a.upper() for a in config_nodes} if config_nodes else None
+        self.config_done = set()
+    
+    def add_listener(self, listener: Callable[[SensorData], None]):
+        """Register a consumer of new readings, such as the MQTT bridge"""
+        self.listeners.append(listener)
+        
+    def advertisement_callback(self, device: BLEDevice, advertisement_data: AdvertisementData,
+                               adapter: Optional[str] = None):
         """Callback for BLE advertisement detection"""
         try:
             # Check if this is a sensor device
@@ -179,9 +890,11 @@ class BLESensorScanner:
             if advertisement_data.manufacturer_data:
                 for company_id, data in advertisement_data.manufacturer_data.items():
                     if company_id == self.decoder.NORDIC_COMPANY_ID:
-                        decoded_data = self.decoder.decode_manufacturer_data(data)
+                        # bleak strips the company ID from the value
+                        decoded_data = self.decoder.decode_payload(data)
                         if decoded_data:
-                            self._process_sensor_data(device, advertisement_data, decoded_data)
+                            self._process_sensor_data(device, advertisement_data,
+                                                      decoded_data, bytes(data), adapter)
                         break
                         
         except Exception as e:
@@ -206,13 +919,136 @@ class BLESensorScanner:
                     
         return False
     
+    def _config_pending(self, address: str) -> bool:
+        return (self.config_push is not None and address not in self.config_done and
+                (self.config_nodes is None or address.upper() in self.config_nodes))
+    
+    def _maintenance_window(self, device: BLEDevice, now: float,
+                            adapter: Optional[str] = None):
+        """Act on the first announcement of a node's connect window, opened
+        for maintenance or on a scan request"""
+        address = device.address
+        seen = self.window_seen.get(address)
+        if seen is not None and now - seen < self.WINDOW_HOLDOFF_S:
+            return
+        self.window_seen[address] = now
+        
+        logger.info(f"Connect window on {address}")
+        if self.window_command or self._config_pending(address):
+            asyncio.get_running_loop().create_task(self._use_window(device, adapter))
+    
+    async def _use_window(self, device: BLEDevice, adapter: Optional[str]):
+        """The node takes one connection per window: the configuration goes
+        first, then the window command"""
+        if self._config_pending(device.address):
+            await self._push_config(device, adapter)
+        if self.window_command:
+            await self._run_window_command(device.address)
+    
+    async def _push_config(self, device: BLEDevice, adapter: Optional[str]):
+        """Read the node's table, write it back with the overrides and
+        read it again to confirm
+        
+        The table needs an authenticated link. A bonded gateway encrypts
+        with its stored keys; otherwise BlueZ pairs through the system
+        agent, which must answer with the deployment passkey.
+        """
+        address = device.address
+        kwargs = {'adapter': adapter} if adapter else {}
+        try:
+            async with BleakClient(device, timeout=self.CONFIG_CONNECT_TIMEOUT_S,
+                                   **kwargs) as client:
+                await client.pair()
+                current = NodeConfig.decode(await client.read_gatt_char(NodeConfig.TABLE_UUID))
+                update = NodeConfig.merge(current, self.config_push)
+                if update != current:
+                    await client.write_gatt_char(NodeConfig.TABLE_UUID,
+                                                 NodeConfig.encode(update), response=True)
+                    current = NodeConfig.decode(
+                        await client.read_gatt_char(NodeConfig.TABLE_UUID))
+        except (BleakError, asyncio.TimeoutError, OSError, ValueError) as e:
+            logger.warning(f"Configuration of {address} failed: {e}")
+            return
+        
+        if current != update:
+            logger.warning(f"{address} kept its configuration: {current}")
+            return
+        self.config_done.add(address)
+        logger.info(f"Configuration of {address}: {json.dumps(current)}")
+    
+    async def _run_window_command(self, address: str):
+        """Run the window command, e.g. an mcumgr image upload, while the
+        node is connectable"""
+        command = self.window_command.format(address=address)
+        try:
+            process = await asyncio.create_subprocess_shell(command)
+            status = await process.wait()
+        except OSError as e:
+            logger.error(f"Window command for {address} failed to start: {e}")
+            return
+        if status != 0:
+            logger.warning(f"Window command for {address} exited with status {status}")
+        else:
+            logger.info(f"Window command for {address} done")
+    
+    @staticmethod
+    def _sample_key(decoded_data: Dict[str, Any], raw: bytes) -> Tuple:
+        """Identify a reading across the copies a node advertises
+        
+        v2 payloads number their readings. v1 payloads have no sequence, so
+        the node uptime they carry plus a CRC of the payload stands in; the
+        CRC, unlike hash(), is the same on every gateway.
+        """
+        if decoded_data.get('seq') is not None:
+            return ('seq', decoded_data['seq'])
+        return ('v1', decoded_data.get('timestamp'), zlib.crc32(raw))
+    
     def _process_sensor_data(self, device: BLEDevice, advertisement_data: AdvertisementData, 
-                           decoded_data: Dict[str, Any]):
+                           decoded_data: Dict[str, Any], raw: bytes = b'',
+                           adapter: Optional[str] = None):
         """Process decoded sensor data"""
         try:
+            now = time.monotonic()
+            address = device.address
+            source = f"{self.gateway_id}/{adapter or 'default'}"
+            self.copies_received += 1
+            
+            if decoded_data.get('maintenance'):
+                self._maintenance_window(device, now, adapter)
+            
+            # Every advertising event of a wake repeats the same reading; a
+            # repeat only adds to the RSSI aggregates of the held reading
+            key = self._sample_key(decoded_data, raw)
+            if self.last_key.get(address) == key:
+                pending = self.pending.get(address)
+                if pending is not None:
+                    pending.add_copy(advertisement_data.rssi, now, source)
+                logger.debug(f"Duplicate reading from {address}")
+                return
+            
+            # A new reading ends the previous window of this node
+            pending = self.pending.pop(address, None)
+            if pending is not None:
+                self._store_pending(pending)
+            
+            # v2 nodes number their readings, so only history not stored yet
+            # is kept
+            history = decoded_data.get('history', [])
+            seq = decoded_data.get('seq')
+            if seq is not None:
+                last_seq = self.last_seq.get(address)
+                if last_seq is not None:
+                    new_readings = (seq - last_seq) & 0xFF
+                    if new_readings == 0:
+                        logger.debug(f"Late duplicate reading {seq} from {address}")
+                        return
+                    history = history[:new_readings - 1]
+                self.last_seq[address] = seq
+            self.last_key[address] = key
+            
             # Create sensor data object
             sensor_data = SensorData(
-                device_address=device.address,
+                device_address=address,
                 device_name=advertisement_data.local_name or "Unknown",
                 timestamp=datetime.now(),
                 temperature=decoded_data['temperature'],
@@ -220,68 +1056,272 @@ class BLESensorScanner:
                 humidity=decoded_data['humidity'],
                 battery_mv=decoded_data['battery_mv'],
                 power_tier=decoded_data['tier'],
-                rssi=advertisement_data.rssi
+                rssi=advertisement_data.rssi,
+                seq=seq
             )
             
             # Log the data
             logger.info(
-                f"Sensor: {device.address} | "
-                f"T: {sensor_data.temperature:.2f}°C | "
-                f"P: {sensor_data.pressure:.1f} hPa | "
-                f"H: {sensor_data.humidity:.2f}% | "
+                f"Sensor: {address} | "
+                f"T: {format_reading(sensor_data.temperature, '.2f')}°C | "
+                f"P: {format_reading(sensor_data.pressure, '.1f')} hPa | "
+                f"H: {format_reading(sensor_data.humidity, '.2f')}% | "
                 f"Battery: {sensor_data.battery_mv} mV | "
                 f"Tier: {sensor_data.power_tier} | "
                 f"RSSI: {sensor_data.rssi} dBm"
             )
             
-            # Store in database
-            self.db.insert_sensor_data(sensor_data)
+            # Batched readings are stored at their time of measurement
+            readings = [sensor_data]
+            for reading in history:
+                readings.append(SensorData(
+                    device_address=sensor_data.device_address,
+                    device_name=sensor_data.device_name,
+                    timestamp=sensor_data.timestamp - timedelta(seconds=reading['age_s']),
+                    temperature=reading['temperature'],
+                    pressure=reading['pressure'],
+                    humidity=reading['humidity'],
+                    battery_mv=sensor_data.battery_mv,
+                    power_tier=sensor_data.power_tier,
+                    rssi=sensor_data.rssi,
+                    seq=reading['seq']
+                ))
+            
+            # Consumers get the reading now; only the database waits for the
+            # RSSI aggregates
+            for listener in self.listeners:
+                listener(sensor_data)
+            
+            # Hold the reading until its advertising window is over
+            pending = PendingSample(key=key, readings=readings, last_seen=now)
+            pending.add_copy(advertisement_data.rssi, now, source)
+            self.pending[address] = pending
             
         except Exception as e:
             logger.error(f"Error processing sensor data: {e}")
     
+    def _store_pending(self, pending: PendingSample):
+        """Queue a held reading and its history with the RSSI aggregates"""
+        rssi_mean = round(pending.rssi_sum / pending.copies)
+        for data in pending.readings:
+            data.rssi = rssi_mean
+            data.rssi_min = pending.rssi_min
+            data.rssi_max = pending.rssi_max
+            data.copies = pending.copies
+            data.gateway = pending.source
+            self.ingest.submit(data)
+        self.samples_stored += len(pending.readings)
+        if self.forwarder is not None:
+            self.forwarder.submit(pending.key, pending.readings)
+        if len(pending.readings) > 1:
+            logger.debug(f"Stored {len(pending.readings) - 1} batched readings "
+                         f"from {pending.readings[0].device_address}")
+    
+    def flush_pending(self, older_than: Optional[float] = None):
+        """Store held readings whose last copy is older than older_than
+        seconds, or all of them"""
+        now = time.monotonic()
+        for address, pending in list(self.pending.items()):
+            if older_than is None or now - pending.last_seen >= older_than:
+                del self.pending[address]
+                self._store_pending(pending)
+    
+    async def _prune_loop(self):
+        """Apply the retention windows now and then every PRUNE_INTERVAL_S"""
+        while True:
+            try:
+                await self.db.call(self.db.prune)
+            except sqlite3.Error as e:
+                logger.error(f"Failed to prune database: {e}")
+            await asyncio.sleep(self.PRUNE_INTERVAL_S)
+    
+    async def _flush_pending_loop(self):
+        """Store readings once their advertising window has gone quiet"""
+        while True:
+            await asyncio.sleep(1)
+            self.flush_pending(self.sample_timeout)
+    
     async def start_scanning(self):
         """Start continuous BLE scanning"""
-        logger.info(f"Starting BLE scanner (scan duration: {self.scan_duration}s)")
+        logger.info(f"Starting BLE scanner {self.gateway_id} "
+                    f"({'passive' if self.passive else 'active'}, "
+                    f"adapters: {', '.join(a or 'default' for a in self.adapters)})")
+        
+        ingest_task = asyncio.create_task(self.ingest.run())
+        helpers = [asyncio.create_task(self._flush_pending_loop()),
+                   asyncio.create_task(self._prune_loop())]
+        if self.forwarder is not None:
+            helpers.append(asyncio.create_task(self.forwarder.run()))
+        try:
+            await asyncio.gather(*(self._scan_loop(adapter) for adapter in self.adapters))
+        finally:
+            for task in helpers:
+                task.cancel()
+            self.flush_pending()
+            ingest_task.cancel()
+            await asyncio.gather(*helpers, ingest_task, return_exceptions=True)
+            logger.info(f"Ingest statistics: {self.ingest.stats()}, "
+                        f"{self.copies_received} advertisements, "
+                        f"{self.samples_stored} readings stored")
+            self.db.close()
+    
+    def _create_scanner(self, passive: bool, adapter: Optional[str]) -> BleakScanner:
+        """Build a scanner that runs until stopped
+        
+        Passive scanning sends no scan requests, so the nodes never wake
+        their receivers for one. BlueZ only allows it with an advertisement
+        monitor pattern, which also moves the company ID match out of Python.
+        """
+        kwargs = {'adapter': adapter} if adapter else {}
+        
+        def callback(device: BLEDevice, advertisement_data: AdvertisementData):
+            self.advertisement_callback(device, advertisement_data, adapter)
+        
+        if not passive:
+            return BleakScanner(detection_callback=callback, **kwargs)
+        
+        company_id = struct.pack('<H', SensorDataDecoder.NORDIC_COMPANY_ID)
+        return BleakScanner(
+            detection_callback=callback,
+            scanning_mode='passive',
+            bluez=BlueZScannerArgs(or_patterns=[
+                OrPattern(0, AdvertisementDataType.MANUFACTURER_SPECIFIC_DATA, company_id)
+            ]),
+            **kwargs
+        )
+    
+    async def _scan_loop(self, adapter: Optional[str] = None):
+        """Keep one scanner running on an adapter; it is only rebuilt after
+        an error"""
+        name = adapter or 'default adapter'
+        passive = self.passive
+        if passive and OrPattern is None:
+            logger.warning("Passive scanning needs the BlueZ backend, scanning actively")
+            passive = False
         
         while True:
+            started = False
             try:
-                # Scan for devices
-                devices = await BleakScanner.discover(
-                    timeout=self.scan_duration,
-                    detection_callback=self.advertisement_callback
-                )
-                
-                logger.debug(f"Scan completed, found {len(devices)} devices")
-                
-                # Brief pause between scans
-                await asyncio.sleep(1)
+                async with self._create_scanner(passive, adapter):
+                    started = True
+                    logger.info(f"Scanning {'passively' if passive else 'actively'} on {name}")
+                    while True:
+                        await asyncio.sleep(self.stats_interval)
+                        logger.debug(f"{self.copies_received} advertisements, "
+                                     f"{len(self.pending)} readings held, "
+                                     f"ingest {self.ingest.stats()}")
                 
             except Exception as e:
-                logger.error(f"Scan error: {e}")
+                logger.error(f"Scan error on {name}: {e}")
+                if passive and not started:
+                    # bluetoothd without --experimental has no advertisement monitor
+                    logger.warning("Passive scanning failed, falling back to active scanning")
+                    passive = False
                 await asyncio.sleep(5)  # Wait before retrying
 
 async def main():
     """Main application entry point"""
     parser = argparse.ArgumentParser(description='BLE Sensor Scanner')
     parser.add_argument('--db', default='sensor_data.db', help='Database file path')
-    parser.add_argument('--scan-duration', type=int, default=30, help='Scan duration in seconds')
+    parser.add_argument('--stats-interval', '--scan-duration', dest='stats_interval',
+                        type=int, default=30, help='Seconds between scanner status logs')
+    parser.add_argument('--active', action='store_true',
+                        help='Scan actively instead of passively')
     parser.add_argument('--log-level', default='INFO', help='Logging level')
+    parser.add_argument('--queue-size', type=int, default=1000,
+                        help='Readings buffered ahead of the database before dropping')
+    parser.add_argument('--batch-size', type=int, default=100,
+                        help='Readings written per database transaction')
+    parser.add_argument('--flush-interval', type=float, default=1.0,
+                        help='Seconds a reading may wait for its batch to fill')
+    parser.add_argument('--raw-retention-days', type=int,
+                        default=SensorDatabase.DEFAULT_RETENTION_DAYS['sensor_data'],
+                        help='Days of raw readings to keep (0 keeps them forever)')
+    parser.add_argument('--minute-retention-days', type=int,
+                        default=SensorDatabase.DEFAULT_RETENTION_DAYS['rollup_1m'],
+                        help='Days of 1-minute rollups to keep (0 keeps them forever)')
+    parser.add_argument('--hour-retention-days', type=int,
+                        default=SensorDatabase.DEFAULT_RETENTION_DAYS['rollup_1h'],
+                        help='Days of 1-hour rollups to keep (0 keeps them forever)')
+    parser.add_argument('--adapters',
+                        help='Comma-separated HCI adapters to scan on, e.g. hci0,hci1')
+    parser.add_argument('--gateway-id', help='Name of this gateway (default: host name)')
+    parser.add_argument('--forward', metavar='HOST:PORT',
+                        help='Also send readings to a central_store.py instance')
+    parser.add_argument('--mqtt-host', help='Publish readings to this MQTT broker as they arrive')
+    parser.add_argument('--mqtt-port', type=int, default=1883, help='MQTT broker port')
+    parser.add_argument('--mqtt-username', help='MQTT username')
+    parser.add_argument('--mqtt-password', help='MQTT password')
+    parser.add_argument('--topic-prefix', default='sensors', help='MQTT topic prefix')
+    parser.add_argument('--window-command', metavar='CMD',
+                        help='Run CMD when a node opens its maintenance window; '
+                             '{address} is replaced by the node address')
+    parser.add_argument('--push-config', metavar='FILE',
+                        help='Write the configuration fields in this JSON file to each '
+                             'node in its next connect window ({} only reads them)')
+    parser.add_argument('--config-nodes',
+                        help='Comma-separated node addresses --push-config is limited to')
+    parser.add_argument('--sample-timeout', type=float,
+                        default=BLESensorScanner.SAMPLE_TIMEOUT_S,
+                        help='Seconds without a repeat before a reading is stored')
     
     args = parser.parse_args()
     
+    config_push = None
+    if args.push_config:
+        try:
+            with open(args.push_config) as f:
+                config_push = json.load(f)
+            # Field names and list lengths; the values are the node's to judge
+            NodeConfig.merge({}, config_push)
+        except (OSError, ValueError, AttributeError) as e:
+            parser.error(f"--push-config: {e}")
+    
     # Set log level
     logging.getLogger().setLevel(getattr(logging, args.log_level.upper()))
     
+    forwarder = None
+    gateway_id = args.gateway_id or socket.gethostname()
+    if args.forward:
+        host, _, port = args.forward.rpartition(':')
+        forwarder = GatewayForwarder(host, int(port), gateway_id)
+    
     # Create scanner
-    scanner = BLESensorScanner(args.db, args.scan_duration)
+    scanner = BLESensorScanner(args.db, args.stats_interval, args.queue_size,
+                               args.batch_size, args.flush_interval, args.sample_timeout,
+                               passive=not args.active,
+                               retention_days={
+                                   'sensor_data': args.raw_retention_days or None,
+                                   'rollup_1m': args.minute_retention_days or None,
+                                   'rollup_1h': args.hour_retention_days or None,
+                               },
+                               adapters=args.adapters.split(',') if args.adapters else None,
+                               gateway_id=gateway_id, forwarder=forwarder,
+                               window_command=args.window_command,
+                               config_push=config_push,
+                               config_nodes=args.config_nodes.split(',') if args.config_nodes
+                               else None)
     
     logger.info("Adaptive BLE Sensor Scanner Starting...")
     logger.info(f"Database: {args.db}")
-    logger.info(f"Scan duration: {args.scan_duration}s")
+    
+    tasks = [scanner.start_scanning()]
+    if args.mqtt_host:
+        # The bridge runs in this process and is fed by the scanner
+        from mqtt_bridge import MQTTBridge
+        bridge = MQTTBridge(
+            db_path=args.db,
+            mqtt_host=args.mqtt_host,
+            mqtt_port=args.mqtt_port,
+            mqtt_username=args.mqtt_username,
+            mqtt_password=args.mqtt_password,
+            topic_prefix=args.topic_prefix
+        )
+        scanner.add_listener(bridge.attach())
+        tasks.append(bridge.run())
     
     try:
-        await scanner.start_scanning()
+        await asyncio.gather(*tasks)
     except KeyboardInterrupt:
         logger.info("Scanner stopped by user")
     except Exception as e:
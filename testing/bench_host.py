@@ -0,0 +1,385 @@
+#!/usr/bin/env python3
+"""
+Host Decode/Ingest Benchmark
+
+Drives a synthetic or recorded advertisement stream for a fleet of nodes
+through the real pi_host scanner: SensorDataDecoder, the
+BLESensorScanner advertisement callback with its dedup, and the
+SensorIngest queue into a scratch SQLite database.
+
+Reports decode ns/op, callback ns/op, ingest rows/s, queue latency
+percentiles and database growth, and appends the results to a JSON lines
+file. Each run is compared with the last saved run that used the same
+parameters, so a regression after a scanner change shows up as a delta.
+
+    python3 testing/bench_host.py --nodes 200 --minutes 60
+    python3 testing/bench_host.py --record stream.jsonl
+    python3 testing/bench_host.py --replay stream.jsonl
+"""
+
+import argparse
+import asyncio
+import json
+import logging
+import os
+import random
+import subprocess
+import sys
+import tempfile
+import time
+import types
+from datetime import datetime
+from typing import Any, Dict, List, Optional, Tuple
+
+REPO_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path.append(os.path.join(REPO_DIR, 'pi_host'))
+
+try:
+    import bleak  # noqa: F401
+except ImportError:
+    # The benchmark never touches the radio; the scanner only needs the names
+    bleak_stub = types.ModuleType('bleak')
+    bleak_stub.BleakScanner = object
+    bleak_stub.BleakClient = object
+    sys.modules['bleak'] = bleak_stub
+    for name in ('bleak.exc', 'bleak.backends', 'bleak.backends.scanner',
+                 'bleak.backends.device'):
+        sys.modules[name] = types.ModuleType(name)
+    sys.modules['bleak.exc'].BleakError = type('BleakError', (Exception,), {})
+    sys.modules['bleak.backends.scanner'].AdvertisementData = object
+    sys.modules['bleak.backends.device'].BLEDevice = object
+
+from sensor_scanner import BLESensorScanner, SensorDataDecoder, SensorIngest  # noqa: E402
+
+# Kept outside the checkout so runs don't leave files in the tree
+DEFAULT_RESULTS = os.path.join(tempfile.gettempdir(), 'temp-sensor-bench', 'bench_results.jsonl')
+
+# A delta beyond this fraction of the previous run is flagged
+REGRESSION_THRESHOLD = 0.10
+
+# One advertisement: (time in s from stream start, node address, RSSI,
+# manufacturer data value as bleak hands it out)
+Frame = Tuple[float, str, int, bytes]
+
+class Device:
+    """Stand-in for bleak's BLEDevice"""
+    __slots__ = ('address', 'name')
+
+    def __init__(self, address: str):
+        self.address = address
+        self.name = None
+
+class Advertisement:
+    """Stand-in for bleak's AdvertisementData on a passive scan"""
+    __slots__ = ('rssi', 'local_name', 'manufacturer_data', 'service_uuids')
+
+    def __init__(self, rssi: int, payload: bytes):
+        self.rssi = rssi
+        self.local_name = None
+        self.manufacturer_data = {SensorDataDecoder.NORDIC_COMPANY_ID: payload}
+        self.service_uuids = []
+
+def encode_v2(seq: int, tier: int, battery_mv: int, temperature: float,
+              pressure: float, humidity: float) -> bytes:
+    """Build a v2 payload the way ble_advertiser.c packs it"""
+    d = SensorDataDecoder
+    fields = {
+        'tier': tier,
+        'battery': max(0, min(255, (battery_mv - d.V2_BATTERY_BASE_MV) // d.V2_BATTERY_STEP_MV)),
+        'temperature': round(temperature * 100) + d.V2_TEMP_OFFSET,
+        'humidity': round(humidity * 10),
+        'pressure': round(pressure * 10) - d.V2_PRESS_OFFSET,
+        'stats': 0,
+    }
+    word, shift = 0, 0
+    for name, bits in d.V2_FIELDS:
+        word |= (fields[name] & ((1 << bits) - 1)) << shift
+        shift += bits
+    return bytes([2, seq & 0xFF]) + word.to_bytes(6, 'little')
+
+def generate_stream(nodes: int, minutes: float, wake_s: float, copies: int,
+                    adv_interval_s: float, seed: int) -> List[Frame]:
+    """Advertisements of a fleet: each node wakes every wake_s seconds, at a
+    random phase, and repeats its reading copies times"""
+    rng = random.Random(seed)
+    frames: List[Frame] = []
+    duration = minutes * 60
+    for n in range(nodes):
+        address = 'C0:%02X:%02X:%02X:%02X:%02X' % ((n >> 24) & 0xFF, (n >> 16) & 0xFF,
+                                                  (n >> 8) & 0xFF, n & 0xFF, rng.randrange(256))
+        rssi_base = rng.randint(-95, -50)
+        temperature = rng.uniform(15, 25)
+        humidity = rng.uniform(30, 60)
+        pressure = rng.uniform(990, 1030)
+        battery_mv = rng.randint(3300, 4200)
+        t = rng.uniform(0, wake_s)
+        seq = rng.randrange(256)
+        while t < duration:
+            temperature += rng.gauss(0, 0.05)
+            humidity = min(100, max(0, humidity + rng.gauss(0, 0.2)))
+            pressure += rng.gauss(0, 0.1)
+            payload = encode_v2(seq, 0 if battery_mv >= 3800 else 1, battery_mv,
+                                temperature, pressure, humidity)
+            for c in range(copies):
+                frames.append((t + c * adv_interval_s, address,
+                               rssi_base + rng.randint(-6, 6), payload))
+            seq = (seq + 1) & 0xFF
+            t += wake_s
+    frames.sort(key=lambda f: f[0])
+    return frames
+
+def save_stream(path: str, frames: List[Frame]):
+    with open(path, 'w') as f:
+        for t, address, rssi, payload in frames:
+            f.write(json.dumps({'t': round(t, 3), 'address': address,
+                                'rssi': rssi, 'data': payload.hex()}) + '\n')
+
+def load_stream(path: str) -> List[Frame]:
+    with open(path) as f:
+        return [(r['t'], r['address'], r['rssi'], bytes.fromhex(r['data']))
+                for r in map(json.loads, f) if r]
+
+def percentile(values: List[float], p: float) -> Optional[float]:
+    if not values:
+        return None
+    values = sorted(values)
+    return values[min(len(values) - 1, int(p / 100 * len(values)))]
+
+def db_size(path: str) -> int:
+    return sum(os.path.getsize(p) for p in (path, path + '-wal') if os.path.exists(p))
+
+def bench_decode(frames: List[Frame], repeat: int) -> float:
+    """ns per decode_payload() call over the stream's payloads"""
+    payloads = [f[3] for f in frames]
+    decode = SensorDataDecoder.decode_payload
+    best = None
+    for _ in range(repeat):
+        start = time.perf_counter_ns()
+        for payload in payloads:
+            decode(payload)
+        elapsed = time.perf_counter_ns() - start
+        best = elapsed if best is None else min(best, elapsed)
+    return best / len(payloads)
+
+async def bench_scanner(frames: List[Frame], db_path: str, speed: float,
+                        queue_size: int, batch_size: int,
+                        flush_interval: float) -> Dict[str, Any]:
+    """Feed the stream through the scanner callback into the database"""
+    scanner = BLESensorScanner(db_path, queue_size=queue_size, batch_size=batch_size,
+                               flush_interval=flush_interval, gateway_id='bench')
+    ingest: SensorIngest = scanner.ingest
+
+    # Time each reading from its hand-over to the queue until its batch is
+    # committed
+    enqueued: Dict[int, float] = {}
+    latencies: List[float] = []
+    insert_s = 0.0
+    submit, insert_batch = ingest.submit, scanner.db.insert_batch
+
+    def timed_submit(data):
+        enqueued[id(data)] = time.perf_counter()
+        return submit(data)
+
+    def timed_insert(batch):
+        nonlocal insert_s
+        t0 = time.perf_counter()
+        insert_batch(batch)
+        now = time.perf_counter()
+        insert_s += now - t0
+        for data in batch:
+            latencies.append(now - enqueued.pop(id(data), now))
+
+    ingest.submit, scanner.db.insert_batch = timed_submit, timed_insert
+    scanner.db.conn.execute('PRAGMA wal_checkpoint(TRUNCATE)')
+    size_before = db_size(db_path)
+
+    ingest_task = asyncio.create_task(ingest.run())
+    devices: Dict[str, Device] = {}
+    callback_ns = 0
+    start = time.perf_counter()
+    for i, (t, address, rssi, payload) in enumerate(frames):
+        if speed > 0:
+            delay = start + t / speed - time.perf_counter()
+            if delay > 0:
+                await asyncio.sleep(delay)
+        elif i % 100 == 0:
+            # Let the writer catch up, so the run measures throughput rather
+            # than queue overflow
+            while ingest.queue.qsize() >= ingest.batch_size:
+                await asyncio.sleep(0)
+        device = devices.get(address)
+        if device is None:
+            device = devices[address] = Device(address)
+        adv = Advertisement(rssi, payload)
+        t0 = time.perf_counter_ns()
+        scanner.advertisement_callback(device, adv, 'hci0')
+        callback_ns += time.perf_counter_ns() - t0
+        # A node's window closes sample_timeout after its last copy
+        if speed > 0 and i % 100 == 0:
+            scanner.flush_pending(scanner.sample_timeout / speed)
+    scanner.flush_pending()
+    while not ingest.queue.empty():
+        await asyncio.sleep(0.01)
+    ingest_task.cancel()
+    await asyncio.gather(ingest_task, return_exceptions=True)
+    elapsed = time.perf_counter() - start
+    scanner.db.close()  # Checkpoints the WAL into the database file
+
+    rows = ingest.rows
+    return {
+        'callback_ns_per_op': callback_ns / len(frames),
+        'rows': rows,
+        'dropped': ingest.dropped,
+        'batches': ingest.batches,
+        'queue_high_water': ingest.high_water,
+        'ingest_rows_per_s': rows / insert_s if insert_s else None,
+        'end_to_end_rows_per_s': rows / elapsed if elapsed else None,
+        'elapsed_s': elapsed,
+        'latency_ms': {f'p{p}': None if v is None else v * 1000
+                       for p, v in ((p, percentile(latencies, p)) for p in (50, 90, 99, 100))},
+        'db_bytes': db_size(db_path) - size_before,
+        'db_bytes_per_row': (db_size(db_path) - size_before) / rows if rows else None,
+    }
+
+def git_revision() -> Optional[str]:
+    try:
+        return subprocess.run(['git', 'rev-parse', '--short', 'HEAD'], cwd=REPO_DIR,
+                              capture_output=True, text=True, check=True).stdout.strip()
+    except (OSError, subprocess.CalledProcessError):
+        return None
+
+def previous_result(path: str, params: Dict[str, Any]) -> Optional[Dict[str, Any]]:
+    if not os.path.exists(path):
+        return None
+    last = None
+    with open(path) as f:
+        for line in f:
+            try:
+                result = json.loads(line)
+            except ValueError:
+                continue
+            if result.get('params') == params:
+                last = result
+    return last
+
+# Metrics compared between runs and whether higher is better
+COMPARED = (('decode_ns_per_op', False), ('callback_ns_per_op', False),
+            ('ingest_rows_per_s', True), ('latency_ms.p99', False),
+            ('db_bytes_per_row', False))
+
+def metric(result: Dict[str, Any], name: str) -> Optional[float]:
+    value: Any = result
+    for part in name.split('.'):
+        value = value.get(part) if isinstance(value, dict) else None
+    return value
+
+def print_report(result: Dict[str, Any], previous: Optional[Dict[str, Any]]) -> bool:
+    """Print the results; returns False if a metric regressed"""
+    m = result['metrics']
+    lat = m['latency_ms']
+    print(f"\nHost benchmark ({result['params']['frames']} advertisements, "
+          f"{result['params']['nodes']} nodes)")
+    print("-" * 60)
+    print(f"Decode:        {m['decode_ns_per_op']:10.0f} ns/op")
+    print(f"Callback:      {m['callback_ns_per_op']:10.0f} ns/op")
+    print(f"Ingest:        {m['ingest_rows_per_s']:10.0f} rows/s in the writer, "
+          f"{m['end_to_end_rows_per_s']:.0f} rows/s end to end")
+    print(f"               {m['rows']} rows, {m['batches']} batches, "
+          f"{m['dropped']} dropped, queue high water {m['queue_high_water']}")
+    print(f"Queue latency: p50 {lat['p50']:.1f} ms, p90 {lat['p90']:.1f} ms, "
+          f"p99 {lat['p99']:.1f} ms, max {lat['p100']:.1f} ms")
+    print(f"DB growth:     {m['db_bytes']} bytes ({m['db_bytes_per_row']:.0f} bytes/row)")
+
+    if previous is None:
+        print("\nNo previous run with these parameters")
+        return True
+    ok = True
+    print(f"\nAgainst {previous.get('revision') or 'previous run'} ({previous['date']}):")
+    for name, higher_is_better in COMPARED:
+        old, new = metric(previous['metrics'], name), metric(m, name)
+        if not old or new is None:
+            continue
+        delta = (new - old) / old
+        worse = -delta if higher_is_better else delta
+        flag = ''
+        if worse > REGRESSION_THRESHOLD:
+            flag = '  <-- regression'
+            ok = False
+        print(f"  {name:<20} {old:12.1f} -> {new:12.1f} ({delta:+.1%}){flag}")
+    return ok
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmark the host decode and ingest path')
+    parser.add_argument('--nodes', type=int, default=100, help='Simulated nodes')
+    parser.add_argument('--minutes', type=float, default=60, help='Simulated minutes of traffic')
+    parser.add_argument('--wake-interval', type=float, default=60,
+                        help='Seconds between node wakes')
+    parser.add_argument('--copies', type=int, default=5,
+                        help='Advertisements per reading')
+    parser.add_argument('--seed', type=int, default=1, help='Stream generator seed')
+    parser.add_argument('--replay', help='Replay a recorded stream instead of generating one')
+    parser.add_argument('--record', help='Save the generated stream to this file')
+    parser.add_argument('--speed', type=float, default=0,
+                        help='Replay speed-up over real time (0 = as fast as possible)')
+    parser.add_argument('--queue-size', type=int, default=1000)
+    parser.add_argument('--batch-size', type=int, default=100)
+    parser.add_argument('--flush-interval', type=float, default=1.0)
+    parser.add_argument('--repeat', type=int, default=3, help='Decode passes (best is kept)')
+    parser.add_argument('--results', default=DEFAULT_RESULTS,
+                        help='JSON lines file the results are appended to')
+    parser.add_argument('--no-save', action='store_true', help='Do not save the results')
+
+    args = parser.parse_args()
+    # Drops are counted in the results; per-reading logs would skew the timing
+    logging.getLogger().setLevel(logging.ERROR)
+
+    if args.replay:
+        frames = load_stream(args.replay)
+        nodes = len({f[1] for f in frames})
+    else:
+        frames = generate_stream(args.nodes, args.minutes, args.wake_interval,
+                                 args.copies, 0.1, args.seed)
+        nodes = args.nodes
+        if args.record:
+            save_stream(args.record, frames)
+            print(f"Recorded {len(frames)} advertisements to {args.record}")
+    if not frames:
+        print("Empty stream")
+        sys.exit(1)
+
+    params = {
+        'stream': os.path.basename(args.replay) if args.replay else 'generated',
+        'nodes': nodes,
+        'frames': len(frames),
+        'speed': args.speed,
+        'queue_size': args.queue_size,
+        'batch_size': args.batch_size,
+        'flush_interval': args.flush_interval,
+    }
+    if not args.replay:
+        params.update(minutes=args.minutes, wake_interval=args.wake_interval,
+                      copies=args.copies, seed=args.seed)
+
+    metrics = {'decode_ns_per_op': bench_decode(frames, args.repeat)}
+    with tempfile.TemporaryDirectory() as tmp:
+        metrics.update(asyncio.run(bench_scanner(
+            frames, os.path.join(tmp, 'bench.db'), args.speed,
+            args.queue_size, args.batch_size, args.flush_interval)))
+
+    result = {
+        'date': datetime.now().isoformat(timespec='seconds'),
+        'revision': git_revision(),
+        'python': sys.version.split()[0],
+        'params': params,
+        'metrics': metrics,
+    }
+    ok = print_report(result, previous_result(args.results, params))
+    if not args.no_save:
+        os.makedirs(os.path.dirname(os.path.abspath(args.results)), exist_ok=True)
+        with open(args.results, 'a') as f:
+            f.write(json.dumps(result) + '\n')
+        print(f"\nResults appended to {args.results}")
+    sys.exit(0 if ok else 2)
+
+if __name__ == "__main__":
+    main()
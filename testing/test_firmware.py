@@ -30,6 +30,7 @@ class TestSensorDataEncoding(unittest.TestCase):
             6540,   # humidity * 100 (65.40%)
             1234567890  # timestamp
         )
+        self.assertEqual(len(mcu_data), 14)  # PAYLOAD_V1_SIZE in sensor_scanner.py
         
         # Simulate host decoding (from sensor_scanner.py)
         version, tier, battery_mv, temp_raw, pressure_raw, humidity_raw, timestamp = \
@@ -49,6 +50,74 @@ class TestSensorDataEncoding(unittest.TestCase):
         self.assertAlmostEqual(humidity, 65.40, places=2)
         self.assertEqual(timestamp, 1234567890)
 
+    def test_not_measured_channels(self):
+        """Test that channels skipped by the measurement profile decode as None"""
+        
+        # Temperature-only profile: pressure and humidity carry the sentinel
+        mcu_data = struct.pack('<BBHhHHI', 1, 3, 3300, -525, 0xFFFF, 0xFFFF, 42)
+        
+        _, _, _, temp_raw, pressure_raw, humidity_raw, _ = struct.unpack('<BBHhHHI', mcu_data)
+        temperature = None if temp_raw == -32768 else temp_raw / 100.0
+        pressure = None if pressure_raw == 0xFFFF else pressure_raw / 10.0
+        humidity = None if humidity_raw == 0xFFFF else humidity_raw / 100.0
+        
+        self.assertAlmostEqual(temperature, -5.25, places=2)
+        self.assertIsNone(pressure)
+        self.assertIsNone(humidity)
+
+    def test_compact_v2_payload(self):
+        """Test the bit-packed v2 payload against its field widths"""
+        
+        def v2_field(value, offset, bits, measured=True):
+            # Simulate v2_field() in ble_advertiser.c
+            na = (1 << bits) - 1
+            return na if not measured else min(max(value + offset, 0), na - 1)
+        
+        def encode(seq, tier, battery_mv, temp, pressure, humidity):
+            # v1 record units in, v2 fields out (temperature, pressure, humidity)
+            word = tier
+            word |= v2_field((battery_mv - 2000) // 10, 0, 8) << 2
+            word |= v2_field(temp, 4000, 14, temp != -32768) << 10
+            word |= v2_field((humidity + 5) // 10, 0, 10, humidity != 0xFFFF) << 24
+            word |= v2_field(pressure, -3000, 13, pressure != 0xFFFF) << 34
+            return bytes([2, seq]) + word.to_bytes(6, 'little')
+        
+        def decode(payload):
+            word = int.from_bytes(payload[2:8], 'little')
+            fields = []
+            for bits in (2, 8, 14, 10, 13):
+                fields.append(word & ((1 << bits) - 1))
+                word >>= bits
+            return payload[0], payload[1], fields
+        
+        payload = encode(42, 2, 3617, 2350, 10132, 6540)
+        self.assertEqual(len(payload), 8)
+        version, seq, (tier, battery, temp, humidity, pressure) = decode(payload)
+        self.assertEqual((version, seq, tier), (2, 42, 2))
+        self.assertEqual(2000 + battery * 10, 3610)
+        self.assertAlmostEqual((temp - 4000) / 100.0, 23.50, places=2)
+        self.assertAlmostEqual(humidity / 10.0, 65.4, places=1)
+        self.assertAlmostEqual((pressure + 3000) / 10.0, 1013.2, places=1)
+        
+        # Sensor range limits fit; skipped channels are all ones
+        _, _, fields = decode(encode(0, 3, 4200, -4000, 11000, 0xFFFF))
+        self.assertEqual(fields[2], 0)
+        self.assertEqual((fields[4] + 3000) / 10.0, 1100.0)
+        self.assertEqual(fields[3], 0x3FF)
+        _, _, fields = decode(encode(0, 3, 1800, 8500, 0xFFFF, 10000))
+        self.assertEqual(fields[1], 0)
+        self.assertEqual((fields[2] - 4000) / 100.0, 85.0)
+        self.assertEqual(fields[3], 1000)
+        self.assertEqual(fields[4], 0x1FFF)
+        
+        # The stats bit sits above pressure and announces the 6-byte summary
+        payload = bytearray(encode(7, 0, 3700, 2000, 10000, 5000))
+        payload[7] |= 0x80
+        payload += struct.pack('<HHBB', 42, 180, 1, 5)
+        _, _, fields = decode(bytes(payload))
+        self.assertAlmostEqual((fields[4] + 3000) / 10.0, 1000.0, places=1)
+        self.assertEqual(struct.unpack('<HHBB', payload[8:14]), (42, 180, 1, 5))
+
 class TestPowerTierLogic(unittest.TestCase):
     """Test adaptive power management logic"""
     
@@ -127,6 +196,121 @@ class TestPowerTierLogic(unittest.TestCase):
         
         return new_tier
 
+    INTERVALS_MS = [5 * 60000, 15 * 60000, 30 * 60000, 60 * 60000]
+    ADV_EVENTS = [5, 3, 2, 1]
+
+    def plan(self, tier, percent, runtime_s=0, capacity_mah=1000, lifetime_days=365,
+             min_interval_s=300, every_n=1):
+        """Simulate adaptive_scheduler_plan()"""
+        wake_uc, event_uc, sleep_na, min_horizon_s = 1000, 40, 1500, 7 * 24 * 3600
+        max_ms = self.INTERVALS_MS[tier]
+        min_ms = self.INTERVALS_MS[tier - 1] if tier > 0 else min_interval_s * 1000
+        min_events = self.ADV_EVENTS[tier]
+        max_events = self.ADV_EVENTS[tier - 1] if tier > 0 else min_events
+
+        lifetime_s = lifetime_days * 24 * 3600
+        remaining_uc = capacity_mah * 3600 * 1000 * percent // 100
+        horizon_s = lifetime_s - runtime_s if lifetime_s > runtime_s + min_horizon_s else min_horizon_s
+        budget_na = remaining_uc * 1000 // horizon_s
+        if budget_na <= sleep_na:
+            return max_ms, min_events
+        budget_na -= sleep_na
+
+        per_wake_uc = wake_uc + min_events * event_uc // every_n
+        interval_ms = per_wake_uc * 1000 * 1000 // budget_na
+        interval_ms = min(max(interval_ms, min_ms), max_ms) // 1000 * 1000
+
+        events = min_events
+        cycle_uc = budget_na * interval_ms // (1000 * 1000)
+        if cycle_uc > wake_uc:
+            events = (cycle_uc - wake_uc) * every_n // event_uc
+            events = min(max(events, min_events), max_events)
+        return interval_ms, events
+
+    def test_energy_budget_plan(self):
+        """Budget picks rates between tier bounds"""
+        # A fresh cell with a one-year target is capped by the fastest rate,
+        # which by default is the normal tier's own interval
+        self.assertEqual(self.plan(0, 100), (5 * 60000, 5))
+        self.assertEqual(self.plan(0, 100, min_interval_s=60), (60000, 5))
+
+        # A tight budget lands between the reserve and conserve intervals
+        self.assertEqual(self.plan(2, 20, lifetime_days=3650), (1379000, 2))
+
+        # An exhausted budget falls back to the tier's own fixed rate
+        self.assertEqual(self.plan(3, 0), (60 * 60000, 1))
+
+    def report_due(self, record, last, silent_s, deadbands=(20, 10, 100), heartbeat_s=3600):
+        """Simulate adaptive_scheduler_report_due()"""
+        if last is None or silent_s >= heartbeat_s:
+            return True
+        sentinels = (-32768, 0xFFFF, 0xFFFF)
+        for value, prev, sentinel, deadband in zip(record, last, sentinels, deadbands):
+            if value == sentinel or prev == sentinel:
+                if value != prev:
+                    return True
+            elif abs(value - prev) > deadband:
+                return True
+        return False
+
+    def test_deadband_reporting(self):
+        """Radio stays off for small changes until the heartbeat"""
+        last = (2150, 10132, 4500)
+        self.assertTrue(self.report_due(last, None, 0))              # Nothing sent yet
+        self.assertFalse(self.report_due((2170, 10140, 4400), last, 600))
+        self.assertTrue(self.report_due((2171, 10132, 4500), last, 600))
+        self.assertTrue(self.report_due((2150, 10132, 4601), last, 600))
+        self.assertTrue(self.report_due((2150, 0xFFFF, 4500), last, 600))
+        self.assertTrue(self.report_due(last, last, 3600))           # Heartbeat
+
+    # struct node_config: version, then per-tier wake intervals, events,
+    # high and low thresholds (no survival entry), intervals, duration
+    CONFIG_FORMAT = '<B4I4B3H3H4HH'
+    CONFIG_DEFAULTS = [1, 300000, 900000, 1800000, 3600000, 5, 3, 2, 1,
+                       3800, 3600, 3400, 3600, 3400, 3200, 1000, 5000, 10000, 10000, 30000]
+
+    def config_valid(self, values, min_interval_ms=60000, max_interval_ms=0x0FFF * 60000):
+        """Simulate node_config_validate()"""
+        version, rest = values[0], values[1:]
+        wake, events = rest[0:4], rest[4:8]
+        high, low = rest[8:11], rest[11:14]
+        adv_interval, duration = rest[14:18], rest[18]
+        if version != 1:
+            return False
+        for i in range(4):
+            if not (min_interval_ms <= wake[i] <= max_interval_ms) or events[i] == 0 or \
+               not (20 <= adv_interval[i] <= 10240) or duration < adv_interval[i]:
+                return False
+            if i > 0 and (wake[i] < wake[i - 1] or events[i] > events[i - 1]):
+                return False
+        for i in range(3):
+            if low[i] >= high[i]:
+                return False
+            if i > 0 and (high[i] > high[i - 1] or low[i] > low[i - 1]):
+                return False
+        return True
+
+    def test_runtime_config_table(self):
+        """Defaults validate, fit one ATT write and reject unusable tables"""
+        table = struct.pack(self.CONFIG_FORMAT, *self.CONFIG_DEFAULTS)
+        self.assertEqual(len(table), 43)
+        self.assertLessEqual(len(table), 65 - 3)  # ATT MTU of prj.conf
+        self.assertTrue(self.config_valid(self.CONFIG_DEFAULTS))
+
+        def changed(index, value):
+            values = list(self.CONFIG_DEFAULTS)
+            values[index] = value
+            return values
+
+        self.assertTrue(self.config_valid(changed(1, 600000)))    # Slower normal tier
+        self.assertFalse(self.config_valid(changed(0, 2)))        # Other table version
+        self.assertFalse(self.config_valid(changed(1, 30000)))    # Below the minimum wake
+        self.assertFalse(self.config_valid(changed(2, 200000)))   # Conserve faster than normal
+        self.assertFalse(self.config_valid(changed(6, 6)))        # Conserve sends more events
+        self.assertFalse(self.config_valid(changed(12, 3800)))    # No normal-tier hysteresis
+        self.assertFalse(self.config_valid(changed(15, 10)))      # Interval below 20 ms
+        self.assertFalse(self.config_valid(changed(19, 5000)))    # Backstop below an interval
+
 class TestBME280Calibration(unittest.TestCase):
     """Test BME280 sensor calibration and compensation"""
     
@@ -154,6 +338,210 @@ class TestBME280Calibration(unittest.TestCase):
         self.assertGreater(temperature, -4000)  # -40.00°C
         self.assertLess(temperature, 8500)      # 85.00°C
 
+    def test_calibration_burst_unpack(self):
+        """Test unpacking of the 0x88-0xA1 and 0xE1-0xE7 calibration bursts"""
+        
+        # Coefficients as stored by the sensor (little endian words)
+        tp_block = struct.pack('<HhhHhhhhhhhh', 27504, 26435, -1000,
+                               36477, -10685, 3024, 2855, 140, -7, 15500, -14600, 6000)
+        tp_block += bytes([0x00, 0x4B])  # 0xA0 reserved, 0xA1 = dig_H1
+        self.assertEqual(len(tp_block), 26)
+        
+        # dig_H2 = 359, dig_H3 = 0, dig_H4 = 333 (0x14D), dig_H5 = -30 (0xFE2), dig_H6 = 30
+        hum_block = bytes([0x67, 0x01, 0x00, 0x14, 0x2D, 0xFE, 0x1E])
+        self.assertEqual(len(hum_block), 7)
+        
+        dig = struct.unpack('<HhhHhhhhhhhh', tp_block[:24])
+        dig_H1 = tp_block[0xA1 - 0x88]
+        dig_H2 = struct.unpack('<h', hum_block[0:2])[0]
+        dig_H3 = hum_block[2]
+        dig_H4 = (struct.unpack('b', hum_block[3:4])[0] * 16) | (hum_block[4] & 0x0F)
+        dig_H5 = (struct.unpack('b', hum_block[5:6])[0] * 16) | ((hum_block[4] >> 4) & 0x0F)
+        dig_H6 = struct.unpack('b', hum_block[6:7])[0]
+        
+        self.assertEqual(dig[0], 27504)
+        self.assertEqual(dig[4], -10685)
+        self.assertEqual(dig_H1, 75)
+        self.assertEqual(dig_H2, 359)
+        self.assertEqual(dig_H3, 0)
+        self.assertEqual(dig_H4, 333)
+        self.assertEqual(dig_H5, -30)
+        self.assertEqual(dig_H6, 30)
+
+class TestBME280Timing(unittest.TestCase):
+    """Test BME280 conversion time computation (datasheet section 9.1)"""
+    
+    @staticmethod
+    def osrs_factor(osrs):
+        """Oversampling factor for a 3-bit osrs_x register field"""
+        if osrs == 0:
+            return 0
+        return 16 if osrs >= 5 else 1 << (osrs - 1)
+    
+    @staticmethod
+    def meas_time_us(t, p, h, maximum=True):
+        """Simulate BME280_MEAS_TIME_TYP_US / BME280_MEAS_TIME_MAX_US"""
+        if maximum:
+            return 1250 + 2300 * t + (2300 * p + 575 if p else 0) + (2300 * h + 575 if h else 0)
+        return 1000 + 2000 * t + (2000 * p + 500 if p else 0) + (2000 * h + 500 if h else 0)
+    
+    def test_default_settings(self):
+        """1x/1x/1x oversampling matches the datasheet figures"""
+        self.assertEqual(self.meas_time_us(1, 1, 1), 9300)
+        self.assertEqual(self.meas_time_us(1, 1, 1, maximum=False), 8000)
+    
+    def test_high_oversampling_exceeds_old_fixed_wait(self):
+        """Higher oversampling needs more than the old fixed 10 ms sleep"""
+        t, p, h = self.osrs_factor(2), self.osrs_factor(5), self.osrs_factor(1)
+        self.assertEqual((t, p, h), (2, 16, 1))
+        self.assertGreater(self.meas_time_us(t, p, h), 10000)
+    
+    def test_skipped_channels(self):
+        """Skipped channels add no conversion time"""
+        self.assertEqual(self.osrs_factor(0), 0)
+        self.assertEqual(self.meas_time_us(1, 0, 0), 3550)
+
+class TestBME280PressureCompensation(unittest.TestCase):
+    """Golden vectors for the 32-bit and 64-bit pressure compensation engines"""
+    
+    # Datasheet example calibration and raw readings
+    CALIB = {
+        'dig_T1': 27504, 'dig_T2': 26435, 'dig_T3': -1000,
+        'dig_P1': 36477, 'dig_P2': -10685, 'dig_P3': 3024,
+        'dig_P4': 2855, 'dig_P5': 140, 'dig_P6': -7,
+        'dig_P7': 15500, 'dig_P8': -14600, 'dig_P9': 6000
+    }
+    ADC_T = 519888
+    ADC_P = 415148
+    
+    @staticmethod
+    def s32(x):
+        """Wrap to a C int32_t"""
+        x &= 0xFFFFFFFF
+        return x - (1 << 32) if x & 0x80000000 else x
+    
+    @staticmethod
+    def u32(x):
+        """Wrap to a C uint32_t"""
+        return x & 0xFFFFFFFF
+    
+    def t_fine(self):
+        c = self.CALIB
+        var1 = (((self.ADC_T >> 3) - (c['dig_T1'] << 1)) * c['dig_T2']) >> 11
+        var2 = (((((self.ADC_T >> 4) - c['dig_T1']) *
+                  ((self.ADC_T >> 4) - c['dig_T1'])) >> 12) * c['dig_T3']) >> 14
+        return var1 + var2
+    
+    def compensate_32bit(self, adc_P, t_fine):
+        """Simulate the 32-bit engine, including its unsigned wrap-around"""
+        c, s32, u32 = self.CALIB, self.s32, self.u32
+        var1 = s32((t_fine >> 1) - 64000)
+        var2 = s32((((var1 >> 2) * (var1 >> 2)) >> 11) * c['dig_P6'])
+        var2 = s32(var2 + s32((var1 * c['dig_P5']) << 1))
+        var2 = s32((var2 >> 2) + (c['dig_P4'] << 16))
+        var1 = s32((((c['dig_P3'] * s32(((var1 >> 2) * (var1 >> 2)) >> 13)) >> 3) +
+                    ((c['dig_P2'] * var1) >> 1)) >> 18)
+        var1 = s32(((32768 + var1) * c['dig_P1']) >> 15)
+        p = u32(u32(u32(1048576 - adc_P) - (var2 >> 12)) * 3125)
+        if p < 0x80000000:
+            p = u32(p << 1) // var1
+        else:
+            p = (p // var1) * 2
+        var1 = s32((c['dig_P9'] * s32(((p >> 3) * (p >> 3)) >> 13)) >> 12)
+        var2 = s32((s32(p >> 2) * c['dig_P8']) >> 13)
+        return u32(s32(p) + ((var1 + var2 + c['dig_P7']) >> 4))
+    
+    def compensate_64bit_q24_8(self, adc_P, t_fine):
+        """Simulate the 64-bit engine before rounding (Q24.8 Pa)"""
+        c = self.CALIB
+        var1 = t_fine - 128000
+        var2 = var1 * var1 * c['dig_P6']
+        var2 = var2 + ((var1 * c['dig_P5']) << 17)
+        var2 = var2 + (c['dig_P4'] << 35)
+        var1 = ((var1 * var1 * c['dig_P3']) >> 8) + ((var1 * c['dig_P2']) << 12)
+        var1 = (((1 << 47) + var1) * c['dig_P1']) >> 33
+        num = (((1048576 - adc_P) << 31) - var2) * 3125
+        p = abs(num) // abs(var1) * (1 if (num >= 0) == (var1 >= 0) else -1)  # C division
+        var1 = (c['dig_P9'] * (p >> 13) * (p >> 13)) >> 25
+        var2 = (c['dig_P8'] * p) >> 19
+        return ((p + var1 + var2) >> 8) + (c['dig_P7'] << 4)
+    
+    def test_temperature_golden(self):
+        """Datasheet example gives 25.08 °C"""
+        self.assertEqual((self.t_fine() * 5 + 128) >> 8, 2508)
+    
+    def test_32bit_golden(self):
+        """32-bit engine is within a few Pa of the 100653.27 Pa reference"""
+        p = self.compensate_32bit(self.ADC_P, self.t_fine())
+        self.assertEqual(p, 100656)
+    
+    def test_64bit_golden(self):
+        """64-bit engine rounds its Q24.8 result to the nearest Pa"""
+        q24_8 = self.compensate_64bit_q24_8(self.ADC_P, self.t_fine())
+        self.assertEqual(q24_8, 25767233)
+        self.assertEqual((q24_8 + 128) >> 8, 100653)
+    
+    def test_engines_agree_across_range(self):
+        """Both engines stay within 0.1 hPa (one payload LSB) of each other"""
+        t_fine = self.t_fine()
+        for adc_P in range(250000, 600001, 25000):
+            p32 = self.compensate_32bit(adc_P, t_fine)
+            p64 = (self.compensate_64bit_q24_8(adc_P, t_fine) + 128) >> 8
+            self.assertLessEqual(abs(p32 - p64), 10)
+            self.assertLess((p64 + 5) // 10, 0xFFFF)
+
+class TestRV3028(unittest.TestCase):
+    """Test RV-3028 countdown timer programming and register batching"""
+    
+    TD_1HZ = 0x02
+    TD_1_60HZ = 0x03
+    
+    @staticmethod
+    def timer_setting(period_s):
+        """Simulate the clock/value choice in rv3028_start_periodic_timer()"""
+        if period_s == 0 or period_s > 4095 * 60:
+            return None
+        if period_s <= 4095:
+            return 0x02, period_s
+        return 0x03, min((period_s + 30) // 60, 4095)
+    
+    def test_tier_intervals_use_second_ticks(self):
+        """All tier wake intervals fit the 12-bit timer at 1 Hz"""
+        for minutes in (5, 15, 30, 60):
+            self.assertEqual(self.timer_setting(minutes * 60), (self.TD_1HZ, minutes * 60))
+    
+    def test_long_periods_use_minute_ticks(self):
+        """Periods past 4095 s switch to 1/60 Hz ticks"""
+        self.assertEqual(self.timer_setting(4096), (self.TD_1_60HZ, 68))
+        self.assertEqual(self.timer_setting(6 * 3600), (self.TD_1_60HZ, 360))
+        self.assertIsNone(self.timer_setting(0))
+        self.assertIsNone(self.timer_setting(4096 * 60))
+    
+    @staticmethod
+    def update_burst(shadow, status_clear=0, ctrl1_set=0, ctrl1_clear=0,
+                     ctrl2_set=0, ctrl2_clear=0):
+        """Simulate rv3028_update(): (first register, bytes) of the burst write"""
+        regs = [~status_clear & 0xFF,
+                (shadow[0] & ~ctrl1_clear) | ctrl1_set,
+                (shadow[1] & ~ctrl2_clear) | ctrl2_set]
+        touched = [status_clear != 0, regs[1] != shadow[0], regs[2] != shadow[1]]
+        if not any(touched):
+            return None
+        first = touched.index(True)
+        last = 2 - touched[::-1].index(True)
+        return 0x0E + first, regs[first:last + 1]
+    
+    def test_update_single_burst(self):
+        """Flag clears and control changes go out in one write"""
+        shadow = (0x86, 0x10)  # TRPT | TE | 1 Hz, TIE
+        # Clearing TF alone touches only STATUS
+        self.assertEqual(self.update_burst(shadow, status_clear=0x08), (0x0E, [0xF7]))
+        # Clear AF and set AIE: STATUS..CONTROL2, CONTROL1 from the shadow
+        self.assertEqual(self.update_burst(shadow, status_clear=0x04, ctrl2_set=0x08),
+                         (0x0E, [0xFB, 0x86, 0x18]))
+        # Bits already in the requested state cost no I2C traffic
+        self.assertIsNone(self.update_burst(shadow, ctrl2_set=0x10))
+
 class TestBLEAdvertising(unittest.TestCase):
     """Test BLE advertising data format"""
     
@@ -184,51 +572,170 @@ class TestBLEAdvertising(unittest.TestCase):
         decoded_company_id = struct.unpack('<H', mfg_data[0:2])[0]
         self.assertEqual(decoded_company_id, company_id)
 
-class TestBatteryMonitoring(unittest.TestCase):
-    """Test battery voltage monitoring"""
-    
-    def test_adc_to_voltage_conversion(self):
-        """Test ADC value to voltage conversion"""
-        
-        # Simulate ADC configuration
-        adc_resolution = 12
-        adc_reference = 3300  # 3.3V in mV
-        voltage_divider_ratio = 2
+    def test_fixed_point_payload_scaling(self):
+        """Test payload fields filled from the fixed-point BME280 results"""
         
-        # Test cases: (adc_value, expected_voltage_mv)
+        # (pressure Pa, humidity Q22.10) -> (pressure 0.1 hPa, humidity 0.01 %RH)
         test_cases = [
-            (2048, 3300),  # Half scale
-            (4095, 6598),  # Full scale (calculated: 4095 * 3300 * 2 / 4096 = 6598)
-            (0, 0),        # Zero
+            (101325, 47445, 10133, 4633),   # 1013.25 hPa, 46.333 %RH
+            (100653, 65536, 10065, 6400),   # 1006.53 hPa, 64.000 %RH
+            (30000, 102400, 3000, 10000),   # 300.00 hPa, 100 %RH
+        ]
+        
+        for pressure_pa, humidity_q10, expected_pressure, expected_humidity in test_cases:
+            self.assertEqual((pressure_pa + 5) // 10, expected_pressure)
+            self.assertEqual((humidity_q10 * 100 + 512) >> 10, expected_humidity)
+
+    def test_batched_history_round_trip(self):
+        """Test delta-encoded history readings appended after the v1 payload"""
+        
+        def put_delta(value, ref):
+            # Simulate put_delta() in ble_advertiser.c
+            delta = value - ref
+            if -128 < delta <= 127:
+                return struct.pack('<b', delta)
+            return bytes([0x80]) + struct.pack('<H', value & 0xFFFF)
+        
+        # Newest first: (temperature, pressure, humidity, interval_s)
+        readings = [
+            (2150, 10132, 4500, 300),
+            (2148, 10131, 4510, 300),
+            (1890, 10131, 4510, 900),      # Temperature jump needs the escape
+            (1890, 0xFFFF, 0xFFFF, 900),   # Pressure and humidity skipped
         ]
         
-        for adc_value, expected_voltage_mv in test_cases:
-            voltage_mv = (adc_value * adc_reference * voltage_divider_ratio) // (1 << adc_resolution)
-            self.assertEqual(voltage_mv, expected_voltage_mv)
+        history = bytes([len(readings) - 1])
+        for newer, older in zip(readings, readings[1:]):
+            history += struct.pack('<H', older[3])
+            history += b''.join(put_delta(older[i], newer[i]) for i in range(3))
+        self.assertEqual(len(history), 1 + 5 + 7 + 9)
+        
+        # Simulate SensorDataDecoder.decode_history()
+        count, pos, age_s = history[0], 1, 0
+        ref = list(readings[0][:3])
+        decoded = []
+        for _ in range(count):
+            age_s += struct.unpack('<H', history[pos:pos + 2])[0]
+            pos += 2
+            values = []
+            for i, fmt in enumerate(('<h', '<H', '<H')):
+                if history[pos] == 0x80:
+                    values.append(struct.unpack(fmt, history[pos + 1:pos + 3])[0])
+                    pos += 3
+                else:
+                    values.append(ref[i] + struct.unpack('<b', history[pos:pos + 1])[0])
+                    pos += 1
+            ref = values
+            decoded.append((age_s, *values))
+        
+        self.assertEqual(pos, len(history))
+        self.assertEqual(decoded, [
+            (300, 2148, 10131, 4510),
+            (1200, 1890, 10131, 4510),
+            (2100, 1890, 0xFFFF, 0xFFFF),
+        ])
+
+    def test_maintenance_window_schedule(self):
+        """Test the maintenance flag and the window schedule"""
+        
+        def maintenance_due(runtime_s, last_s, tier, interval_h=24):
+            # Simulate adaptive_scheduler_maintenance_due()
+            return tier != 3 and ((runtime_s - last_s) & 0xFFFFFFFF) >= interval_h * 3600
+        
+        # Flag in the high nibble of the version byte; the layout is unchanged
+        version_byte = 2 | 0x80
+        self.assertEqual(version_byte & 0x0F, 2)
+        self.assertTrue(version_byte & 0x80)
+        
+        # A 5-minute node opens a window on the 288th wake after the last one
+        last_s = 0
+        windows = []
+        for wake in range(1, 600):
+            runtime_s = wake * 300
+            if maintenance_due(runtime_s, last_s, 0):
+                windows.append(wake)
+                last_s = runtime_s
+        self.assertEqual(windows, [288, 576])
+        
+        # The survival tier skips windows
+        self.assertFalse(maintenance_due(100000, 0, 3))
+        self.assertTrue(maintenance_due(100000, 0, 2))
+
+class TestBatteryMonitoring(unittest.TestCase):
+    """Test battery voltage monitoring"""
     
+    # Mirrors battery_monitor.h: 2.4 V full scale, 4.22M / 1.87M divider
+    FULL_SCALE_MV = 2400
+    DIVIDER_TOP_KOHM = 4220
+    DIVIDER_BOTTOM_KOHM = 1870
+    RESOLUTION = 12
+
+    LIPO_CURVE = [
+        (4200, 100), (4110, 90), (4020, 80), (3950, 70), (3870, 60), (3840, 50),
+        (3800, 40), (3770, 30), (3730, 20), (3690, 10), (3610, 5), (3270, 0),
+    ]
+
+    def mv_per_lsb_q16(self, trim_ppm=0):
+        total = self.DIVIDER_TOP_KOHM + self.DIVIDER_BOTTOM_KOHM
+        den = self.DIVIDER_BOTTOM_KOHM << self.RESOLUTION
+        num = (self.FULL_SCALE_MV * total << 16) * (1000000 + trim_ppm) // 1000000
+        return (num + den // 2) // den
+
+    def adc_to_mv(self, counts, coefficient):
+        return (max(counts, 0) * coefficient + (1 << 15)) >> 16
+
+    def test_adc_to_voltage_conversion(self):
+        """Integer Q16 conversion tracks the exact divider model"""
+        coefficient = self.mv_per_lsb_q16()
+        self.assertLessEqual(coefficient * (1 << self.RESOLUTION), 0xFFFFFFFF)
+
+        ratio = (self.DIVIDER_TOP_KOHM + self.DIVIDER_BOTTOM_KOHM) / self.DIVIDER_BOTTOM_KOHM
+        for counts in range(0, 4096, 7):
+            exact = counts * self.FULL_SCALE_MV / 4096 * ratio
+            self.assertLessEqual(abs(self.adc_to_mv(counts, coefficient) - exact), 1)
+
+        # Negative single-ended samples clamp to zero
+        self.assertEqual(self.adc_to_mv(-3, coefficient), 0)
+
+        # A 1 % trim moves a 3.7 V reading by about 37 mV
+        counts = round(3700 * 4096 / self.FULL_SCALE_MV / ratio)
+        trimmed = self.adc_to_mv(counts, self.mv_per_lsb_q16(10000))
+        self.assertAlmostEqual(trimmed - self.adc_to_mv(counts, coefficient), 37, delta=1)
+
+    def test_median_ewma_rejects_single_dip(self):
+        """One low reading does not move the filtered voltage"""
+        recent, ewma = [], None
+        for mv in [3700, 3702, 3150, 3701, 3699]:
+            recent = (recent + [mv])[-3:]
+            median = sorted(recent)[len(recent) // 2] << 4
+            ewma = median if ewma is None else ewma + int((median - ewma) / 4)
+            self.assertGreater(ewma >> 4, 3690)
+
     def test_battery_percentage_calculation(self):
-        """Test battery percentage calculation"""
-        
-        # Test cases: (voltage_mv, expected_percentage)
+        """LiPo discharge curve lookup"""
         test_cases = [
+            (4250, 100),  # Above full charge
             (4200, 100),  # Fully charged
-            (4000, 71),   # 71% (linear interpolation)
-            (3500, 0),    # Minimum safe voltage
-            (3300, 0),    # Below minimum
+            (4065, 85),   # Halfway between the 90 % and 80 % points
+            (3840, 50),   # Flat middle of the curve
+            (3650, 7),    # Steep knee near empty
+            (3270, 0),    # Cut-off
+            (3000, 0),    # Below cut-off
         ]
-        
+
         for voltage_mv, expected_percentage in test_cases:
             percentage = self.calculate_battery_percentage(voltage_mv)
             self.assertEqual(percentage, expected_percentage)
-    
+
     def calculate_battery_percentage(self, voltage_mv):
-        """Simulate battery percentage calculation"""
-        if voltage_mv >= 4200:
-            return 100
-        elif voltage_mv <= 3500:
-            return 0
-        else:
-            return int((voltage_mv - 3500) * 100 / (4200 - 3500))
+        """Simulate battery_monitor_get_percentage()"""
+        curve = self.LIPO_CURVE
+        if voltage_mv >= curve[0][0]:
+            return curve[0][1]
+        for (hi_mv, hi_pct), (lo_mv, lo_pct) in zip(curve, curve[1:]):
+            if voltage_mv >= lo_mv:
+                return lo_pct + (voltage_mv - lo_mv) * (hi_pct - lo_pct) // (hi_mv - lo_mv)
+        return 0
 
 def run_tests():
     """Run all tests"""
@@ -243,6 +750,9 @@ def run_tests():
         TestSensorDataEncoding,
         TestPowerTierLogic,
         TestBME280Calibration,
+        TestBME280Timing,
+        TestBME280PressureCompensation,
+        TestRV3028,
         TestBLEAdvertising,
         TestBatteryMonitoring
     ]
@@ -0,0 +1,254 @@
+#!/usr/bin/env python3
+"""
+Host Test Suite
+
+Tests the Raspberry Pi host logic (scanner dedup, rollups, viewer table
+choice and the multi-gateway merge) against temporary databases. bleak is stubbed when it is not installed, so the
+suite runs on any machine.
+"""
+
+import unittest
+import logging
+import sys
+import os
+import tempfile
+import time
+import types
+from datetime import datetime
+from types import SimpleNamespace
+
+# Stand-in for bleak on machines without it; only the names the host
+# modules import are provided
+try:
+    import bleak  # noqa: F401
+except ImportError:
+    bleak = types.ModuleType('bleak')
+    bleak.BleakScanner = object
+    bleak.BleakClient = object
+    sys.modules['bleak'] = bleak
+    for name in ('bleak.exc', 'bleak.backends', 'bleak.backends.scanner',
+                 'bleak.backends.device'):
+        sys.modules[name] = types.ModuleType(name)
+    sys.modules['bleak.exc'].BleakError = type('BleakError', (Exception,), {})
+    sys.modules['bleak.backends.scanner'].AdvertisementData = object
+    sys.modules['bleak.backends.device'].BLEDevice = object
+
+# Add the host directory to the path for imports
+sys.path.append(os.path.join(os.path.dirname(os.path.dirname(os.path.abspath(__file__))),
+                             'pi_host'))
+
+from sensor_scanner import BLESensorScanner, SensorData, SensorDatabase  # noqa: E402
+import data_viewer  # noqa: E402
+from central_store import CentralStore  # noqa: E402
+
+# The scanner logs every reading at INFO; keep the test output readable
+logging.disable(logging.INFO)
+
+class TestScannerDedup(unittest.TestCase):
+    """Test that repeated advertisements are stored once with RSSI aggregates"""
+
+    def setUp(self):
+        self.tmp = tempfile.TemporaryDirectory()
+        self.scanner = BLESensorScanner(os.path.join(self.tmp.name, 'sensor_data.db'))
+        self.device = SimpleNamespace(address='AA:BB:CC:DD:EE:FF')
+
+    def tearDown(self):
+        self.scanner.db.close()
+        self.tmp.cleanup()
+
+    @staticmethod
+    def reading(seq, history=()):
+        return {
+            'temperature': 21.5, 'pressure': 1013.2, 'humidity': 45.0,
+            'battery_mv': 3700, 'tier': 0, 'seq': seq, 'history': list(history),
+        }
+
+    def receive(self, decoded, rssi, raw=b''):
+        adv = SimpleNamespace(rssi=rssi, local_name='TempSensor')
+        self.scanner._process_sensor_data(self.device, adv, decoded, raw)
+
+    def queued(self):
+        rows = []
+        while not self.scanner.ingest.queue.empty():
+            rows.append(self.scanner.ingest.queue.get_nowait())
+        return rows
+
+    def test_repeats_aggregate_rssi(self):
+        """Copies of one reading fold into a single row"""
+        for rssi in (-60, -50, -70):
+            self.receive(self.reading(7), rssi)
+
+        # Nothing is stored while the advertising window may still repeat it
+        self.assertEqual(self.queued(), [])
+
+        # The next reading closes the window
+        self.receive(self.reading(8), -55)
+        rows = self.queued()
+        self.assertEqual(len(rows), 1)
+        self.assertEqual(rows[0].seq, 7)
+        self.assertEqual(rows[0].copies, 3)
+        self.assertEqual((rows[0].rssi, rows[0].rssi_min, rows[0].rssi_max), (-60, -70, -50))
+
+    def test_history_only_new_readings(self):
+        """Batched history already stored through an earlier reading is skipped"""
+        self.receive(self.reading(10), -60)
+        history = [{'seq': 10, 'age_s': 300, 'temperature': 21.0,
+                    'pressure': 1013.0, 'humidity': 44.0},
+                   {'seq': 9, 'age_s': 600, 'temperature': 20.5,
+                    'pressure': 1012.8, 'humidity': 44.5}]
+        self.receive(self.reading(11, history), -60)
+        self.scanner.flush_pending()
+
+        self.assertEqual([row.seq for row in self.queued()], [10, 11])
+
+    def test_v1_keyed_on_payload(self):
+        """v1 readings without a sequence number dedup on timestamp and payload"""
+        decoded = dict(self.reading(None), timestamp=1234)
+        self.receive(decoded, -60, b'\x01\x02')
+        self.receive(decoded, -62, b'\x01\x02')
+        self.receive(decoded, -64, b'\x01\x03')
+        self.scanner.flush_pending()
+
+        self.assertEqual([row.copies for row in self.queued()], [2, 1])
+
+class TestRollups(unittest.TestCase):
+    """Test the ingest-time rollups and the viewer's table choice"""
+
+    def setUp(self):
+        self.tmp = tempfile.TemporaryDirectory()
+        self.db = SensorDatabase(os.path.join(self.tmp.name, 'sensor_data.db'))
+
+    def tearDown(self):
+        self.db.close()
+        self.tmp.cleanup()
+
+    @staticmethod
+    def reading(ts, temperature, humidity=None):
+        return SensorData(device_address='AA:BB:CC:DD:EE:FF', device_name='TempSensor',
+                          timestamp=datetime.fromtimestamp(ts), temperature=temperature,
+                          pressure=1013.0, humidity=humidity, battery_mv=3700,
+                          power_tier=0, rssi=-60)
+
+    def test_batches_merge_into_buckets(self):
+        """Partial rollup rows from separate batches merge exactly"""
+        base = 3600 * 1000
+        self.db.insert_batch([self.reading(base + 10, 20.0, 40.0)])
+        self.db.insert_batch([self.reading(base + 20, 22.0), self.reading(base + 70, 30.0)])
+
+        rows = self.db.conn.execute(
+            'SELECT bucket, n, temp_n, temp_sum, temp_min, temp_max, hum_n '
+            'FROM rollup_1m ORDER BY bucket').fetchall()
+        self.assertEqual(rows, [(base, 2, 2, 42.0, 20.0, 22.0, 1),
+                                (base + 60, 1, 1, 30.0, 30.0, 30.0, 0)])
+        self.assertEqual(self.db.conn.execute(
+            'SELECT n, temp_sum FROM rollup_1h').fetchall(), [(3, 72.0)])
+
+    def test_choose_table_covering_range(self):
+        """A range the raw rows span is answered from the finest table in the limit"""
+        now = int(time.time())
+        self.db.insert_batch([self.reading(now - 2 * 3600, 20.0),
+                              self.reading(now - 60, 21.0)])
+        since = now - 3600
+        self.assertEqual(data_viewer.choose_table(self.db.conn, since, 1, 100), 'sensor_data')
+        self.assertEqual(data_viewer.choose_table(self.db.conn, since, 1, 30), 'rollup_1h')
+
+    def test_choose_table_young_database(self):
+        """Without a table reaching back far enough the finest one is used, not daily rows"""
+        now = int(time.time())
+        self.db.insert_batch([self.reading(now - 1800, 20.0), self.reading(now - 60, 21.0)])
+        since = now - 3600
+        self.assertEqual(data_viewer.choose_table(self.db.conn, since, 1, 100), 'sensor_data')
+        self.assertEqual(data_viewer.choose_table(self.db.conn, since, 1, 30), 'rollup_1h')
+
+    def test_choose_table_pruned_raw(self):
+        """Raw rows pruned past the range give way to the rollup that kept the data"""
+        now = int(time.time())
+        self.db.insert_batch([self.reading(now - 40 * 86400, 20.0),
+                              self.reading(now - 60, 21.0)])
+        self.db.prune()
+        since = now - 60 * 86400
+        self.assertEqual(data_viewer.choose_table(self.db.conn, since, 60 * 24, 100000),
+                         'rollup_1m')
+
+class TestCentralStore(unittest.TestCase):
+    """Test that copies from several gateways merge into one stored reading"""
+
+    def setUp(self):
+        self.tmp = tempfile.TemporaryDirectory()
+        self.store = CentralStore(os.path.join(self.tmp.name, 'central.db'))
+
+    def tearDown(self):
+        self.store.db.close()
+        self.tmp.cleanup()
+
+    @staticmethod
+    def reading(seq, gateway, rssi):
+        return SensorData(device_address='AA:BB:CC:DD:EE:FF', device_name='TempSensor',
+                          timestamp=datetime.now(), temperature=21.5, pressure=1013.2,
+                          humidity=45.0, battery_mv=3700, power_tier=0, rssi=rssi,
+                          seq=seq, rssi_min=rssi, rssi_max=rssi, gateway=gateway)
+
+    def stored(self):
+        rows = []
+        while not self.store.ingest.queue.empty():
+            rows.append(self.store.ingest.queue.get_nowait())
+        return rows
+
+    def test_best_rssi_kept(self):
+        """The gateway with the strongest copy wins, history only the other heard is kept"""
+        self.store.submit_report('gw-a', (5,), [self.reading(5, 'gw-a/hci0', -80),
+                                                self.reading(4, 'gw-a/hci0', -80)])
+        self.store.submit_report('gw-b', (5,), [self.reading(5, 'gw-b/hci0', -50)])
+        self.store.flush_pending()
+
+        rows = self.stored()
+        self.assertEqual([(row.seq, row.gateway) for row in rows],
+                         [(5, 'gw-b/hci0'), (4, 'gw-a/hci0')])
+        self.assertEqual(self.store.duplicates, 1)
+
+    def test_late_report_dropped(self):
+        """A report arriving after its reading was stored is not written again"""
+        self.store.submit_report('gw-a', (5,), [self.reading(5, 'gw-a/hci0', -60)])
+        self.store.flush_pending()
+        self.store.submit_report('gw-b', (5,), [self.reading(5, 'gw-b/hci0', -40)])
+        self.store.submit_report('gw-b', (6,), [self.reading(6, 'gw-b/hci0', -40),
+                                                self.reading(5, 'gw-b/hci0', -40)])
+        self.store.flush_pending()
+
+        self.assertEqual([row.seq for row in self.stored()], [5, 6])
+        self.assertEqual(self.store.duplicates, 1)
+
+def run_tests():
+    """Run all tests"""
+    print("Running Host Tests...")
+    print("=" * 50)
+
+    # Create test suite
+    test_suite = unittest.TestSuite()
+
+    # Add test classes
+    test_classes = [
+        TestScannerDedup,
+        TestRollups,
+        TestCentralStore
+    ]
+
+    for test_class in test_classes:
+        tests = unittest.TestLoader().loadTestsFromTestCase(test_class)
+        test_suite.addTests(tests)
+
+    # Run tests
+    runner = unittest.TextTestRunner(verbosity=2)
+    result = runner.run(test_suite)
+
+    # Print summary
+    print("=" * 50)
+    print(f"Tests run: {result.testsRun}")
+    print(f"Failures: {len(result.failures)}")
+    print(f"Errors: {len(result.errors)}")
+
+    return len(result.failures) + len(result.errors) == 0
+
+if __name__ == "__main__":
+    success = run_tests()
+    sys.exit(0 if success else 1)